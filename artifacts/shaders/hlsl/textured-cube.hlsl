@@ -18,31 +18,47 @@ struct VertexData {
   uint   iid      : SV_InstanceID;
 };
 
+// Per-vertex data, followed by per-instance data.
+struct InstancedVertexData {
+  float3 position     : SV_POSITION0;
+  float2 uv           : ATTR0;
+  float4 offset_scale : ATTR1; // World-space position and uniform scale.
+  float2 rotation     : ATTR2; // Sine and cosine of the angle around Y.
+  float4 color        : ATTR3;
+};
+
 struct PSInput {
   float4 clip_pos : SV_POSITION;
   float2 uv : ATTR0;
+  float4 color : ATTR1;
 };
 
 PSInput VSMain(VertexData vertex) {
   PSInput result = {
     mul(u_WorldToClip * u_ModelToWorld, float4(vertex.position, 1.0)),
-    vertex.uv
+    vertex.uv,
+    float4(1.0, 1.0, 1.0, 1.0)
   };
   return result;
 }
 
-PSInput VSMainInstanced(VertexData vertex) {
-  uint    col    =  vertex.iid % 200;
-  uint    row    = (vertex.iid - col) / 220;
-  float4  pos    =  float4(vertex.position + float3((float)col * 5.0, (float)row * 5.0, 0.0), 1.0);
+PSInput VSMainInstanced(InstancedVertexData vertex) {
+  float  s       = vertex.rotation.x;
+  float  c       = vertex.rotation.y;
+  float3 rotated = float3(vertex.position.x * c + vertex.position.z * s,
+                          vertex.position.y,
+                          vertex.position.z * c - vertex.position.x * s);
+  float4 pos     = float4(rotated * vertex.offset_scale.w +
+                          vertex.offset_scale.xyz, 1.0);
   PSInput result = {
     mul(u_WorldToClip, pos),
-    vertex.uv
+    vertex.uv,
+    vertex.color
   };
   return result;
 }
 
 float4 PSMain(PSInput ps_in) : SV_TARGET {
-  return tex.Sample(smp, ps_in.uv);
+  return tex.Sample(smp, ps_in.uv) * ps_in.color;
 }
 
@@ -0,0 +1,21 @@
+//T: upscale ps:PSMain vs:VSMain
+
+#include "triangle.hlsl"
+
+[[vk::binding(0, 0)]] cbuffer UpscaleParams {
+  // Fraction of the source image that the scaled frame occupies.
+  float2 u_UVScale;
+  // Texture coordinates of the centers of the scaled frame's last texels.
+  float2 u_UVMax;
+};
+
+[[vk::binding(1, 0)]] uniform Texture2D tex;
+[[vk::binding(2, 0)]] uniform sampler samp;
+
+float4 PSMain(Triangle_PSInput ps_in) : SV_TARGET {
+  return tex.Sample(samp, min(ps_in.texcoord * u_UVScale, u_UVMax));
+}
+
+Triangle_PSInput VSMain(uint vid : SV_VertexID) {
+  return Triangle(vid, 1.0, 0.0, 0.0);
+}
@@ -0,0 +1,128 @@
+#[[
+Copyright (c) 2021 nicegraf contributors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+]]
+
+# Shader build step.
+#
+# When included, defines ngf_shader_includes, which lists the files a shader
+# includes (directly or not). The main CMakeLists uses it to make shaders
+# depend on their includes.
+#
+# When run as a script (cmake -P), compiles one shader with nicegraf_shaderc,
+# unless the shader and everything it includes are exactly the same as the
+# last time it was compiled, in which case the existing outputs are kept.
+# It also writes a depfile listing the includes, for generators that support
+# them. Expects the following variables:
+#  SHADERC      - path to nicegraf_shaderc;
+#  SOURCE       - the shader to compile;
+#  TARGETS      - comma-separated nicegraf_shaderc targets (e.g. "spv");
+#  HEADER       - name of the binding constants header to generate;
+#  INCLUDE_DIRS - comma-separated directories to look for includes in, after
+#                 the including file's own directory;
+#  OUTPUTS      - comma-separated files the compiler is expected to produce;
+#  STAMP        - file to record the hash of the compiled sources in;
+#  DEPFILE      - depfile to write, listing dependencies of STAMP.
+
+# Appends the files included by `file` (recursively) to the list `out_var`,
+# skipping the ones that are already on it.
+function(ngf_shader_includes file include_dirs out_var)
+  set(result ${${out_var}})
+  file(STRINGS ${file} include_lines REGEX "^[ \t]*#[ \t]*include[ \t]*\"")
+  get_filename_component(file_dir ${file} DIRECTORY)
+  foreach(include_line ${include_lines})
+    string(REGEX REPLACE "^[ \t]*#[ \t]*include[ \t]*\"([^\"]+)\".*" "\\1"
+           include_name "${include_line}")
+    set(include_path "")
+    foreach(dir ${file_dir} ${include_dirs})
+      if (NOT include_path AND EXISTS "${dir}/${include_name}")
+        get_filename_component(include_path "${dir}/${include_name}" ABSOLUTE)
+      endif()
+    endforeach(dir)
+    if (include_path)
+      list(FIND result ${include_path} found)
+      if (found EQUAL -1)
+        list(APPEND result ${include_path})
+        ngf_shader_includes(${include_path} "${include_dirs}" result)
+      endif()
+    endif()
+  endforeach(include_line)
+  set(${out_var} ${result} PARENT_SCOPE)
+endfunction(ngf_shader_includes)
+
+if (NOT CMAKE_SCRIPT_MODE_FILE)
+  return()
+endif()
+
+string(REPLACE "," ";" TARGETS "${TARGETS}")
+string(REPLACE "," ";" INCLUDE_DIRS "${INCLUDE_DIRS}")
+string(REPLACE "," ";" OUTPUTS "${OUTPUTS}")
+
+set(includes "")
+ngf_shader_includes(${SOURCE} "${INCLUDE_DIRS}" includes)
+
+# Write the depfile first, so that includes are tracked even if compilation
+# fails.
+set(depfile_contents "${STAMP}:")
+foreach(dep ${SOURCE} ${includes})
+  string(REPLACE " " "\\ " dep "${dep}")
+  set(depfile_contents "${depfile_contents} \\\n  ${dep}")
+endforeach(dep)
+file(WRITE ${DEPFILE} "${depfile_contents}\n")
+
+# Hash everything that goes into the compiler: the sources the preprocessor
+# sees, the targets and the compiler itself.
+file(TIMESTAMP ${SHADERC} shaderc_timestamp)
+set(hash_input "${SHADERC} ${shaderc_timestamp} ${TARGETS} ${HEADER}")
+foreach(dep ${SOURCE} ${includes})
+  file(READ ${dep} dep_contents)
+  set(hash_input "${hash_input}\n${dep}\n${dep_contents}")
+endforeach(dep)
+string(SHA256 hash "${hash_input}")
+
+set(outputs_exist TRUE)
+foreach(output ${OUTPUTS})
+  if (NOT EXISTS ${output})
+    set(outputs_exist FALSE)
+  endif()
+endforeach(output)
+if (outputs_exist AND EXISTS ${STAMP})
+  file(READ ${STAMP} old_hash)
+  if (old_hash STREQUAL hash)
+    # Nothing changed, so only mark the outputs up to date.
+    execute_process(COMMAND ${CMAKE_COMMAND} -E touch ${OUTPUTS} ${STAMP})
+    return()
+  endif()
+endif()
+
+set(target_args "")
+foreach(target ${TARGETS})
+  list(APPEND target_args "-t" ${target})
+endforeach(target)
+get_filename_component(source_dir ${SOURCE} DIRECTORY)
+execute_process(COMMAND ${SHADERC} ${SOURCE} ${target_args}
+                        "-O" "../generated/" "-h" ${HEADER}
+                WORKING_DIRECTORY ${source_dir}
+                RESULT_VARIABLE shaderc_result)
+if (NOT shaderc_result EQUAL 0)
+  file(REMOVE ${STAMP})
+  message(FATAL_ERROR "Failed to compile ${SOURCE}")
+endif()
+file(WRITE ${STAMP} "${hash}")
@@ -33,16 +33,220 @@
 #define GET_GLFW_NATIVE_HANDLE(w) glfwGetX11Window(w)
 #endif
 #include <GLFW/glfw3native.h>
+#include <algorithm>
 #include <assert.h>
+#include <chrono>
 #include <stdint.h>
 #include <string>
 #include <vector>
 #include <fstream>
+#include <memory>
+#include <string.h>
+#include <thread>
 
 #include "common.h"
 #include "imgui_ngf_backend.h"
+#include "trace.h"
+#if defined(NGF_SAMPLES_NULL_BACKEND)
+#include "nicegraf_null.h"
+#endif
 #include <examples/imgui_impl_glfw.h>
 
+// Built-in context profiles. The first one is used unless another one is
+// requested on the command line or from the profile panel.
+static const context_profile builtin_profiles[] = {
+  // name, present mode, MSAA, swapchain capacity hint, depth format
+  { "default", NGF_PRESENTATION_MODE_FIFO, NGF_SAMPLE_COUNT_8, 2u,
+    NGF_IMAGE_FORMAT_DEPTH24_STENCIL8 },
+  { "triple-buffered", NGF_PRESENTATION_MODE_FIFO, NGF_SAMPLE_COUNT_8, 3u,
+    NGF_IMAGE_FORMAT_DEPTH24_STENCIL8 },
+  { "no-vsync", NGF_PRESENTATION_MODE_IMMEDIATE, NGF_SAMPLE_COUNT_8, 2u,
+    NGF_IMAGE_FORMAT_DEPTH24_STENCIL8 },
+  { "msaa-4x", NGF_PRESENTATION_MODE_FIFO, NGF_SAMPLE_COUNT_4, 2u,
+    NGF_IMAGE_FORMAT_DEPTH24_STENCIL8 },
+  { "no-msaa", NGF_PRESENTATION_MODE_FIFO, NGF_SAMPLE_COUNT_1, 2u,
+    NGF_IMAGE_FORMAT_DEPTH24_STENCIL8 },
+  { "depth32", NGF_PRESENTATION_MODE_FIFO, NGF_SAMPLE_COUNT_8, 2u,
+    NGF_IMAGE_FORMAT_DEPTH32 },
+  { "cheapest", NGF_PRESENTATION_MODE_IMMEDIATE, NGF_SAMPLE_COUNT_1, 2u,
+    NGF_IMAGE_FORMAT_DEPTH16 },
+};
+static constexpr size_t nbuiltin_profiles =
+    sizeof(builtin_profiles) / sizeof(builtin_profiles[0]);
+static size_t active_profile = 0u;
+
+// Index of the profile picked in the profile panel, if a switch is pending.
+static int requested_profile = -1;
+
+const context_profile& get_active_context_profile() {
+  return builtin_profiles[active_profile];
+}
+
+// Up to "swapchain capacity" frames may be queued for presentation while the
+// next one is recorded.
+static uint32_t max_frames_in_flight = 3u;
+
+// Command buffers queued for submission during the current frame.
+static std::vector<ngf_cmd_buffer> pending_cmd_buffers;
+
+void enqueue_cmd_buffer(ngf_cmd_buffer cmd_buf) {
+  pending_cmd_buffers.push_back(cmd_buf);
+}
+
+// Command buffers handed out by acquire_cmd_buffer, one slot per frame in
+// flight. A slot is only reused max_frames_in_flight frames later, by which
+// time the frame that recorded into it has retired.
+struct cmd_buffer_pool_slot {
+  std::vector<ngf::cmd_buffer> cmd_buffers;
+  size_t                       nused = 0u;
+};
+static std::vector<cmd_buffer_pool_slot> cmd_buffer_pool;
+static uint32_t                          current_pool_slot = 0u;
+
+// A framebuffer size change is only applied once the size has stayed the same
+// for this long, so that dragging a window border doesn't recreate the
+// swapchain on every intermediate size.
+static constexpr double resize_settle_seconds = 0.1;
+
+// File that recorded trace zones are saved to, when F12 is pressed or, if
+// requested on the command line, on exit.
+static const char *trace_path = "trace.json";
+
+static void save_trace() {
+  const int64_t nzones = trace_write_json(trace_path);
+  if (nzones < 0) {
+    fprintf(stderr, "failed to write trace to %s\n", trace_path);
+  } else {
+    printf("wrote %lld trace zones to %s\n", (long long)nzones, trace_path);
+  }
+}
+
+// Frame rate cap while the window is unfocused. 0 means no cap.
+static uint32_t unfocused_fps = 0u;
+
+// Per-frame budgets for transient data.
+static constexpr size_t transient_uniform_bytes = 64u * 1024u;
+static constexpr size_t transient_attrib_bytes = 1024u * 1024u;
+static constexpr size_t transient_index_bytes = 256u * 1024u;
+static transient_allocator transient_alloc;
+
+transient_allocator& get_transient_allocator() {
+  return transient_alloc;
+}
+
+// Worker threads shared by the common code and the samples.
+static std::unique_ptr<thread_pool> workers;
+
+thread_pool& get_thread_pool() {
+  return *workers;
+}
+
+// Context of the running sample, shared by the contexts of other threads.
+static ngf_context sample_context = nullptr;
+
+// A nicegraf context may only be current on one thread, so every worker gets
+// a context of its own, which shares objects with the sample's. It lives as
+// long as the thread does.
+static void init_worker_thread(ngf_context shared, const char *name) {
+  static thread_local ngf::context thread_context;
+  trace_set_thread_name(name);
+  const ngf_context_info ctx_info = {
+    nullptr, // swapchain_info (nullptr, no presentation from workers)
+    shared // shared_context
+  };
+  ngf_error err = thread_context.initialize(ctx_info);
+  assert(err == NGF_ERROR_OK);
+  err = ngf_set_context(thread_context);
+  assert(err == NGF_ERROR_OK);
+}
+
+std::unique_ptr<thread_pool> create_background_thread_pool(uint32_t nthreads) {
+  assert(sample_context != nullptr);
+  const ngf_context ctx = sample_context;
+  return std::unique_ptr<thread_pool>(new thread_pool(nthreads, [ctx] {
+    init_worker_thread(ctx, "background worker");
+  }));
+}
+
+// Resources of the running sample that get reloaded when their files change.
+// Reloads run on a thread of their own, so that a slow one doesn't hold up
+// the jobs of a frame.
+static hot_reloader reloader;
+static std::unique_ptr<thread_pool> reload_workers;
+
+void watch_resource(const std::vector<std::string> &files,
+                    hot_reloader::reload_fn         reload) {
+  reloader.watch(files, std::move(reload));
+}
+
+static ngf_error create_pipeline_objects(const pipeline_shaders   &shaders,
+                                         const pipeline_create_fn &create,
+                                         pipeline_objects         *p) {
+  ngf_error err = try_load_shader_stage(&p->vert_stage, shaders.vert_name,
+                                        shaders.vert_entry_point,
+                                        NGF_STAGE_VERTEX);
+  if (err == NGF_ERROR_OK) {
+    err = try_load_shader_stage(&p->frag_stage, shaders.frag_name,
+                                shaders.frag_entry_point, NGF_STAGE_FRAGMENT);
+  }
+  if (err == NGF_ERROR_OK) err = create(p);
+  return err;
+}
+
+void watch_pipeline(pipeline_objects               *target,
+                    const pipeline_shaders         &shaders,
+                    pipeline_create_fn              create,
+                    const std::vector<std::string> &extra_files) {
+  const ngf_error err = create_pipeline_objects(shaders, create, target);
+  assert(err == NGF_ERROR_OK);
+  std::vector<std::string> files {
+    shader_stage_path(shaders.vert_name, NGF_STAGE_VERTEX),
+    shader_stage_path(shaders.frag_name, NGF_STAGE_FRAGMENT)
+  };
+  files.insert(files.end(), extra_files.begin(), extra_files.end());
+  watch_resource(files, [target, shaders, create] {
+    auto p = std::make_shared<pipeline_objects>();
+    if (create_pipeline_objects(shaders, create, p.get()) != NGF_ERROR_OK) {
+      return hot_reloader::apply_fn {};
+    }
+    // The old pipeline goes before the stages it was created from.
+    return hot_reloader::apply_fn([target, p](ngf_cmd_buffer) {
+      target->pipeline = std::move(p->pipeline);
+      target->vert_stage = std::move(p->vert_stage);
+      target->frag_stage = std::move(p->frag_stage);
+    });
+  });
+}
+
+// The UI rendering backend of the running sample, if any.
+static ngf_imgui *active_ui = nullptr;
+
+void request_ui_glyphs(const char *utf8_text) {
+#if !defined(NGF_NO_IMGUI)
+  if (active_ui != nullptr) active_ui->request_glyphs(utf8_text);
+#else
+  (void)utf8_text;
+#endif
+}
+
+const ngf_imgui* get_ui_backend() {
+  return active_ui;
+}
+
+ngf_cmd_buffer acquire_cmd_buffer(ngf_frame_token frame_token) {
+  cmd_buffer_pool_slot &slot = cmd_buffer_pool[current_pool_slot];
+  if (slot.nused == slot.cmd_buffers.size()) {
+    ngf::cmd_buffer new_buf;
+    ngf_error err = new_buf.initialize(ngf_cmd_buffer_info{});
+    assert(err == NGF_ERROR_OK); err = NGF_ERROR_OK;
+    slot.cmd_buffers.emplace_back(std::move(new_buf));
+  }
+  ngf_cmd_buffer cmd_buf = slot.cmd_buffers[slot.nused++].get();
+  ngf_error err = ngf_start_cmd_buffer(cmd_buf, frame_token);
+  assert(err == NGF_ERROR_OK); err = NGF_ERROR_OK;
+  return cmd_buf;
+}
+
 void debugmsg_cb(const char *msg, const void*) {
   // TODO: surface these logs in a GUI console.
   printf("%s\n", msg);
@@ -69,54 +273,132 @@ void diagnostic_callback(ngf_diagnostic_message_type type, void *, const char* f
   va_end(a);
 }
 
-// This is the "common main" for desktop apps.
-int ENTRYFN(int, char **) {
-  // Initialize GLFW.
-  glfwInit();
- 
-  // Initialize nicegraf.
-  const ngf_init_info init_info = {
-     NGF_DEVICE_PREFERENCE_DONTCARE,
-    {
-    #ifndef NDEBUG
-      NGF_DIAGNOSTICS_VERBOSITY_DETAILED,
-    #else
-      NGF_DIAGNOSTICS_VERBOSITY_DEFAULT,
-    #endif
-      nullptr,
-      diagnostic_callback
+#if !defined(NGF_NO_IMGUI)
+// When enabled, frames on which the user hasn't interacted with the window
+// redraw the previous frame's UI instead of running ImGui and on_ui.
+static bool cache_idle_ui = false;
+
+// Input is considered settled this long after the last event, which lets
+// ImGui finish any animations it started in response to it.
+static constexpr double ui_settle_seconds = 0.5;
+
+// While idle, the UI is still rebuilt this often, so that values it displays
+// don't go stale.
+static constexpr double ui_idle_refresh_seconds = 0.5;
+
+// Time of the most recent input event.
+static double last_input_time = 0.0;
+
+static void note_input() { last_input_time = glfwGetTime(); }
+
+// GLFW callbacks that track input. ImGui's GLFW backend chains to these.
+static void mouse_button_callback(GLFWwindow*, int, int, int) {
+  note_input();
+}
+static void scroll_callback(GLFWwindow*, double, double) { note_input(); }
+static void key_callback(GLFWwindow*, int key, int, int action, int) {
+  note_input();
+  if (key == GLFW_KEY_F12 && action == GLFW_PRESS) save_trace();
+}
+static void char_callback(GLFWwindow*, unsigned int) { note_input(); }
+
+// The frame time readout is only updated this often. Text that changes on
+// every frame would keep the UI from ever being replayed.
+static constexpr double frame_time_refresh_seconds = 0.5;
+
+// Frame time shown in the profile panel, and when it was last updated.
+static float shown_frame_ms = 0.0f;
+static double shown_frame_ms_time = -1.0;
+
+// Draws a window for picking the context profile. The switch happens at the
+// end of the current frame.
+static void draw_profile_panel() {
+  ImGui::Begin("Context Profile", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+  if (ImGui::BeginCombo("Profile", get_active_context_profile().name)) {
+    for (size_t i = 0u; i < nbuiltin_profiles; ++i) {
+      if (ImGui::Selectable(builtin_profiles[i].name, i == active_profile) &&
+          i != active_profile) {
+        requested_profile = (int)i;
+      }
     }
-  };
-  ngf_error err = ngf_initialize(&init_info);
-  if (err != NGF_ERROR_OK) {
-    exit(1);
+    ImGui::EndCombo();
+  }
+  const double now = glfwGetTime();
+  if (shown_frame_ms_time < 0.0 ||
+      now - shown_frame_ms_time >= frame_time_refresh_seconds) {
+    shown_frame_ms = 1000.0f / ImGui::GetIO().Framerate;
+    shown_frame_ms_time = now;
   }
+  ImGui::Text("%.3f ms/frame", shown_frame_ms);
+  ImGui::Checkbox("cache idle UI", &cache_idle_ui);
+  ImGui::End();
+}
+#endif
 
-  // Tell GLFW not to attempt to create an API context for the
-  // window we're about to create (nicegraf does it for us).
-  glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+// Prints statistics for the given frame times (in milliseconds).
+static void print_frame_stats(const char *profile_name,
+                              std::vector<float> &frame_times) {
+  if (frame_times.empty()) return;
+  std::sort(frame_times.begin(), frame_times.end());
+  double total = 0.0;
+  for (float t : frame_times) total += t;
+  const size_t n = frame_times.size();
+  printf("%-16s frames: %6zu avg: %8.3f ms p50: %8.3f ms p95: %8.3f ms "
+         "max: %8.3f ms\n",
+         profile_name, n, total / (double)n, frame_times[n / 2],
+         frame_times[std::min(n - 1u, n * 95u / 100u)], frame_times[n - 1u]);
+}
 
-  // Create a GLFW window.
-  GLFWwindow *win = glfwCreateWindow(1024,
-                                     768,
-                                     "nicegraf sample",
-                                     nullptr,
-                                     nullptr);
-  assert(win != nullptr);
+// Runs the sample with the active context profile until the window is closed,
+// `max_frames` frames have been rendered (if nonzero) or a different profile
+// is requested. The duration of each frame is appended to `frame_times`.
+static void run_sample(GLFWwindow         *win,
+                       uint64_t            max_frames,
+                       std::vector<float> *frame_times) {
+  max_frames_in_flight = get_active_context_profile().capacity_hint + 1u;
+  cmd_buffer_pool.resize(max_frames_in_flight);
+  current_pool_slot = 0u;
 
   // Notify the app.
   int w, h;
   glfwGetFramebufferSize(win, &w, &h);
-  {
   init_result init_data = on_initialized((uintptr_t)GET_GLFW_NATIVE_HANDLE(win),
                                          (uint32_t)w,
                                          (uint32_t)h);
 
+  // Create the backing buffers for transient per-frame data.
+  ngf_error err = transient_alloc.initialize(max_frames_in_flight,
+                                             transient_uniform_bytes,
+                                             transient_attrib_bytes,
+                                             transient_index_bytes);
+  assert(err == NGF_ERROR_OK);
+
+  // Start the worker threads, leaving one core for the main thread.
+  const uint32_t nworkers =
+      std::max(2u, std::thread::hardware_concurrency()) - 1u;
+  ngf_context ctx = init_data.context.get();
+  sample_context = ctx;
+  workers.reset(new thread_pool(nworkers, [ctx] {
+    init_worker_thread(ctx, "worker");
+  }));
+  reload_workers = create_background_thread_pool(1u);
+
   // Create an ImGui context and initialize ImGui GLFW i/o backend and nicegraf
   // rendering backend for imgui.
   ImGui::SetCurrentContext(ImGui::CreateContext());
+#if !defined(NGF_NO_IMGUI)
+  glfwSetMouseButtonCallback(win, mouse_button_callback);
+  glfwSetScrollCallback(win, scroll_callback);
+  glfwSetKeyCallback(win, key_callback);
+  glfwSetCharCallback(win, char_callback);
+  double last_cursor_x = 0.0, last_cursor_y = 0.0;
+  double last_ui_build_time = 0.0;
+#endif
   ImGui_ImplGlfw_InitForOpenGL(win, true);
-  ngf_imgui ui; // ImGui nicegraf rendering backend.
+  // ImGui nicegraf rendering backend. It holds nicegraf objects, so it has to
+  // go away before the app destroys its context.
+  std::unique_ptr<ngf_imgui> ui { new ngf_imgui };
+  active_ui = ui.get();
 
   // Style ImGui controls.
   ImGui::StyleColorsLight();
@@ -141,59 +423,286 @@ int ENTRYFN(int, char **) {
                             NULL,
                             NULL,
                             &defaultrt);
-  int old_win_width = 1024, old_win_height = 768;
-  bool imgui_font_uploaded = false;
-  while (!glfwWindowShouldClose(win)) { // Main loop.
-    glfwPollEvents(); // Get input events.
+  int old_win_width = w, old_win_height = h; // Size the context has.
+  int pending_win_width = w, pending_win_height = h;
+  double pending_size_since = 0.0;
+  double next_frame_time = 0.0;
+  uint64_t frames_rendered = 0u;
+  auto last_frame_end = std::chrono::steady_clock::now();
+  requested_profile = -1;
+  while (!glfwWindowShouldClose(win) && requested_profile < 0 &&
+         (max_frames == 0u || frames_rendered < max_frames)) { // Main loop.
+    // Get input events. While the window is in the background and a frame
+    // rate cap is set, sleep until the next frame is due instead.
+    const double now = glfwGetTime();
+    if (unfocused_fps > 0u && now < next_frame_time &&
+        !glfwGetWindowAttrib(win, GLFW_FOCUSED)) {
+      glfwWaitEventsTimeout(next_frame_time - now);
+      continue;
+    }
+    {
+      NGF_SAMPLE_ZONE("poll events");
+      glfwPollEvents();
+    }
     
-    // Update renderable area size.
+    // Nothing is visible while the window is minimized, so don't render
+    // anything until it gets restored.
     int new_win_width = 0, new_win_height = 0;
     glfwGetFramebufferSize(win, &new_win_width, &new_win_height);
-    if (new_win_width != old_win_width || new_win_height != old_win_height) {
-      old_win_width = new_win_width; old_win_height = new_win_height;
+    if (new_win_width == 0 || new_win_height == 0) {
+      glfwWaitEventsTimeout(0.1);
+      last_frame_end = std::chrono::steady_clock::now();
+      continue;
+    }
+    NGF_SAMPLE_ZONE("frame");
+
+    // Update renderable area size once it has settled.
+    if (new_win_width != pending_win_width ||
+        new_win_height != pending_win_height) {
+      pending_win_width = new_win_width; pending_win_height = new_win_height;
+      pending_size_since = now;
+    }
+    if ((pending_win_width != old_win_width ||
+         pending_win_height != old_win_height) &&
+        now - pending_size_since >= resize_settle_seconds) {
+      old_win_width = pending_win_width; old_win_height = pending_win_height;
       ngf_resize_context(init_data.context,
-                         (uint32_t)new_win_width,
-                         (uint32_t)new_win_height);
+                         (uint32_t)old_win_width,
+                         (uint32_t)old_win_height);
+#if !defined(NGF_NO_IMGUI)
+      note_input();
+#endif
     }
     
     ngf_frame_token frame_token;
-    if (ngf_begin_frame(&frame_token) == NGF_ERROR_OK) {
-      // Notify application.
-      on_frame((uint32_t)old_win_width, (uint32_t)old_win_height,
-                (float)glfwGetTime(),
-                init_data.userdata, frame_token);
+    {
+      NGF_SAMPLE_ZONE("begin frame");
+      err = ngf_begin_frame(&frame_token);
+    }
+    if (err == NGF_ERROR_OK) {
+      // Recycle the command buffers of the frame that used this pool slot.
+      current_pool_slot = (current_pool_slot + 1u) % max_frames_in_flight;
+      cmd_buffer_pool[current_pool_slot].nused = 0u;
+      transient_alloc.begin_frame();
+
+      // Apply reloaded resources before the app records anything for this
+      // frame.
+      {
+        NGF_SAMPLE_ZONE("apply reloads");
+        reloader.poll(*reload_workers);
+        if (reloader.has_results()) {
+          ngf_cmd_buffer reload_cmd_buf = acquire_cmd_buffer(frame_token);
+          reloader.apply_results(reload_cmd_buf);
+          enqueue_cmd_buffer(reload_cmd_buf);
+        }
+      }
+
 #if !defined(NGF_NO_IMGUI)
-      // Give application a chance to submit its UI drawing commands.
-      // TODO: make toggleable.
-      ImGui::GetIO().DisplaySize.x = (float)new_win_width;
-      ImGui::GetIO().DisplaySize.y = (float)new_win_height;
-      ImGui::NewFrame();
-      ImGui_ImplGlfw_NewFrame();
-      on_ui(init_data.userdata);
-      // TODO: draw debug console window.
-
-      // Draw the UI.
-      ngf_start_cmd_buffer(uibuf, frame_token);
-      if (!imgui_font_uploaded) {
-        ui.upload_font_texture(uibuf);
-        imgui_font_uploaded = true;
+      // Cursor movement is polled rather than reported through a callback.
+      double cursor_x = 0.0, cursor_y = 0.0;
+      glfwGetCursorPos(win, &cursor_x, &cursor_y);
+      if (cursor_x != last_cursor_x || cursor_y != last_cursor_y) {
+        last_cursor_x = cursor_x; last_cursor_y = cursor_y;
+        note_input();
+      }
+
+      // Reuse the previous frame's UI if caching is on and nothing that
+      // could change it has happened recently.
+      const bool replay_ui =
+          cache_idle_ui && ui->can_replay() &&
+          now - last_input_time >= ui_settle_seconds &&
+          now - last_ui_build_time < ui_idle_refresh_seconds;
+      if (!replay_ui) {
+        NGF_SAMPLE_ZONE("build ui");
+        // Build the UI on the main thread: ImGui's input handling talks to
+        // GLFW, and on_ui is free to modify state that on_frame reads.
+        ImGui::GetIO().DisplaySize.x = (float)old_win_width;
+        ImGui::GetIO().DisplaySize.y = (float)old_win_height;
+        ui->update_font_atlas();
+        ImGui::NewFrame();
+        ImGui_ImplGlfw_NewFrame();
+        on_ui(init_data.userdata);
+        draw_profile_panel();
+        // TODO: draw debug console window.
+        last_ui_build_time = now;
+      }
+#endif
+
+      // Notify application.
+      {
+        NGF_SAMPLE_ZONE("on_frame");
+        on_frame((uint32_t)old_win_width, (uint32_t)old_win_height,
+                  (float)glfwGetTime(),
+                  init_data.userdata, frame_token);
       }
+
+#if !defined(NGF_NO_IMGUI)
+      // Record the UI rendering commands. Recording uses the command and
+      // descriptor pools of the sample's context, which can't be touched
+      // from two threads at once, so this happens on the main thread, after
+      // the app is done. The UI is drawn on top of everything else, so it
+      // goes last anyway.
       {
+        NGF_SAMPLE_ZONE("record ui");
+        ngf_start_cmd_buffer(uibuf, frame_token);
+        ui->upload_font_texture(uibuf);
         ngf::render_encoder enc { uibuf };
         ngf_cmd_begin_pass(enc, defaultrt);
-        ui.record_rendering_commands(enc);
+        if (replay_ui) {
+          ui->replay_rendering_commands(enc);
+        } else {
+          ui->record_rendering_commands(enc);
+        }
         ngf_cmd_end_pass(enc);
       }
-      ngf_cmd_buffer b = uibuf.get();
-      ngf_submit_cmd_buffers(1u, &b);
+      pending_cmd_buffers.push_back(uibuf.get());
 #endif
+      // Make transient data visible to the GPU, then submit everything
+      // recorded for this frame at once.
+      {
+        NGF_SAMPLE_ZONE("submit");
+        transient_alloc.end_frame();
+        if (!pending_cmd_buffers.empty()) {
+          ngf_submit_cmd_buffers((uint32_t)pending_cmd_buffers.size(),
+                                 pending_cmd_buffers.data());
+        }
+        pending_cmd_buffers.clear();
+      }
       // End frame.
-      ngf_end_frame(frame_token);
+      {
+        NGF_SAMPLE_ZONE("end frame");
+        ngf_end_frame(frame_token);
+      }
+      ++frames_rendered;
+      const auto frame_end = std::chrono::steady_clock::now();
+      frame_times->push_back(std::chrono::duration<float, std::milli>(
+          frame_end - last_frame_end).count());
+      last_frame_end = frame_end;
+      if (unfocused_fps > 0u) next_frame_time = now + 1.0 / unfocused_fps;
     }
   }
+  reloader.clear();
+  reload_workers.reset();
   ngf_destroy_render_target(defaultrt);
+  uibuf.reset(nullptr);
+  active_ui = nullptr;
+  ui.reset();
+  cmd_buffer_pool.clear();
+  workers.reset();
+  transient_alloc.destroy();
   on_shutdown(init_data.userdata);
+  sample_context = nullptr;
+  ImGui_ImplGlfw_Shutdown();
+  ImGui::DestroyContext();
+}
+
+// This is the "common main" for desktop apps.
+int ENTRYFN(int argc, char **argv) {
+  // Parse command line:
+  //  --frames N          exit after rendering N frames;
+  //  --unfocused-fps N   cap the frame rate at N while the window is
+  //                      unfocused;
+  //  --cache-idle-ui     redraw the previous frame's UI while there is no
+  //                      input;
+  //  --profile NAME      use the named context profile;
+  //  --sweep-profiles N  run every context profile for N frames, print
+  //                      frame time statistics for each and exit;
+  //  --trace FILE        save trace zones to FILE (instead of trace.json)
+  //                      on F12, and also on exit.
+  uint64_t max_frames = 0u;
+  uint64_t sweep_frames = 0u;
+  bool save_trace_on_exit = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      max_frames = strtoull(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--cache-idle-ui") == 0) {
+#if !defined(NGF_NO_IMGUI)
+      cache_idle_ui = true;
+#endif
+    } else if (strcmp(argv[i], "--unfocused-fps") == 0 && i + 1 < argc) {
+      unfocused_fps = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--sweep-profiles") == 0 && i + 1 < argc) {
+      sweep_frames = strtoull(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      trace_path = argv[++i];
+      save_trace_on_exit = true;
+    } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+      const char *name = argv[++i];
+      size_t p = 0u;
+      while (p < nbuiltin_profiles && strcmp(builtin_profiles[p].name, name)) {
+        ++p;
+      }
+      if (p == nbuiltin_profiles) {
+        fprintf(stderr, "unknown profile \"%s\". available profiles:\n", name);
+        for (const context_profile &profile : builtin_profiles) {
+          fprintf(stderr, "  %s\n", profile.name);
+        }
+        exit(1);
+      }
+      active_profile = p;
+    }
   }
+
+  trace_set_thread_name("main");
+
+  // Initialize GLFW.
+  glfwInit();
+ 
+  // Initialize nicegraf.
+  const ngf_init_info init_info = {
+     NGF_DEVICE_PREFERENCE_DONTCARE,
+    {
+    #ifndef NDEBUG
+      NGF_DIAGNOSTICS_VERBOSITY_DETAILED,
+    #else
+      NGF_DIAGNOSTICS_VERBOSITY_DEFAULT,
+    #endif
+      nullptr,
+      diagnostic_callback
+    }
+  };
+  ngf_error err = ngf_initialize(&init_info);
+  if (err != NGF_ERROR_OK) {
+    exit(1);
+  }
+
+  // Tell GLFW not to attempt to create an API context for the
+  // window we're about to create (nicegraf does it for us).
+  glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+
+  // Create a GLFW window.
+  GLFWwindow *win = glfwCreateWindow(1024,
+                                     768,
+                                     "nicegraf sample",
+                                     nullptr,
+                                     nullptr);
+  assert(win != nullptr);
+
+  if (sweep_frames > 0u) {
+    // Run every profile in turn, discarding the first 10% of the frames of
+    // each run as warm-up.
+    for (active_profile = 0u;
+         active_profile < nbuiltin_profiles && !glfwWindowShouldClose(win);
+         ++active_profile) {
+      std::vector<float> frame_times;
+      run_sample(win, sweep_frames, &frame_times);
+      frame_times.erase(frame_times.begin(),
+                        frame_times.begin() + (ptrdiff_t)(frame_times.size() / 10u));
+      print_frame_stats(get_active_context_profile().name, frame_times);
+    }
+  } else {
+    // Run until the window is closed, restarting the sample from scratch
+    // whenever a different profile is picked.
+    do {
+      if (requested_profile >= 0) active_profile = (size_t)requested_profile;
+      std::vector<float> frame_times;
+      run_sample(win, max_frames, &frame_times);
+    } while (requested_profile >= 0 && !glfwWindowShouldClose(win));
+  }
+#if defined(NGF_SAMPLES_NULL_BACKEND)
+  ngf_null_dump_stats(stdout);
+#endif
+  if (save_trace_on_exit) save_trace();
   glfwTerminate();
   return 0;
 }
@@ -206,52 +715,95 @@ int ENTRYFN(int, char **) {
 #define SHADER_EXTENSION ".12.msl"
 #endif
 
-ngf::shader_stage load_shader_stage(const char *root_name,
-                                    const char *entry_point_name,
-                                    ngf_stage_type type,
-                                    const char *prefix) {
+std::string shader_stage_path(const char *root_name,
+                              ngf_stage_type type,
+                              const char *prefix) {
   static const char *stage_names[] = {
     "vs", "ps"
   };
-  std::string file_name =
-       prefix + std::string(root_name) + "." + stage_names[type] +
-       SHADER_EXTENSION;
+  return prefix + std::string(root_name) + "." + stage_names[type] +
+         SHADER_EXTENSION;
+}
+
+ngf_error try_load_shader_stage(ngf::shader_stage *stage,
+                                const char *root_name,
+                                const char *entry_point_name,
+                                ngf_stage_type type,
+                                const char *prefix) {
+  NGF_SAMPLE_ZONE("load_shader_stage");
+  const std::string file_name = shader_stage_path(root_name, type, prefix);
   std::ifstream fs(file_name, std::ios::binary | std::ios::in);
-  assert(fs.is_open());
+  if (!fs.is_open()) {
+    fprintf(stderr, "failed to open %s\n", file_name.c_str());
+    return NGF_ERROR_OBJECT_CREATION_FAILED;
+  }
   std::vector<char> content((std::istreambuf_iterator<char>(fs)),
                        std::istreambuf_iterator<char>());
+  if (content.empty()) {
+    fprintf(stderr, "%s is empty\n", file_name.c_str());
+    return NGF_ERROR_INVALID_SIZE;
+  }
   ngf_shader_stage_info stage_info;
   stage_info.type = type;
   stage_info.content = content.data();
   stage_info.content_length = (uint32_t)content.size();
   stage_info.debug_name = "";
   stage_info.entry_point_name = entry_point_name;
+  ngf::shader_stage new_stage;
+  const ngf_error err = new_stage.initialize(stage_info);
+  if (err != NGF_ERROR_OK) {
+    fprintf(stderr, "failed to create a shader stage from %s\n",
+            file_name.c_str());
+    return err;
+  }
+  *stage = std::move(new_stage);
+  return NGF_ERROR_OK;
+}
+
+ngf::shader_stage load_shader_stage(const char *root_name,
+                                    const char *entry_point_name,
+                                    ngf_stage_type type,
+                                    const char *prefix) {
   ngf::shader_stage stage;
-  ngf_error err = stage.initialize(stage_info);
+  ngf_error err = try_load_shader_stage(&stage, root_name, entry_point_name,
+                                        type, prefix);
   assert(err == NGF_ERROR_OK); err = NGF_ERROR_OK;
   return stage;
 }
 
-ngf_plmd* load_pipeline_metadata(const char *name, const char *prefix) {
+ngf_plmd* try_load_pipeline_metadata(const char *name, const char *prefix) {
+  NGF_SAMPLE_ZONE("load_pipeline_metadata");
   std::string file_name = prefix + std::string(name) + ".pipeline";
   std::vector<char> content = load_raw_data(file_name.c_str());
-  ngf_plmd *m;
-  ngf_plmd_error err = ngf_plmd_load(content.data(), content.size(), NULL, &m);
-  assert(err == NGF_PLMD_ERROR_OK); err = NGF_PLMD_ERROR_OK;
+  ngf_plmd *m = NULL;
+  if (content.empty() ||
+      ngf_plmd_load(content.data(), content.size(), NULL, &m) !=
+          NGF_PLMD_ERROR_OK) {
+    fprintf(stderr, "failed to load pipeline metadata from %s\n",
+            file_name.c_str());
+    return NULL;
+  }
+  return m;
+}
+
+ngf_plmd* load_pipeline_metadata(const char *name, const char *prefix) {
+  ngf_plmd *m = try_load_pipeline_metadata(name, prefix);
+  assert(m != NULL);
   return m;
 }
 
 ngf::context create_default_context(uintptr_t handle, uint32_t w, uint32_t h) {
-  // Create a nicegraf context.
+  // Create a nicegraf context, configured according to the active profile.
+  const context_profile &profile = get_active_context_profile();
   ngf_swapchain_info swapchain_info = {
     NGF_IMAGE_FORMAT_BGRA8, // color format
-    NGF_IMAGE_FORMAT_DEPTH24_STENCIL8, // depth format (24bit)
-    NGF_SAMPLE_COUNT_8, // MSAA 8x
-    2u, // swapchain capacity hint
+    profile.depth_format, // depth format
+    profile.sample_count, // MSAA
+    profile.capacity_hint, // swapchain capacity hint
     w, // swapchain image width
     h, // swapchain image height
     handle,
-    NGF_PRESENTATION_MODE_FIFO,
+    profile.present_mode,
   };
   ngf_context_info ctx_info = {
     &swapchain_info, // swapchain_info
@@ -275,6 +827,7 @@ ngf::context create_default_context(uintptr_t handle, uint32_t w, uint32_t h) {
 
 
 std::vector<char> load_raw_data(const char *file_path) {
+  NGF_SAMPLE_ZONE("load_raw_data");
   std::ifstream fs(file_path, std::ios::binary);
   std::vector<char> content((std::istreambuf_iterator<char>(fs)),
                              std::istreambuf_iterator<char>());
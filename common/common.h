@@ -21,6 +21,12 @@ SOFTWARE.
 #include <vector>
 #include <nicegraf.h>
 #include <nicegraf_wrappers.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include "hot_reload.h"
+#include "thread_pool.h"
+#include "transient_allocator.h"
 
 ngf::shader_stage load_shader_stage(const char *root_name,
                                     const char *entry_point_name,
@@ -29,10 +35,126 @@ ngf::shader_stage load_shader_stage(const char *root_name,
 ngf_plmd* load_pipeline_metadata(const char *name,
                              const char *prefix = "shaders/generated/");
 
+// Variants of the above that report failures instead of asserting, for
+// loading files that may be broken or half-written, e.g. while hot reloading.
+// try_load_shader_stage leaves `stage` untouched unless it succeeds, and
+// try_load_pipeline_metadata returns NULL if it fails. Failures are logged to
+// stderr.
+ngf_error try_load_shader_stage(ngf::shader_stage *stage,
+                                const char *root_name,
+                                const char *entry_point_name,
+                                ngf_stage_type type,
+                                const char *prefix = "shaders/generated/");
+ngf_plmd* try_load_pipeline_metadata(const char *name,
+                                     const char *prefix = "shaders/generated/");
+
+// Returns the path of the file that load_shader_stage loads a stage from.
+std::string shader_stage_path(const char *root_name,
+                              ngf_stage_type type,
+                              const char *prefix = "shaders/generated/");
+
+// A swapchain configuration that the samples can be run with.
+struct context_profile {
+  const char           *name;
+  ngf_present_mode      present_mode;
+  ngf_sample_count      sample_count;
+  uint32_t              capacity_hint; // Swapchain capacity hint.
+  ngf_image_format      depth_format;
+};
+
+// Returns the profile that the sample is currently running with. Pipelines
+// that render to the default render target must use its sample count.
+// The profile can be picked with "--profile NAME" or from the profile panel;
+// switching profiles restarts the sample (on_shutdown, then on_initialized).
+const context_profile& get_active_context_profile();
+
+// Creates a context using the active profile's swapchain configuration and
+// makes it current.
 ngf::context create_default_context(uintptr_t handle, uint32_t w, uint32_t h);
 
 std::vector<char> load_raw_data(const char *file_path);
 
+// Queues a command buffer for submission at the end of the current frame.
+// Everything queued during a frame is submitted together with the UI
+// commands in a single call to ngf_submit_cmd_buffers, in the order it was
+// queued. The caller must keep the command buffer alive until the frame ends.
+void enqueue_cmd_buffer(ngf_cmd_buffer cmd_buf);
+
+// Returns a command buffer that has already been started for the given frame.
+// Command buffers come from a pool with one slot per frame in flight and are
+// recycled once the frame that used them has retired, so steady-state frames
+// don't create or destroy any. The returned buffer must not be used after the
+// frame ends.
+ngf_cmd_buffer acquire_cmd_buffer(ngf_frame_token frame_token);
+
+// Returns the allocator for per-frame uniform and geometry data. Memory
+// obtained from it may only be used by command buffers submitted during the
+// current frame, and only during on_frame (or UI rendering).
+transient_allocator& get_transient_allocator();
+
+// Returns the pool of worker threads. Each worker has a nicegraf context of
+// its own, which shares objects with the sample's context, so jobs may
+// create and destroy objects. Jobs must not record commands: command buffers
+// are recorded on the main thread only, because they are allocated from the
+// sample's context. on_frame may wait for its own jobs (e.g. with
+// parallel_for), but nothing else waits on the pool during a frame.
+thread_pool& get_thread_pool();
+
+// Creates a separate pool of `nthreads` threads, set up like the workers of
+// get_thread_pool(), for long-running work (such as creating pipelines) that
+// would hold up per-frame jobs if it were queued on get_thread_pool().
+// Must be called while the sample runs, and the pool must be destroyed by the
+// time on_shutdown returns.
+std::unique_ptr<thread_pool> create_background_thread_pool(uint32_t nthreads);
+
+// Registers a resource for hot reloading (see hot_reloader). Whenever one of
+// the files changes on disk, `reload` runs on a background thread, and the
+// function it returns is applied on the main thread at the start of a frame,
+// before on_frame. Resources stop being watched before on_shutdown is called.
+void watch_resource(const std::vector<std::string> &files,
+                    hot_reloader::reload_fn         reload);
+
+// A graphics pipeline together with the shader stages it was created from.
+struct pipeline_objects {
+  ngf::shader_stage vert_stage;
+  ngf::shader_stage frag_stage;
+  ngf::graphics_pipeline pipeline;
+};
+
+// The shader stages of a pipeline (see load_shader_stage).
+struct pipeline_shaders {
+  const char *vert_name;
+  const char *frag_name;
+  const char *vert_entry_point = "VSMain";
+  const char *frag_entry_point = "PSMain";
+};
+
+// Creates p->pipeline from the stages already loaded into `p`. Returns an
+// error rather than asserting, since it also runs when the shaders change.
+using pipeline_create_fn = std::function<ngf_error(pipeline_objects *p)>;
+
+// Loads the given stages into `*target` and creates its pipeline with
+// `create`, asserting that this works. Whenever the stages or any of
+// `extra_files` (e.g. the pipeline metadata) change on disk, does the same
+// again on a background thread, and swaps the result into `*target` at the
+// start of a frame. If that fails, `*target` is kept as it was. `target`
+// must stay valid until on_shutdown.
+void watch_pipeline(pipeline_objects               *target,
+                    const pipeline_shaders         &shaders,
+                    pipeline_create_fn              create,
+                    const std::vector<std::string> &extra_files = {});
+
+// Makes the UI font able to render the characters in the given UTF-8 text.
+// Glyphs outside of Latin-1 are only rasterized once requested, and show up
+// starting from the next frame. Must be called on the main thread, e.g. from
+// on_ui.
+void request_ui_glyphs(const char *utf8_text);
+
+// Returns the UI rendering backend of the running sample (e.g. to read its
+// stats), or nullptr if there is none. Must be called on the main thread.
+class ngf_imgui;
+const ngf_imgui* get_ui_backend();
+
 struct init_result {
   ngf::context context;
   void *userdata;
@@ -0,0 +1,261 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "dynamic_resolution.h"
+#include "common.h"
+#include <nicegraf_util.h>
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+
+// Frame times are smoothed with an exponential moving average.
+static constexpr float frame_time_smoothing = 0.1f;
+
+// The scale is left alone while the smoothed frame time stays within this
+// band around the target, so that it doesn't oscillate.
+static constexpr float over_budget_ratio = 1.05f;
+static constexpr float under_budget_ratio = 0.85f;
+
+// Largest increase of the scale in a single step. Scaling up is done
+// cautiously, since overshooting shows up as a hitch.
+static constexpr float max_scale_increase = 0.05f;
+
+// Number of frames to wait after changing the scale, for the effect of the
+// change to show up in the smoothed frame time.
+static constexpr uint32_t adjustment_cooldown = 10u;
+
+// Frames that take longer than this are assumed to be stalls unrelated to
+// rendering (e.g. the window being dragged) and are ignored.
+static constexpr float stall_frame_ms = 250.0f;
+
+// Layout of the upscale shader's uniform buffer.
+struct upscale_uniforms {
+  float uv_scale[2];
+  float uv_max[2];
+};
+
+resolution_controller::resolution_controller(float target_frame_ms,
+                                             float min_scale,
+                                             float max_scale) :
+  target_frame_ms_(target_frame_ms),
+  min_scale_(min_scale),
+  max_scale_(max_scale),
+  scale_(max_scale) {}
+
+void resolution_controller::set_adaptive(bool adaptive) {
+  adaptive_ = adaptive;
+  if (!adaptive_) scale_ = max_scale_;
+  cooldown_ = adjustment_cooldown;
+}
+
+float resolution_controller::update(float frame_ms) {
+  if (!adaptive_ || frame_ms <= 0.0f || frame_ms > stall_frame_ms) {
+    return scale_;
+  }
+  smoothed_frame_ms_ =
+      smoothed_frame_ms_ == 0.0f
+          ? frame_ms
+          : smoothed_frame_ms_ +
+                frame_time_smoothing * (frame_ms - smoothed_frame_ms_);
+  if (cooldown_ > 0u) {
+    --cooldown_;
+    return scale_;
+  }
+  const float ratio = smoothed_frame_ms_ / target_frame_ms_;
+  if (ratio > over_budget_ratio || ratio < under_budget_ratio) {
+    // Cost goes with the pixel count, so the scale goes with the square root
+    // of the ratio between the budget and the frame time.
+    float new_scale = scale_ * sqrtf(1.0f / ratio);
+    new_scale = std::min(new_scale, scale_ + max_scale_increase);
+    new_scale = std::max(min_scale_, std::min(max_scale_, new_scale));
+    if (fabsf(new_scale - scale_) > 0.01f) {
+      scale_ = new_scale;
+      cooldown_ = adjustment_cooldown;
+    }
+  }
+  return scale_;
+}
+
+// Creates a render target with a color attachment and a depth attachment of
+// the given size.
+static ngf_error create_target(uint32_t            w,
+                               uint32_t            h,
+                               ngf_image_format    depth_format,
+                               const ngf_clear    &clear_color,
+                               ngf::image         *color_image,
+                               ngf::image         *depth_image,
+                               ngf::render_target *rt) {
+  const ngf_image_info color_info {
+    NGF_IMAGE_TYPE_IMAGE_2D,
+    { w, h, 1u },
+    1u,
+    NGF_IMAGE_FORMAT_BGRA8,
+    NGF_SAMPLE_COUNT_1,
+    NGF_IMAGE_USAGE_SAMPLE_FROM | NGF_IMAGE_USAGE_ATTACHMENT
+  };
+  ngf_error err = color_image->initialize(color_info);
+  if (err != NGF_ERROR_OK) return err;
+  const ngf_image_info depth_info {
+    NGF_IMAGE_TYPE_IMAGE_2D,
+    { w, h, 1u },
+    1u,
+    depth_format,
+    NGF_SAMPLE_COUNT_1,
+    NGF_IMAGE_USAGE_ATTACHMENT
+  };
+  err = depth_image->initialize(depth_info);
+  if (err != NGF_ERROR_OK) return err;
+
+  ngf_clear clear_depth;
+  clear_depth.clear_depth = 1.0f;
+  const ngf_attachment attachments[] = {
+    {
+      { color_image->get(), 0u, 0u, NGF_CUBEMAP_FACE_POSITIVE_X },
+      NGF_ATTACHMENT_COLOR,
+      NGF_LOAD_OP_CLEAR,
+      NGF_STORE_OP_STORE,
+      clear_color
+    },
+    {
+      { depth_image->get(), 0u, 0u, NGF_CUBEMAP_FACE_POSITIVE_X },
+      depth_format == NGF_IMAGE_FORMAT_DEPTH24_STENCIL8
+          ? NGF_ATTACHMENT_DEPTH_STENCIL
+          : NGF_ATTACHMENT_DEPTH,
+      NGF_LOAD_OP_CLEAR,
+      NGF_STORE_OP_DONTCARE,
+      clear_depth
+    }
+  };
+  const ngf_render_target_info rt_info { attachments, 2u };
+  return rt->initialize(rt_info);
+}
+
+ngf_error dynamic_resolution::initialize(uint32_t          w,
+                                         uint32_t          h,
+                                         ngf_image_format  depth_format,
+                                         const ngf_clear  &clear_color) {
+  depth_format_ = depth_format;
+  clear_color_ = clear_color;
+  ngf_error err = create_offscreen_target(w, h);
+  if (err != NGF_ERROR_OK) return err;
+  err = create_target(1u, 1u, depth_format_, clear_color_,
+                      &compatible_color_image_, &compatible_depth_image_,
+                      &compatible_rt_);
+  if (err != NGF_ERROR_OK) return err;
+
+  // The upscale pass overwrites the whole screen, so the default render
+  // target's previous contents don't need to be loaded.
+  ngf_render_target rt = nullptr;
+  err = ngf_default_render_target(NGF_LOAD_OP_DONTCARE, NGF_LOAD_OP_DONTCARE,
+                                  NGF_STORE_OP_STORE, NGF_STORE_OP_DONTCARE,
+                                  NULL, NULL, &rt);
+  if (err != NGF_ERROR_OK) return err;
+  default_rt_.reset(rt);
+
+  vert_stage_ = load_shader_stage("upscale", "VSMain", NGF_STAGE_VERTEX);
+  frag_stage_ = load_shader_stage("upscale", "PSMain", NGF_STAGE_FRAGMENT);
+  ngf_plmd *pipeline_metadata = load_pipeline_metadata("upscale");
+  assert(pipeline_metadata);
+
+  ngf_util_graphics_pipeline_data pipeline_data;
+  ngf_util_create_default_graphics_pipeline_data(nullptr, &pipeline_data);
+  pipeline_data.multisample_info.sample_count =
+      get_active_context_profile().sample_count;
+  ngf_graphics_pipeline_info &pipe_info = pipeline_data.pipeline_info;
+  pipe_info.nshader_stages = 2u;
+  pipe_info.shader_stages[0] = vert_stage_.get();
+  pipe_info.shader_stages[1] = frag_stage_.get();
+  pipe_info.compatible_render_target = default_rt_.get();
+  pipe_info.image_to_combined_map =
+      ngf_plmd_get_image_to_cis_map(pipeline_metadata);
+  pipe_info.sampler_to_combined_map =
+      ngf_plmd_get_sampler_to_cis_map(pipeline_metadata);
+  err = ngf_util_create_pipeline_layout_from_metadata(
+      ngf_plmd_get_layout(pipeline_metadata), &pipeline_data.layout_info);
+  if (err == NGF_ERROR_OK) err = upscale_pipeline_.initialize(pipe_info);
+  ngf_plmd_destroy(pipeline_metadata, nullptr);
+  if (err != NGF_ERROR_OK) return err;
+
+  // Bilinear filtering does the actual upscaling.
+  const ngf_sampler_info samp_info {
+    NGF_FILTER_LINEAR,
+    NGF_FILTER_LINEAR,
+    NGF_FILTER_NEAREST,
+    NGF_WRAP_MODE_CLAMP_TO_EDGE,
+    NGF_WRAP_MODE_CLAMP_TO_EDGE,
+    NGF_WRAP_MODE_CLAMP_TO_EDGE,
+    0.0f,
+    0.0f,
+    0.0f,
+    {0.0f},
+    1.0f,
+    false
+  };
+  return sampler_.initialize(samp_info);
+}
+
+ngf_error dynamic_resolution::create_offscreen_target(uint32_t w,
+                                                      uint32_t h) {
+  // Release the old target before the images it refers to.
+  offscreen_rt_.reset(nullptr);
+  full_w_ = std::max(1u, w);
+  full_h_ = std::max(1u, h);
+  return create_target(full_w_, full_h_, depth_format_, clear_color_,
+                       &color_image_, &depth_image_, &offscreen_rt_);
+}
+
+ngf_irect2d dynamic_resolution::begin_frame(uint32_t w, uint32_t h,
+                                            float time) {
+  if (w != full_w_ || h != full_h_) {
+    ngf_error err = create_offscreen_target(w, h);
+    assert(err == NGF_ERROR_OK);
+  }
+  const float scale =
+      controller_.update(prev_time_ < 0.0f ? 0.0f
+                                           : (time - prev_time_) * 1000.0f);
+  prev_time_ = time;
+  scaled_w_ = std::max(1u, (uint32_t)((float)full_w_ * scale + 0.5f));
+  scaled_h_ = std::max(1u, (uint32_t)((float)full_h_ * scale + 0.5f));
+  return ngf_irect2d { 0, 0, scaled_w_, scaled_h_ };
+}
+
+void dynamic_resolution::record_upscale(ngf_render_encoder enc) {
+  // Texels outside of the scaled part hold whatever an earlier, larger
+  // frame left there. Bilinear filtering would blend them in along the right
+  // and bottom edges, so texture coordinates are clamped to the centers of
+  // the last texels inside.
+  const float full_w = (float)full_w_, full_h = (float)full_h_;
+  const upscale_uniforms uniforms {
+    { (float)scaled_w_ / full_w, (float)scaled_h_ / full_h },
+    { ((float)scaled_w_ - 0.5f) / full_w, ((float)scaled_h_ - 0.5f) / full_h }
+  };
+  const ngf_irect2d viewport { 0, 0, full_w_, full_h_ };
+  ngf_cmd_begin_pass(enc, default_rt_);
+  ngf_cmd_bind_gfx_pipeline(enc, upscale_pipeline_);
+  ngf_cmd_viewport(enc, &viewport);
+  ngf_cmd_scissor(enc, &viewport);
+  ngf::cmd_bind_resources(enc,
+    get_transient_allocator().upload_uniform(uniforms, 0, 0),
+    ngf::descriptor_set<0>::binding<1>::texture(color_image_.get()),
+    ngf::descriptor_set<0>::binding<2>::sampler(sampler_.get()));
+  ngf_cmd_draw(enc, false, 0u, 3u, 1u);
+  ngf_cmd_end_pass(enc);
+}
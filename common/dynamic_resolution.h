@@ -0,0 +1,124 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <nicegraf.h>
+#include <nicegraf_wrappers.h>
+#include <stdint.h>
+
+// Picks the fraction of the full resolution to render at, so that frame
+// times stay close to a budget. Rendering cost is assumed to be roughly
+// proportional to the number of pixels, i.e. to the square of the scale.
+class resolution_controller {
+public:
+  explicit resolution_controller(float target_frame_ms = 1000.0f / 60.0f,
+                                 float min_scale = 0.5f,
+                                 float max_scale = 1.0f);
+
+  // Feeds the duration of the last frame and returns the scale to render the
+  // next one at.
+  float update(float frame_ms);
+
+  // When adaptive scaling is off, the maximum scale is always used.
+  void set_adaptive(bool adaptive);
+  void set_target_frame_ms(float ms) { target_frame_ms_ = ms; }
+
+  bool  adaptive() const { return adaptive_; }
+  float target_frame_ms() const { return target_frame_ms_; }
+  float smoothed_frame_ms() const { return smoothed_frame_ms_; }
+  float scale() const { return scale_; }
+
+private:
+  float    target_frame_ms_;
+  float    min_scale_;
+  float    max_scale_;
+  float    scale_;
+  float    smoothed_frame_ms_ = 0.0f;
+  uint32_t cooldown_ = 0u; // Frames to wait before the next adjustment.
+  bool     adaptive_ = true;
+};
+
+// Renders the application's pass at a reduced resolution and upscales the
+// result to the default render target. The offscreen target is allocated at
+// full window size and only a part of it is rendered to, so changing the
+// scale does not require creating new images.
+//
+// Usage, every frame:
+//  - call begin_frame and render into render_target() using the returned
+//    viewport;
+//  - call record_upscale to draw the result onto the default render target.
+class dynamic_resolution {
+public:
+  // Creates the offscreen target for the given window size and the upscale
+  // pipeline. The context must be current.
+  ngf_error initialize(uint32_t          w,
+                       uint32_t          h,
+                       ngf_image_format  depth_format,
+                       const ngf_clear  &clear_color);
+
+  // Feeds the current time to the controller, resizes the offscreen target if
+  // the window size changed, and returns the viewport to render to.
+  ngf_irect2d begin_frame(uint32_t w, uint32_t h, float time);
+
+  // Begins a pass on the default render target and upscales the part of the
+  // offscreen image rendered this frame onto it.
+  void record_upscale(ngf_render_encoder enc);
+
+  // Render target for the application's pass. Pipelines must be created
+  // with it as the compatible render target and a sample count of 1.
+  ngf_render_target render_target() const { return offscreen_rt_.get(); }
+
+  // A render target with the same attachments as render_target(), which,
+  // unlike it, isn't recreated when the window is resized. Pipelines can be
+  // created against it on other threads, e.g. when reloading shaders.
+  ngf_render_target compatible_render_target() const {
+    return compatible_rt_.get();
+  }
+
+  resolution_controller&       controller() { return controller_; }
+  const resolution_controller& controller() const { return controller_; }
+
+  // Size that the current frame is being rendered at.
+  uint32_t scaled_width() const { return scaled_w_; }
+  uint32_t scaled_height() const { return scaled_h_; }
+
+private:
+  ngf_error create_offscreen_target(uint32_t w, uint32_t h);
+
+  resolution_controller  controller_;
+  ngf::image             color_image_;
+  ngf::image             depth_image_;
+  ngf::render_target     offscreen_rt_;
+  ngf::image             compatible_color_image_;
+  ngf::image             compatible_depth_image_;
+  ngf::render_target     compatible_rt_;
+  ngf::render_target     default_rt_;
+  ngf::shader_stage      vert_stage_;
+  ngf::shader_stage      frag_stage_;
+  ngf::graphics_pipeline upscale_pipeline_;
+  ngf::sampler           sampler_;
+  ngf_image_format       depth_format_ = NGF_IMAGE_FORMAT_UNDEFINED;
+  ngf_clear              clear_color_ {};
+  uint32_t               full_w_ = 0u, full_h_ = 0u;
+  uint32_t               scaled_w_ = 0u, scaled_h_ = 0u;
+  float                  prev_time_ = -1.0f;
+};
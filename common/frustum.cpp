@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "frustum.h"
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+frustum::frustum(const nm::float4x4 &world_to_clip) {
+  // Rows of the matrix (which is stored in column-major order).
+  float rows[4][4];
+  for (int r = 0; r < 4; ++r) {
+    for (int c = 0; c < 4; ++c) rows[r][c] = world_to_clip[c][r];
+  }
+  for (int p = 0; p < 6; ++p) {
+    // Left, right, bottom, top, near and far planes are, respectively, the
+    // sum and the difference of the last row and the first three.
+    const float sign = (p % 2 == 0) ? 1.0f : -1.0f;
+    const float *row = rows[p / 2];
+    float plane[4];
+    for (int i = 0; i < 4; ++i) plane[i] = rows[3][i] + sign * row[i];
+    // Normalize, so that the plane equation gives the signed distance.
+    const float len = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] +
+                            plane[2] * plane[2]);
+    for (int i = 0; i < 4; ++i) {
+      const float v = len > 0.0f ? plane[i] / len : plane[i];
+      for (int lane = 0; lane < 4; ++lane) planes_[p][i][lane] = v;
+    }
+  }
+}
+
+uint32_t frustum::test_spheres4(const float *x,
+                                const float *y,
+                                const float *z,
+                                float        radius) const {
+#if defined(FRUSTUM_USE_SSE)
+  const __m128 px = _mm_loadu_ps(x);
+  const __m128 py = _mm_loadu_ps(y);
+  const __m128 pz = _mm_loadu_ps(z);
+  const __m128 neg_radius = _mm_set1_ps(-radius);
+  __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+  for (int p = 0; p < 6; ++p) {
+    __m128 dist = _mm_mul_ps(_mm_load_ps(planes_[p][0]), px);
+    dist = _mm_add_ps(dist, _mm_mul_ps(_mm_load_ps(planes_[p][1]), py));
+    dist = _mm_add_ps(dist, _mm_mul_ps(_mm_load_ps(planes_[p][2]), pz));
+    dist = _mm_add_ps(dist, _mm_load_ps(planes_[p][3]));
+    inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, neg_radius));
+  }
+  return (uint32_t)_mm_movemask_ps(inside);
+#else
+  uint32_t mask = 0u;
+  for (int lane = 0; lane < 4; ++lane) {
+    bool inside = true;
+    for (int p = 0; p < 6; ++p) {
+      const float dist = planes_[p][0][0] * x[lane] +
+                         planes_[p][1][0] * y[lane] +
+                         planes_[p][2][0] * z[lane] + planes_[p][3][0];
+      inside = inside && dist >= -radius;
+    }
+    mask |= inside ? (1u << lane) : 0u;
+  }
+  return mask;
+#endif
+}
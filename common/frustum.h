@@ -0,0 +1,48 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include "nicemath.h"
+#include <stdint.h>
+
+// A view frustum, used for culling bounding spheres on the CPU. Spheres are
+// tested four at a time, with SSE where it's available.
+class frustum {
+public:
+  // Extracts the frustum planes from a world-to-clip matrix. The planes
+  // bound the OpenGL clip volume (-w <= z <= w), which contains the one of
+  // the other backends, so culling stays conservative with all of them.
+  explicit frustum(const nm::float4x4 &world_to_clip);
+
+  // Tests four spheres of the given radius, centered at (x[i], y[i], z[i]).
+  // Returns a mask with bit i set if the i-th sphere intersects the frustum.
+  uint32_t test_spheres4(const float *x,
+                         const float *y,
+                         const float *z,
+                         float        radius) const;
+
+private:
+  // Plane coefficients (a, b, c, d), each replicated four times so that SIMD
+  // code can load them directly. A point p is inside a plane if
+  // a*p.x + b*p.y + c*p.z + d >= 0.
+  alignas(16) float planes_[6][4][4];
+};
@@ -0,0 +1,176 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "hot_reload.h"
+#include <algorithm>
+#include <assert.h>
+#include <stdio.h>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#include <filesystem>
+#endif
+
+// How long a file has to stay unchanged before it's reloaded.
+static constexpr std::chrono::milliseconds settle_time { 200 };
+
+#if !defined(__linux__)
+// How often modification times are checked.
+static constexpr std::chrono::milliseconds scan_interval { 500 };
+#endif
+
+// Paths are compared as "directory/name", so files in the current directory
+// get an explicit "./".
+static std::string normalize_path(const std::string &path) {
+  return path.find('/') == std::string::npos ? "./" + path : path;
+}
+
+hot_reloader::hot_reloader() {
+#if defined(__linux__)
+  inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+hot_reloader::~hot_reloader() {
+  clear();
+#if defined(__linux__)
+  if (inotify_fd_ >= 0) close(inotify_fd_);
+#endif
+}
+
+void hot_reloader::watch(const std::vector<std::string> &files,
+                         reload_fn reload) {
+  resource r;
+  for (const std::string &f : files) {
+    r.files.push_back(normalize_path(f));
+    add_watch(r.files.back());
+  }
+  r.reload = std::move(reload);
+  resources_.push_back(std::move(r));
+}
+
+void hot_reloader::add_watch(const std::string &path) {
+#if defined(__linux__)
+  if (inotify_fd_ < 0) return;
+  // Watch the directory rather than the file itself: editors and compilers
+  // often replace files instead of writing them in place.
+  const std::string dir = path.substr(0, path.rfind('/'));
+  const int wd = inotify_add_watch(inotify_fd_, dir.c_str(),
+                                   IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+  if (wd >= 0) watched_dirs_[wd] = dir;
+#else
+  std::error_code ec;
+  mtimes_[path] =
+      std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+#endif
+}
+
+void hot_reloader::collect_changes(std::vector<std::string> &changed) {
+#if defined(__linux__)
+  if (inotify_fd_ < 0) return;
+  alignas(inotify_event) char buf[4096];
+  for (;;) {
+    const ssize_t len = read(inotify_fd_, buf, sizeof(buf));
+    if (len <= 0) break;
+    for (ssize_t i = 0; i < len;) {
+      const inotify_event *e = (const inotify_event*)(buf + i);
+      auto dir = watched_dirs_.find(e->wd);
+      if (e->len > 0u && dir != watched_dirs_.end()) {
+        changed.push_back(dir->second + "/" + e->name);
+      }
+      i += (ssize_t)(sizeof(inotify_event) + e->len);
+    }
+  }
+#else
+  const auto now = std::chrono::steady_clock::now();
+  if (now - last_scan_ < scan_interval) return;
+  last_scan_ = now;
+  for (auto &entry : mtimes_) {
+    std::error_code ec;
+    const long long mtime = std::filesystem::last_write_time(entry.first, ec)
+                                .time_since_epoch().count();
+    if (!ec && mtime != entry.second) {
+      entry.second = mtime;
+      changed.push_back(entry.first);
+    }
+  }
+#endif
+}
+
+void hot_reloader::poll(thread_pool &workers) {
+  std::vector<std::string> changed;
+  collect_changes(changed);
+  const auto now = std::chrono::steady_clock::now();
+  for (resource &r : resources_) {
+    for (const std::string &f : r.files) {
+      if (std::find(changed.begin(), changed.end(), f) != changed.end()) {
+        r.changed = true;
+        r.last_change = now;
+      }
+    }
+
+    // Collect finished reloads. A reload that failed returns an empty
+    // function, and the resource is left as it was.
+    if (r.job.valid() &&
+        r.job.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+      r.job.get();
+      if (*r.result) {
+        results_.push_back(std::move(*r.result));
+      } else {
+        fprintf(stderr, "failed to reload %s, keeping the previous version\n",
+                r.files.empty() ? "a resource" : r.files.front().c_str());
+      }
+      r.result.reset();
+    }
+
+    // Start a reload, unless one is already in progress. Changes made
+    // meanwhile get picked up after it finishes.
+    if (r.changed && !r.job.valid() && now - r.last_change >= settle_time) {
+      r.changed = false;
+      r.result = std::make_shared<apply_fn>();
+      std::shared_ptr<apply_fn> result = r.result;
+      const reload_fn &reload = r.reload;
+      r.job = workers.enqueue([result, reload] { *result = reload(); });
+    }
+  }
+}
+
+void hot_reloader::apply_results(ngf_cmd_buffer cmd_buf) {
+  for (apply_fn &apply : results_) apply(cmd_buf);
+  results_.clear();
+}
+
+void hot_reloader::clear() {
+  for (resource &r : resources_) {
+    if (r.job.valid()) r.job.wait();
+  }
+  resources_.clear();
+  results_.clear();
+#if defined(__linux__)
+  for (const auto &dir : watched_dirs_) {
+    inotify_rm_watch(inotify_fd_, dir.first);
+  }
+  watched_dirs_.clear();
+#else
+  mtimes_.clear();
+#endif
+}
@@ -0,0 +1,102 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include "thread_pool.h"
+#include <nicegraf.h>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Watches the files that resources were loaded from, and reloads the
+// resources when the files change on disk.
+//
+// A resource is registered with the files it depends on and a reload
+// function. When any of the files changes, the reload function runs on a
+// worker thread, where it can read files and create new nicegraf objects. It
+// returns a function that applies the result (e.g. swaps in a new pipeline or
+// records an upload) on the main thread, between frames. If loading fails
+// (e.g. because a file is only half-written), the reload function returns an
+// empty function instead, and the resource is kept as it was. Only resources
+// that depend on a changed file get reloaded.
+//
+// Changes are detected with inotify on Linux, and by polling modification
+// times elsewhere.
+class hot_reloader {
+public:
+  using apply_fn = std::function<void(ngf_cmd_buffer)>;
+  using reload_fn = std::function<apply_fn()>;
+
+  hot_reloader();
+  ~hot_reloader();
+
+  hot_reloader(const hot_reloader&) = delete;
+  hot_reloader& operator=(const hot_reloader&) = delete;
+
+  // Registers a resource that depends on the given files.
+  void watch(const std::vector<std::string> &files, reload_fn reload);
+
+  // Checks for changed files, and starts reloading the resources that depend
+  // on them once the files have stopped changing for a bit (they are usually
+  // written in several steps).
+  void poll(thread_pool &workers);
+
+  // Whether there are finished reloads to apply.
+  bool has_results() const { return !results_.empty(); }
+
+  // Applies finished reloads. Commands are recorded into the given command
+  // buffer, which must be submitted before the app's commands for the frame.
+  void apply_results(ngf_cmd_buffer cmd_buf);
+
+  // Waits for reloads in progress and forgets about all resources.
+  void clear();
+
+private:
+  struct resource {
+    std::vector<std::string> files;
+    reload_fn reload;
+    bool changed = false; // A file changed since the last reload started.
+    std::chrono::steady_clock::time_point last_change;
+    std::future<void> job; // The reload in progress, if any.
+    std::shared_ptr<apply_fn> result; // Written by job.
+  };
+
+  // Adds the paths of files that changed since the last call to `changed`.
+  void collect_changes(std::vector<std::string> &changed);
+
+  // Starts watching the given file.
+  void add_watch(const std::string &path);
+
+  std::vector<resource> resources_;
+  std::vector<apply_fn> results_;
+#if defined(__linux__)
+  int inotify_fd_ = -1;
+  std::unordered_map<int, std::string> watched_dirs_; // By watch descriptor.
+#else
+  std::unordered_map<std::string, long long> mtimes_; // By path.
+  std::chrono::steady_clock::time_point last_scan_;
+#endif
+};
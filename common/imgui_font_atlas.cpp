@@ -0,0 +1,233 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "imgui_font_atlas.h"
+#include "common.h"
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+
+// Largest codepoint an ImWchar can hold.
+static constexpr uint32_t max_codepoint = 0xFFFFu;
+
+// Height of the horizontal bands that the atlas is compared in.
+static constexpr int dirty_band_height = 16;
+
+void imgui_font_atlas::add_font(const char *ttf_path, float size_pixels) {
+  fonts_.push_back(font_source { ttf_path, size_pixels });
+  needs_rebuild_ = true;
+}
+
+void imgui_font_atlas::request(uint32_t codepoint) {
+  if (codepoint == 0u || codepoint > max_codepoint) return;
+  if (requested_.empty()) requested_.resize(max_codepoint + 1u, false);
+  if (!requested_[codepoint]) {
+    requested_[codepoint] = true;
+    ++nrequested_;
+    needs_rebuild_ = true;
+  }
+}
+
+void imgui_font_atlas::request_glyphs(const char *utf8_text) {
+  const uint8_t *p = (const uint8_t*)utf8_text;
+  while (*p != 0u) {
+    // Decode one UTF-8 sequence. Bytes that don't start a valid sequence are
+    // skipped.
+    uint32_t codepoint = *p;
+    int len = 1;
+    if (codepoint >= 0xF0u) { codepoint &= 0x07u; len = 4; }
+    else if (codepoint >= 0xE0u) { codepoint &= 0x0Fu; len = 3; }
+    else if (codepoint >= 0xC0u) { codepoint &= 0x1Fu; len = 2; }
+    else if (codepoint >= 0x80u) { ++p; continue; }
+    int i = 1;
+    for (; i < len && (p[i] & 0xC0u) == 0x80u; ++i) {
+      codepoint = (codepoint << 6u) | (p[i] & 0x3Fu);
+    }
+    if (i < len) { ++p; continue; }
+    p += len;
+    request(codepoint);
+  }
+}
+
+bool imgui_font_atlas::update() {
+  if (!needs_rebuild_) return false;
+  ImFontAtlas *atlas = ImGui::GetIO().Fonts;
+
+  // ImGui's default ranges (Basic Latin and Latin-1) are always present.
+  if (nrequested_ == 0u) {
+    for (const ImWchar *r = atlas->GetGlyphRangesDefault(); r[0] != 0; r += 2) {
+      for (uint32_t c = r[0]; c <= r[1]; ++c) request(c);
+    }
+  }
+  needs_rebuild_ = false;
+
+  // The old ranges are referenced by the atlas until it's cleared.
+  atlas->Clear();
+  glyph_ranges_.clear();
+  for (uint32_t c = 1u; c <= max_codepoint; ++c) {
+    if (!requested_[c]) continue;
+    const uint32_t first = c;
+    while (c < max_codepoint && requested_[c + 1u]) ++c;
+    glyph_ranges_.push_back((ImWchar)first);
+    glyph_ranges_.push_back((ImWchar)c);
+  }
+  glyph_ranges_.push_back(0);
+
+  ImFontConfig config;
+  config.GlyphRanges = glyph_ranges_.data();
+  if (fonts_.empty()) atlas->AddFontDefault(&config);
+  for (const font_source &f : fonts_) {
+    config.SizePixels = f.size_pixels;
+    if (f.ttf_path != nullptr) {
+      atlas->AddFontFromFileTTF(f.ttf_path, f.size_pixels, &config,
+                                glyph_ranges_.data());
+    } else {
+      atlas->AddFontDefault(&config);
+    }
+  }
+  unsigned char *pixels = nullptr;
+  int width = 0, height = 0;
+  atlas->GetTexDataAsRGBA32(&pixels, &width, &height);
+
+  // The atlas' UVs are relative to its size, so the texture needs to be
+  // recreated whenever that changes. Otherwise, only the changed parts of
+  // the atlas need to be uploaded.
+  const bool recreate =
+      texture_.get() == nullptr || width != width_ || height != height_;
+  if (recreate) {
+    const ngf_image_info texture_info = {
+      NGF_IMAGE_TYPE_IMAGE_2D, // type
+      {(uint32_t)width, (uint32_t)height, 1u}, // extent
+      1u, // nmips
+      NGF_IMAGE_FORMAT_RGBA8, // image_format
+      NGF_SAMPLE_COUNT_1, // samples
+      NGF_IMAGE_USAGE_SAMPLE_FROM  |
+      NGF_IMAGE_USAGE_XFER_DST // usage_hint
+    };
+    const ngf_error err = texture_.initialize(texture_info);
+    assert(err == NGF_ERROR_OK);
+    width_ = width; height_ = height;
+    shadow_.resize((size_t)width * (size_t)height);
+    memcpy(shadow_.data(), pixels, shadow_.size() * sizeof(uint32_t));
+    dirty_rects_.clear();
+    dirty_rects_.push_back({0, 0, (uint32_t)width, (uint32_t)height});
+  } else {
+    find_dirty_rects((const uint32_t*)pixels);
+  }
+  atlas->TexID = (ImTextureID)(uintptr_t)texture_.get();
+  return recreate;
+}
+
+void imgui_font_atlas::find_dirty_rects(const uint32_t *pixels) {
+  // Within each band, find the span of columns that changed and bring the
+  // shadow copy up to date. Consecutive dirty bands are merged into one rect.
+  bool extend_last = false;
+  for (int y0 = 0; y0 < height_; y0 += dirty_band_height) {
+    const int y1 = std::min(y0 + dirty_band_height, height_);
+    int min_x = width_, max_x = -1;
+    for (int y = y0; y < y1; ++y) {
+      const uint32_t *src = pixels + (size_t)y * (size_t)width_;
+      uint32_t *dst = shadow_.data() + (size_t)y * (size_t)width_;
+      if (memcmp(src, dst, (size_t)width_ * sizeof(uint32_t)) == 0) continue;
+      int x0 = 0, x1 = width_ - 1;
+      while (src[x0] == dst[x0]) ++x0;
+      while (src[x1] == dst[x1]) --x1;
+      memcpy(dst + x0, src + x0, (size_t)(x1 - x0 + 1) * sizeof(uint32_t));
+      min_x = std::min(min_x, x0);
+      max_x = std::max(max_x, x1);
+    }
+    if (max_x < 0) {
+      extend_last = false;
+    } else if (extend_last) {
+      ngf_irect2d &r = dirty_rects_.back();
+      const int right = std::max(r.x + (int)r.width, max_x + 1);
+      r.x = std::min(r.x, min_x);
+      r.width = (uint32_t)(right - r.x);
+      r.height = (uint32_t)(y1 - r.y);
+    } else {
+      dirty_rects_.push_back({min_x, y0, (uint32_t)(max_x - min_x + 1),
+                              (uint32_t)(y1 - y0)});
+      extend_last = true;
+    }
+  }
+}
+
+void imgui_font_atlas::record_uploads(ngf_cmd_buffer cmdbuf) {
+  last_upload_bytes_ = 0u;
+  if (dirty_rects_.empty()) return;
+  size_t total_bytes = 0u;
+  for (const ngf_irect2d &r : dirty_rects_) {
+    total_bytes += sizeof(uint32_t) * r.width * r.height;
+  }
+
+  // There is a staging buffer for every frame in flight, and at most one is
+  // used per frame, so the GPU is done reading a buffer by the time it comes
+  // around again.
+  if (staging_.empty()) {
+    staging_.resize(get_active_context_profile().capacity_hint + 1u);
+  }
+  staging_slot &slot = staging_[next_staging_slot_];
+  next_staging_slot_ = (next_staging_slot_ + 1u) % (uint32_t)staging_.size();
+  if (slot.size < total_bytes) {
+    const ngf_pixel_buffer_info staging_info {
+      total_bytes,
+      NGF_PIXEL_BUFFER_USAGE_WRITE
+    };
+    const ngf_error err = slot.buffer.initialize(staging_info);
+    assert(err == NGF_ERROR_OK);
+    slot.size = total_bytes;
+  }
+
+  // Pack the rects tightly into the staging buffer, one after another.
+  uint8_t *mapped = (uint8_t*)ngf_pixel_buffer_map_range(
+      slot.buffer.get(), 0, total_bytes, NGF_BUFFER_MAP_WRITE_BIT);
+  assert(mapped != nullptr);
+  size_t offset = 0u;
+  for (const ngf_irect2d &r : dirty_rects_) {
+    const size_t row_bytes = sizeof(uint32_t) * r.width;
+    for (uint32_t row = 0u; row < r.height; ++row) {
+      const size_t y = (size_t)r.y + row;
+      memcpy(mapped + offset,
+             shadow_.data() + y * (size_t)width_ + (size_t)r.x, row_bytes);
+      offset += row_bytes;
+    }
+  }
+  ngf_pixel_buffer_flush_range(slot.buffer.get(), 0, total_bytes);
+  ngf_pixel_buffer_unmap(slot.buffer.get());
+
+  const ngf_image_ref ref = {
+    texture_.get(),
+    0,
+    0,
+    NGF_CUBEMAP_FACE_POSITIVE_X
+  };
+  ngf::xfer_encoder xfenc { cmdbuf };
+  offset = 0u;
+  for (const ngf_irect2d &r : dirty_rects_) {
+    ngf_offset3d rect_offset {r.x, r.y, 0};
+    ngf_extent3d rect_extent {r.width, r.height, 1u};
+    ngf_cmd_write_image(xfenc, slot.buffer.get(), offset, ref, &rect_offset,
+                        &rect_extent);
+    offset += sizeof(uint32_t) * r.width * r.height;
+  }
+  last_upload_bytes_ = total_bytes;
+  dirty_rects_.clear();
+}
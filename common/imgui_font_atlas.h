@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <nicegraf.h>
+#include <nicegraf_wrappers.h>
+#include <imgui.h>
+#include <stdint.h>
+#include <vector>
+
+// Keeps ImGui's font atlas and the texture it is sampled from in sync.
+//
+// Only the glyphs for Basic Latin, Latin-1 and characters that have been
+// explicitly requested get rasterized, so large fonts (e.g. CJK) cost memory
+// proportional to the glyphs actually used. When new glyphs are requested,
+// ImGui's atlas is rebuilt (ImGui packs glyph rectangles with stb_rect_pack),
+// compared against the previous contents, and only the regions that changed
+// are uploaded, through a small ring of staging buffers.
+//
+// Usage:
+//  - call update on the main thread, before ImGui::NewFrame;
+//  - call record_uploads every frame, before the UI is drawn.
+class imgui_font_atlas {
+public:
+  // Adds a font to the atlas. A null path selects ImGui's built-in font. If
+  // no fonts are added, only the built-in font is used.
+  void add_font(const char *ttf_path, float size_pixels);
+
+  // Makes sure the characters in the given UTF-8 text get rasterized by the
+  // next call to update. Until then, they're rendered as ImGui's fallback
+  // glyph.
+  void request_glyphs(const char *utf8_text);
+
+  // Rebuilds ImGui's atlas if new glyphs have been requested or fonts have
+  // been added, and works out which parts of the texture need to be uploaded.
+  // Returns true if the texture was (re)created, in which case
+  // io.Fonts->TexID has a new value. Must not be called between
+  // ImGui::NewFrame and ImGui::Render. Rebuilding invalidates ImFont pointers
+  // obtained from ImGui before.
+  bool update();
+
+  // Records commands that upload the parts of the atlas that changed since
+  // the last call.
+  void record_uploads(ngf_cmd_buffer cmdbuf);
+
+  ngf_image texture() const { return texture_.get(); }
+  size_t texture_bytes() const { return shadow_.size() * sizeof(uint32_t); }
+  size_t last_upload_bytes() const { return last_upload_bytes_; }
+  uint32_t requested_glyph_count() const { return nrequested_; }
+
+private:
+  struct font_source {
+    const char *ttf_path; // Null for the built-in font.
+    float size_pixels;
+  };
+  struct staging_slot {
+    ngf::pixel_buffer buffer;
+    size_t size = 0u;
+  };
+
+  // Marks a codepoint as requested.
+  void request(uint32_t codepoint);
+
+  // Adds the rects of the atlas that differ from shadow_ to dirty_rects_.
+  void find_dirty_rects(const uint32_t *pixels);
+
+  std::vector<font_source> fonts_;
+  std::vector<bool> requested_; // Indexed by codepoint.
+  uint32_t nrequested_ = 0u;
+  bool needs_rebuild_ = true;
+  // Glyph ranges passed to ImGui. ImGui keeps a pointer to them, so they must
+  // stay alive until the next rebuild.
+  std::vector<ImWchar> glyph_ranges_;
+
+  int width_ = 0, height_ = 0;
+  std::vector<uint32_t> shadow_; // What the texture contains (or will).
+  std::vector<ngf_irect2d> dirty_rects_; // Not uploaded yet.
+  ngf::image texture_;
+  std::vector<staging_slot> staging_;
+  uint32_t next_staging_slot_ = 0u;
+  size_t last_upload_bytes_ = 0u;
+};
@@ -1,12 +1,20 @@
 #include "imgui_ngf_backend.h"
 #include "imgui_binding_consts.h"
 #include "common.h"
+#include "trace.h"
 #include <nicegraf_util.h>
 #include <assert.h>
+#include <chrono>
+#include <string.h>
 #include <vector>
 
 ngf_imgui::ngf_imgui() {
 #if !defined(NGF_NO_IMGUI)
+#if IMGUI_VERSION_NUM >= 17100
+  // Draw commands carry their own vertex offset, so a single draw list may
+  // have more than 64K vertices even with 16-bit indices.
+  ImGui::GetIO().BackendFlags |= ImGuiBackendFlags_RendererHasVtxOffset;
+#endif
   vertex_stage_ = load_shader_stage("imgui", "VSMain", NGF_STAGE_VERTEX);
   fragment_stage_ = load_shader_stage("imgui", "PSMain", NGF_STAGE_FRAGMENT);
 
@@ -19,13 +27,6 @@ ngf_imgui::ngf_imgui() {
   assert(err == NGF_ERROR_OK);
   default_rt_ = ngf::render_target(rt);
   
-  // Initialize the streamed uniform object.
-  std::optional<ngf::streamed_uniform<uniform_data>> maybe_streamed_uniform;
-  std::tie(maybe_streamed_uniform, err) =
-      ngf::streamed_uniform<uniform_data>::create(3);
-  assert(err == NGF_ERROR_OK);
-  uniform_data_ = std::move(maybe_streamed_uniform.value());
-
   // Initial pipeline configuration with OpenGL-style defaults.
   ngf_util_graphics_pipeline_data pipeline_data;
   ngf_util_create_default_graphics_pipeline_data(nullptr,
@@ -54,7 +55,8 @@ ngf_imgui::ngf_imgui() {
   pipeline_data.depth_stencil_info.stencil_test = false;
 
   // Set up multisampling.
-  pipeline_data.multisample_info.sample_count = NGF_SAMPLE_COUNT_8;
+  pipeline_data.multisample_info.sample_count =
+      get_active_context_profile().sample_count;
  
   // Assign programmable stages.
   ngf_graphics_pipeline_info &pipeline_info = pipeline_data.pipeline_info;
@@ -88,40 +90,9 @@ ngf_imgui::ngf_imgui() {
   err = pipeline_.initialize(pipeline_data.pipeline_info);
   assert(err == NGF_ERROR_OK);
 
-  // Generate data for the font texture.
-  ImGuiIO& io = ImGui::GetIO();
-  unsigned char* font_pixels;
-  int width, height;
-  io.Fonts->GetTexDataAsRGBA32(&font_pixels, &width, &height);
-
-  // Create and populate font texture.
-  const ngf_image_info font_texture_info = {
-    NGF_IMAGE_TYPE_IMAGE_2D, // type
-    {(uint32_t)width, (uint32_t)height, 1u}, // extent
-    1u, // nmips
-    NGF_IMAGE_FORMAT_RGBA8, // image_format
-    NGF_SAMPLE_COUNT_1, // samples
-    NGF_IMAGE_USAGE_SAMPLE_FROM  |
-    NGF_IMAGE_USAGE_XFER_DST // usage_hint
-  };
-  err = font_texture_.initialize(font_texture_info);
-  assert(err == NGF_ERROR_OK);
-  ImGui::GetIO().Fonts->TexID = (ImTextureID)(uintptr_t)font_texture_.get();
-  const ngf_pixel_buffer_info pbuffer_info{
-    4u * (size_t)width * (size_t)height,
-    NGF_PIXEL_BUFFER_USAGE_WRITE
-  };
-  err = texture_data_.initialize(pbuffer_info);
-  assert(err == NGF_ERROR_OK);
-  void  *mapped_texture_data = 
-      ngf_pixel_buffer_map_range(texture_data_.get(),
-                                 0,
-                                 4 * (size_t)width * (size_t)height,
-                                 NGF_BUFFER_MAP_WRITE_BIT);
-  memcpy(mapped_texture_data, font_pixels, 4 * (size_t)width * (size_t)height);
-  ngf_pixel_buffer_flush_range(texture_data_.get(), 0,
-                               4 * (size_t)width * (size_t)height);
-  ngf_pixel_buffer_unmap(texture_data_.get());
+  // Build the font atlas and create the texture for it. Its contents get
+  // uploaded by the first call to upload_font_texture.
+  font_atlas_.update();
 
   // Create a sampler for the font texture.
   ngf_sampler_info sampler_info {
@@ -146,109 +117,112 @@ ngf_imgui::ngf_imgui() {
 
 #if !defined(NGF_NO_IMGUI)
 
+void ngf_imgui::update_font_atlas() {
+  const ngf_image old_texture = font_atlas_.texture();
+  if (font_atlas_.update()) {
+    // Drop the bind op for the old texture, and make sure the retained
+    // geometry, which references it, isn't replayed.
+    texture_bind_ops_.erase((ImTextureID)(uintptr_t)old_texture);
+    retained_valid_ = false;
+  }
+}
+
+void ngf_imgui::request_glyphs(const char *utf8_text) {
+  font_atlas_.request_glyphs(utf8_text);
+}
+
 void ngf_imgui::upload_font_texture(ngf_cmd_buffer cmdbuf) {
-  const ngf_image_ref ref = {
-    font_texture_.get(),
-    0,
-    0,
-    NGF_CUBEMAP_FACE_POSITIVE_X
-    
-  };
-  ngf_offset3d tex_offset {0, 0, 0};
-  ngf_extent3d tex_extent {512, 64, 1};
-  ngf::xfer_encoder xfenc { cmdbuf };
-  ngf_cmd_write_image(xfenc, texture_data_.get(), 0, ref, &tex_offset,
-                      &tex_extent);
+  font_atlas_.record_uploads(cmdbuf);
 }
 
-void ngf_imgui::record_rendering_commands(ngf_render_encoder enc) {
-  ImGui::Render();
-  ImDrawData *data = ImGui::GetDrawData();
-  if (data->TotalIdxCount <= 0) return;
-  //Compute effective viewport width and height, apply scaling for
-  // retina/high-dpi displays.
-  ImGuiIO& io = ImGui::GetIO();
-  int fb_width = (int)(data->DisplaySize.x * io.DisplayFramebufferScale.x);
-  int fb_height = (int)(data->DisplaySize.y * io.DisplayFramebufferScale.y);
-  data->ScaleClipRects(io.DisplayFramebufferScale);
+static bool same_rect(const ngf_irect2d &a, const ngf_irect2d &b) {
+  return a.x == b.x && a.y == b.y && a.width == b.width &&
+         a.height == b.height;
+}
 
-  // Avoid rendering when minimized.
-  if (fb_width <= 0 || fb_height <= 0) { return; }
-   
-  // Build projection matrix.
-  const ImVec2 &pos = data->DisplayPos;
-  const float L = pos.x;
-  const float R = pos.x + data->DisplaySize.x;
-  const float T = pos.y;
-  const float B = pos.y + data->DisplaySize.y;
-  const uniform_data ortho_projection = {
-    {
-        { 2.0f/(R-L),   0.0f,         0.0f,   0.0f },
-        { 0.0f,         2.0f/(T-B),   0.0f,   0.0f },
-        { 0.0f,         0.0f,        -1.0f,   0.0f },
-        { (R+L)/(L-R),  (T+B)/(B-T),  0.0f,   1.0f },
+const ngf_resource_bind_op& ngf_imgui::texture_bind_op(ImTextureID texture) {
+  auto it = texture_bind_ops_.find(texture);
+  if (it == texture_bind_ops_.end()) {
+    it = texture_bind_ops_.emplace(
+        texture,
+        ngf::descriptor_set<0>::binding<imgui::u_Texture_Binding>::texture(
+            (ngf_image)(uintptr_t)texture)).first;
+  }
+  return it->second;
+}
+
+// Hashes everything in the draw data that affects what gets rendered.
+static uint64_t hash_draw_data(const ImDrawData *data) {
+  uint64_t h = 14695981039346656037ull;
+  auto mix = [&h](const void *bytes, size_t size) {
+    // FNV-1a over 8-byte words, with a byte-wise tail.
+    const uint8_t *p = (const uint8_t*)bytes;
+    for (; size >= 8u; size -= 8u, p += 8u) {
+      uint64_t word;
+      memcpy(&word, p, 8u);
+      h = (h ^ word) * 1099511628211ull;
     }
+    for (; size > 0u; --size, ++p) h = (h ^ *p) * 1099511628211ull;
   };
-  uniform_data_.write(ortho_projection);
-
-  // Bind the ImGui rendering pipeline.
-  ngf_cmd_bind_gfx_pipeline(enc, pipeline_);
-  
-  // Bind resources.
-  ngf::cmd_bind_resources(
-      enc,
-      uniform_data_.bind_op_at_current_offset(0u, 0u),
-      ngf::descriptor_set<0>::binding<imgui::u_Texture_Binding>::texture(
-          font_texture_.get()),
-      ngf::descriptor_set<0>::binding<imgui::u_Sampler_Binding>::sampler(
-          tex_sampler_.get()));
+  mix(&data->DisplayPos, sizeof(data->DisplayPos));
+  mix(&data->DisplaySize, sizeof(data->DisplaySize));
+  for (int i = 0; i < data->CmdListsCount; ++i) {
+    const ImDrawList *list = data->CmdLists[i];
+    mix(list->VtxBuffer.Data, sizeof(ImDrawVert) * (size_t)list->VtxBuffer.Size);
+    mix(list->IdxBuffer.Data, sizeof(ImDrawIdx) * (size_t)list->IdxBuffer.Size);
+    for (int j = 0; j < list->CmdBuffer.Size; ++j) {
+      const ImDrawCmd &cmd = list->CmdBuffer[j];
+      mix(&cmd.ElemCount, sizeof(cmd.ElemCount));
+      mix(&cmd.ClipRect, sizeof(cmd.ClipRect));
+      mix(&cmd.TextureId, sizeof(cmd.TextureId));
+    }
+  }
+  return h;
+}
 
-  // Set viewport.
-  ngf_irect2d viewport_rect = {
-    0u, 0u,
-    (uint32_t)fb_width, (uint32_t)fb_height
-  };
-  ngf_cmd_viewport(enc, &viewport_rect);
-  ngf_cmd_scissor(enc, &viewport_rect);
-
-  // These vectors will store vertex and index data for the draw calls.
-  // Later this data will be transferred to GPU buffers.
-  std::vector<ImDrawVert> vertex_data((size_t)data->TotalVtxCount,
-                                      ImDrawVert());
-  std::vector<ImDrawIdx> index_data((size_t)data->TotalIdxCount,
-                                    0u);
-  struct draw_data {
-    ngf_irect2d scissor;
-    uint32_t first_elem;
-    uint32_t nelem;
-  };
-  std::vector<draw_data> draw_data;
+// Copies the vertices and indices of all draw lists, back to back.
+static void write_geometry(const ImDrawData *data,
+                           ImDrawVert       *dst_vertices,
+                           ImDrawIdx        *dst_indices) {
+  for (int i = 0u; i < data->CmdListsCount; ++i) {
+    const ImDrawList *imgui_cmd_list = data->CmdLists[i];
+    const size_t nvertices = (size_t)imgui_cmd_list->VtxBuffer.Size;
+    const size_t nindices = (size_t)imgui_cmd_list->IdxBuffer.Size;
+    memcpy(dst_vertices, imgui_cmd_list->VtxBuffer.Data,
+           sizeof(ImDrawVert) * nvertices);
+    // ImGui's indices are relative to the start of their draw list's
+    // vertices, so they are kept as-is and each draw binds the attrib buffer
+    // at its list's first vertex instead.
+    memcpy(dst_indices, imgui_cmd_list->IdxBuffer.Data,
+           sizeof(ImDrawIdx) * nindices);
+    dst_vertices += nvertices;
+    dst_indices += nindices;
+  }
+}
 
+void ngf_imgui::build_draws(const ImDrawData *data,
+                            int               fb_width,
+                            int               fb_height) {
+  const ImVec2 &pos = data->DisplayPos;
+  const ImTextureID font_texture = ImGui::GetIO().Fonts->TexID;
+  draws_.clear();
   uint32_t last_vertex = 0u;
   uint32_t last_index = 0u;
-
-  // Process each ImGui command list and translate it into the nicegraf
-  // command buffer.
   for (int i = 0u; i < data->CmdListsCount; ++i) {
-    // Append vertex data.
     const ImDrawList *imgui_cmd_list = data->CmdLists[i];
-    memcpy(&vertex_data[last_vertex],
-           imgui_cmd_list->VtxBuffer.Data,
-           sizeof(ImDrawVert) * (size_t)imgui_cmd_list->VtxBuffer.Size);
-
-    // Append index data.
-    for (int a = 0u; a < imgui_cmd_list->IdxBuffer.Size; ++a) {
-      // ImGui uses separate index buffers, but we'll use just one. We will
-      // update the index values accordingly.
-      index_data[last_index + (size_t)a] =
-          (ImDrawIdx)(last_vertex + imgui_cmd_list->IdxBuffer[a]);
-    }
-    last_vertex += (uint32_t)imgui_cmd_list->VtxBuffer.Size;
-    
-    // Process each ImGui command in the draw list.
+#if IMGUI_VERSION_NUM < 17100
     uint32_t idx_buffer_sub_offset = 0u;
+#endif
     for (int j = 0u; j < imgui_cmd_list->CmdBuffer.Size; ++j) {
       const ImDrawCmd &cmd = imgui_cmd_list->CmdBuffer[j];
+#if IMGUI_VERSION_NUM >= 17100
+      const uint32_t cmd_first_vertex = last_vertex + cmd.VtxOffset;
+      const uint32_t cmd_first_index = last_index + cmd.IdxOffset;
+#else
+      const uint32_t cmd_first_vertex = last_vertex;
+      const uint32_t cmd_first_index = last_index + idx_buffer_sub_offset;
+      idx_buffer_sub_offset += (uint32_t)cmd.ElemCount;
+#endif
       if (cmd.UserCallback != nullptr) {
         cmd.UserCallback(imgui_cmd_list, &cmd);
       } else {
@@ -265,57 +239,227 @@ void ngf_imgui::record_rendering_commands(ngf_render_encoder enc) {
             (uint32_t)(clip_rect.z - clip_rect.x),
             (uint32_t)(clip_rect.w - clip_rect.y)
           };
-          draw_data.push_back(
-            {scissor_rect, last_index + idx_buffer_sub_offset,
-             (uint32_t)cmd.ElemCount});
-          idx_buffer_sub_offset += (uint32_t)cmd.ElemCount;
+          const draw_data draw {
+            scissor_rect, cmd_first_index, (uint32_t)cmd.ElemCount,
+            (uint32_t)(sizeof(ImDrawVert) * cmd_first_vertex),
+            cmd.TextureId != nullptr ? cmd.TextureId : font_texture
+          };
+          ++last_frame_stats_.imgui_cmds;
+          draws_.push_back(draw);
         }
       }
     }
+    last_vertex += (uint32_t)imgui_cmd_list->VtxBuffer.Size;
     last_index += (uint32_t)imgui_cmd_list->IdxBuffer.Size;
   }
+}
 
-  // Create new vertex and index buffers.
+void ngf_imgui::retain_geometry(const ImDrawData *data,
+                                size_t            vertex_bytes,
+                                size_t            index_bytes) {
+  // Buffers that are in use by frames in flight can't be overwritten, so
+  // every retained copy gets buffers of its own.
   ngf_buffer_info attrib_buffer_info {
-    sizeof(ImDrawVert) * vertex_data.size(), // data size
+    vertex_bytes,
     NGF_BUFFER_STORAGE_HOST_READABLE_WRITEABLE
   };
   ngf_attrib_buffer attrib_buffer = nullptr;
   ngf_create_attrib_buffer(&attrib_buffer_info, &attrib_buffer);
-  attrib_buffer_.reset(attrib_buffer);
-  void *mapped_attrib_buffer =
-      ngf_attrib_buffer_map_range(attrib_buffer, 0, attrib_buffer_info.size,
-                                  NGF_BUFFER_MAP_WRITE_BIT);
-  assert(mapped_attrib_buffer != nullptr);
-  memcpy(mapped_attrib_buffer, vertex_data.data(), attrib_buffer_info.size);
-  ngf_attrib_buffer_flush_range(attrib_buffer, 0, attrib_buffer_info.size);
-  ngf_attrib_buffer_unmap(attrib_buffer);
-
+  retained_attrib_buffer_.reset(attrib_buffer);
   ngf_buffer_info index_buffer_info {
-    sizeof(ImDrawIdx) * index_data.size(),
+    index_bytes,
     NGF_BUFFER_STORAGE_HOST_READABLE_WRITEABLE
   };
   ngf_index_buffer index_buffer = nullptr;
   ngf_create_index_buffer(&index_buffer_info, &index_buffer);
-  index_buffer_.reset(index_buffer);
-  void *mapped_index_buffer =
-      ngf_index_buffer_map_range(index_buffer, 0, index_buffer_info.size,
+  retained_index_buffer_.reset(index_buffer);
+  void *mapped_vertices =
+      ngf_attrib_buffer_map_range(attrib_buffer, 0, vertex_bytes,
+                                  NGF_BUFFER_MAP_WRITE_BIT);
+  void *mapped_indices =
+      ngf_index_buffer_map_range(index_buffer, 0, index_bytes,
                                  NGF_BUFFER_MAP_WRITE_BIT);
-  assert(mapped_index_buffer != nullptr);
-  memcpy(mapped_index_buffer, index_data.data(), index_buffer_info.size);
-  ngf_index_buffer_flush_range(index_buffer, 0, index_buffer_info.size);
+  assert(mapped_vertices != nullptr && mapped_indices != nullptr);
+  write_geometry(data, (ImDrawVert*)mapped_vertices,
+                 (ImDrawIdx*)mapped_indices);
+  ngf_attrib_buffer_flush_range(attrib_buffer, 0, vertex_bytes);
+  ngf_attrib_buffer_unmap(attrib_buffer);
+  ngf_index_buffer_flush_range(index_buffer, 0, index_bytes);
   ngf_index_buffer_unmap(index_buffer);
+}
+
+void ngf_imgui::issue_draws(ngf_render_encoder enc,
+                            ngf_attrib_buffer  attrib_buffer,
+                            uint32_t           vertex_base,
+                            ngf_index_buffer   index_buffer,
+                            uint32_t           first_index) {
+  // Bind the ImGui rendering pipeline.
+  ngf_cmd_bind_gfx_pipeline(enc, pipeline_);
+  
+  // Bind resources. Textures are bound along with the draws that use them.
+  ngf::cmd_bind_resources(
+      enc,
+      get_transient_allocator().upload_uniform(projection_, 0u, 0u),
+      ngf::descriptor_set<0>::binding<imgui::u_Sampler_Binding>::sampler(
+          tex_sampler_.get()));
+
+  // Set viewport.
+  ngf_cmd_viewport(enc, &viewport_rect_);
+  ngf_cmd_scissor(enc, &viewport_rect_);
 
   ngf_cmd_bind_index_buffer(enc, index_buffer,
                             sizeof(ImDrawIdx) < 4
                                 ? NGF_TYPE_UINT16 : NGF_TYPE_UINT32);
-  ngf_cmd_bind_attrib_buffer(enc, attrib_buffer, 0u, 0u);
-  for (const auto &draw : draw_data) {
-    ngf_cmd_scissor(enc, &draw.scissor);
-    ngf_cmd_draw(enc, true, draw.first_elem, draw.nelem, 1u);
+  // ImGui's draw order has to be kept for blending to work, so draws can't
+  // be sorted by texture. Consecutive draws mostly use the same texture
+  // anyway, and the texture is only rebound when it changes.
+  uint32_t bound_vertex_offset = ~0u;
+  ImTextureID bound_texture = nullptr;
+  ngf_irect2d bound_scissor = viewport_rect_;
+  for (const auto &draw : draws_) {
+    if (draw.texture != bound_texture) {
+      ngf_cmd_bind_gfx_resources(enc, &texture_bind_op(draw.texture), 1u);
+      bound_texture = draw.texture;
+      ++last_frame_stats_.texture_binds;
+    }
+    if (draw.vertex_offset != bound_vertex_offset) {
+      ngf_cmd_bind_attrib_buffer(enc, attrib_buffer, 0u,
+                                 vertex_base + draw.vertex_offset);
+      bound_vertex_offset = draw.vertex_offset;
+    }
+    if (!same_rect(draw.scissor, bound_scissor)) {
+      ngf_cmd_scissor(enc, &draw.scissor);
+      bound_scissor = draw.scissor;
+      ++last_frame_stats_.scissor_changes;
+    }
+    ngf_cmd_draw(enc, true, first_index + draw.first_elem, draw.nelem, 1u);
+  }
+  last_frame_stats_.draws = (uint32_t)draws_.size();
+}
+
+void ngf_imgui::record_rendering_commands(ngf_render_encoder enc) {
+  NGF_SAMPLE_ZONE("ngf_imgui::record_rendering_commands");
+  ImGui::Render();
+  last_frame_stats_ = frame_stats {};
+  last_frame_stats_.font_texture_bytes = font_atlas_.texture_bytes();
+  last_frame_stats_.font_upload_bytes = font_atlas_.last_upload_bytes();
+  ImDrawData *data = ImGui::GetDrawData();
+  retained_valid_ = false;
+  if (data->TotalIdxCount <= 0) return;
+  //Compute effective viewport width and height, apply scaling for
+  // retina/high-dpi displays.
+  ImGuiIO& io = ImGui::GetIO();
+  int fb_width = (int)(data->DisplaySize.x * io.DisplayFramebufferScale.x);
+  int fb_height = (int)(data->DisplaySize.y * io.DisplayFramebufferScale.y);
+  data->ScaleClipRects(io.DisplayFramebufferScale);
+
+  // Avoid rendering when minimized.
+  if (fb_width <= 0 || fb_height <= 0) { return; }
+   
+  // Build projection matrix.
+  const ImVec2 &pos = data->DisplayPos;
+  const float L = pos.x;
+  const float R = pos.x + data->DisplaySize.x;
+  const float T = pos.y;
+  const float B = pos.y + data->DisplaySize.y;
+  projection_ = {
+    {
+        { 2.0f/(R-L),   0.0f,         0.0f,   0.0f },
+        { 0.0f,         2.0f/(T-B),   0.0f,   0.0f },
+        { 0.0f,         0.0f,        -1.0f,   0.0f },
+        { (R+L)/(L-R),  (T+B)/(B-T),  0.0f,   1.0f },
+    }
+  };
+  viewport_rect_ = { 0u, 0u, (uint32_t)fb_width, (uint32_t)fb_height };
+  build_draws(data, fb_width, fb_height);
+
+  // If the UI looks exactly like it did last frame, keep a copy of its
+  // geometry in dedicated buffers. Frames that render the same UI after that
+  // don't need to upload anything.
+  const size_t vertex_bytes = sizeof(ImDrawVert) * (size_t)data->TotalVtxCount;
+  const size_t index_bytes = sizeof(ImDrawIdx) * (size_t)data->TotalIdxCount;
+  const uint64_t hash = hash_draw_data(data);
+  if (hash == retained_hash_ && retained_attrib_buffer_.get() != nullptr) {
+    retained_valid_ = true;
+  } else if (hash == last_hash_) {
+    retain_geometry(data, vertex_bytes, index_bytes);
+    retained_hash_ = hash;
+    retained_valid_ = true;
+  }
+  last_hash_ = hash;
+  if (retained_valid_) {
+    last_frame_stats_.reused_geometry = true;
+    issue_draws(enc, retained_attrib_buffer_.get(), 0u,
+                retained_index_buffer_.get(), 0u);
+    return;
+  }
+
+  // Reserve space for all of the frame's UI geometry up front, so that draw
+  // lists can be written straight into mapped memory. If transient memory
+  // can't fit it, fall back to dedicated buffers. The transient allocator
+  // grows to fit the demand, so this only happens on the first frames after
+  // the UI outgrows it.
+  transient_allocator &talloc = get_transient_allocator();
+  transient_allocation<ngf_attrib_buffer> vertices =
+      talloc.alloc_attrib(vertex_bytes, sizeof(float));
+  transient_allocation<ngf_index_buffer> indices =
+      talloc.alloc_index(index_bytes, sizeof(ImDrawIdx));
+  const bool use_fallback = vertices.ptr == nullptr || indices.ptr == nullptr;
+  if (use_fallback) {
+    ngf_buffer_info attrib_buffer_info {
+      vertex_bytes, // data size
+      NGF_BUFFER_STORAGE_HOST_READABLE_WRITEABLE
+    };
+    ngf_attrib_buffer attrib_buffer = nullptr;
+    ngf_create_attrib_buffer(&attrib_buffer_info, &attrib_buffer);
+    attrib_buffer_.reset(attrib_buffer);
+    vertices = { attrib_buffer, 0u, vertex_bytes,
+                 ngf_attrib_buffer_map_range(attrib_buffer, 0, vertex_bytes,
+                                             NGF_BUFFER_MAP_WRITE_BIT) };
+    ngf_buffer_info index_buffer_info {
+      index_bytes,
+      NGF_BUFFER_STORAGE_HOST_READABLE_WRITEABLE
+    };
+    ngf_index_buffer index_buffer = nullptr;
+    ngf_create_index_buffer(&index_buffer_info, &index_buffer);
+    index_buffer_.reset(index_buffer);
+    indices = { index_buffer, 0u, index_bytes,
+                ngf_index_buffer_map_range(index_buffer, 0, index_bytes,
+                                           NGF_BUFFER_MAP_WRITE_BIT) };
+    assert(vertices.ptr != nullptr && indices.ptr != nullptr);
   }
+  const auto write_start = std::chrono::steady_clock::now();
+  write_geometry(data, (ImDrawVert*)vertices.ptr, (ImDrawIdx*)indices.ptr);
+  if (use_fallback) {
+    ngf_attrib_buffer_flush_range(vertices.buffer, 0, vertex_bytes);
+    ngf_attrib_buffer_unmap(vertices.buffer);
+    ngf_index_buffer_flush_range(indices.buffer, 0, index_bytes);
+    ngf_index_buffer_unmap(indices.buffer);
+  }
+  last_frame_stats_.vertex_bytes = vertex_bytes;
+  last_frame_stats_.index_bytes = index_bytes;
+  last_frame_stats_.used_fallback = use_fallback;
+  last_frame_stats_.write_ms = std::chrono::duration<float, std::milli>(
+      std::chrono::steady_clock::now() - write_start).count();
+
+  // The index buffer can't be bound at an offset, so the first index of the
+  // allocation is added to every draw instead.
+  issue_draws(enc, vertices.buffer, (uint32_t)vertices.offset,
+              indices.buffer, (uint32_t)(indices.offset / sizeof(ImDrawIdx)));
+}
+
+void ngf_imgui::replay_rendering_commands(ngf_render_encoder enc) {
+  last_frame_stats_ = frame_stats {};
+  last_frame_stats_.replayed = true;
+  last_frame_stats_.font_texture_bytes = font_atlas_.texture_bytes();
+  last_frame_stats_.font_upload_bytes = font_atlas_.last_upload_bytes();
+  if (!retained_valid_) return;
+  last_frame_stats_.reused_geometry = true;
+  issue_draws(enc, retained_attrib_buffer_.get(), 0u,
+              retained_index_buffer_.get(), 0u);
 }
 #else
 void ngf_imgui::record_rendering_commands(ngf_render_encoder) {}
+void ngf_imgui::replay_rendering_commands(ngf_render_encoder) {}
 #endif
 
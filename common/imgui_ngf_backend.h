@@ -3,8 +3,14 @@
 #include <nicegraf.h>
 #include <nicegraf_wrappers.h>
 #include <imgui.h>
+#include "imgui_font_atlas.h"
+#include <unordered_map>
+#include <vector>
 
 // A nicegraf-based rendering backend for ImGui.
+// Textures are passed to ImGui (e.g. to ImGui::Image) as ngf_image handles
+// cast to ImTextureID. They must have been created with
+// NGF_IMAGE_USAGE_SAMPLE_FROM and outlive the frame they are used in.
 class ngf_imgui {
 public:
   // Initializes the internal state of the ImGui rendering backend.
@@ -14,24 +20,96 @@ public:
   // given command buffer.
   void record_rendering_commands(ngf_render_encoder enc);
 
-  // Records commands that upload the imgui font atlas. This only needs to be
-  // called once.
+  // Records commands that draw the same UI as the last call to
+  // record_rendering_commands, without running ImGui::Render or uploading
+  // any geometry. Only possible once the UI has stayed unchanged for two
+  // consecutive recorded frames (see can_replay). Draw callbacks are not
+  // invoked again.
+  void replay_rendering_commands(ngf_render_encoder enc);
+  bool can_replay() const { return retained_valid_; }
+
+  // Makes the font atlas include glyphs for the characters in the given UTF-8
+  // text, starting from the next call to update_font_atlas.
+  void request_glyphs(const char *utf8_text);
+
+  // Rebuilds the font atlas if new glyphs have been requested. Must be called
+  // on the main thread, before ImGui::NewFrame.
+  void update_font_atlas();
+
+  // Records commands that upload the parts of the font atlas that changed
+  // since the last call. Should be called every frame.
   void upload_font_texture(ngf_cmd_buffer cmdbuf);
+
+  // Information about the geometry written for the UI in the last frame.
+  struct frame_stats {
+    size_t vertex_bytes = 0u;
+    size_t index_bytes = 0u;
+    float  write_ms = 0.0f; // Time spent writing geometry.
+    bool   used_fallback = false; // Whether dedicated buffers were needed.
+    uint32_t imgui_cmds = 0u; // Visible ImGui draw commands.
+    uint32_t draws = 0u; // Draws issued.
+    uint32_t scissor_changes = 0u; // Scissor updates issued.
+    uint32_t texture_binds = 0u; // Texture binds issued.
+    bool     reused_geometry = false; // Drawn from retained buffers.
+    bool     replayed = false; // ImGui::Render was skipped.
+    size_t font_texture_bytes = 0u; // Size of the font atlas texture.
+    size_t font_upload_bytes = 0u; // Font atlas data uploaded.
+  };
+
+  // Returns stats for the most recently recorded UI frame.
+  const frame_stats& last_frame_stats() const { return last_frame_stats_; }
+
 private:
   struct uniform_data {
     float ortho_projection[4][4];
   };
+  struct draw_data {
+    ngf_irect2d scissor;
+    uint32_t first_elem; // Relative to the first index of the frame's UI.
+    uint32_t nelem;
+    uint32_t vertex_offset; // Byte offset of the draw list's vertices.
+    ImTextureID texture;
+  };
+
+  // Translates the draw data into draws_.
+  void build_draws(const ImDrawData *data, int fb_width, int fb_height);
+
+  // Records draws_, with geometry at the given locations.
+  void issue_draws(ngf_render_encoder enc,
+                   ngf_attrib_buffer  attrib_buffer,
+                   uint32_t           vertex_base,
+                   ngf_index_buffer   index_buffer,
+                   uint32_t           first_index);
+
+  // Writes the geometry of the draw data into new retained buffers.
+  void retain_geometry(const ImDrawData *data,
+                       size_t            vertex_bytes,
+                       size_t            index_bytes);
+
+  // Returns the op that binds the given texture, creating it on first use.
+  const ngf_resource_bind_op& texture_bind_op(ImTextureID texture);
 
 #if !defined(NGF_NO_IMGUI)
   ngf::graphics_pipeline pipeline_;
-  ngf::streamed_uniform<uniform_data> uniform_data_;
-  ngf::image font_texture_;
+  imgui_font_atlas font_atlas_;
   ngf::sampler tex_sampler_;
+  // Fallback buffers, used on frames where transient memory can't fit the
+  // UI geometry yet.
   ngf::attrib_buffer attrib_buffer_;
   ngf::index_buffer index_buffer_;
-  ngf::pixel_buffer texture_data_;
   ngf::shader_stage vertex_stage_;
   ngf::shader_stage fragment_stage_;
   ngf::render_target default_rt_;
+  // A copy of the UI geometry, kept while the UI doesn't change.
+  ngf::attrib_buffer retained_attrib_buffer_;
+  ngf::index_buffer retained_index_buffer_;
 #endif
+  uint64_t last_hash_ = 0u; // Hash of the last recorded draw data.
+  uint64_t retained_hash_ = 0u; // Hash of the retained geometry.
+  bool retained_valid_ = false; // Whether the retained geometry is current.
+  uniform_data projection_ {};
+  ngf_irect2d viewport_rect_ {};
+  std::vector<draw_data> draws_; // Reused between frames.
+  std::unordered_map<ImTextureID, ngf_resource_bind_op> texture_bind_ops_;
+  frame_stats last_frame_stats_;
 };
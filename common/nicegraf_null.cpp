@@ -0,0 +1,818 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "nicegraf_null.h"
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <stdarg.h>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+enum class cmd_buffer_state {
+  NEW,       // created, never started.
+  READY,     // started, no encoder active.
+  RECORDING, // an encoder is active.
+  SUBMITTED  // submitted, needs to be started again before use.
+};
+
+struct buffer_storage {
+  std::vector<uint8_t> data;
+  bool                 host_visible = false;
+  bool                 mapped = false;
+  size_t               mapped_offset = 0u;
+  size_t               mapped_size = 0u;
+};
+
+struct state {
+  std::mutex                                            mut;
+  std::unordered_map<const void*, ngf_null_object_type> live_objects;
+  std::atomic<uint64_t> objects_created[NGF_NULL_OBJECT_TYPE_COUNT];
+  std::atomic<uint64_t> objects_live[NGF_NULL_OBJECT_TYPE_COUNT];
+  std::atomic<uint64_t> frames { 0u };
+  std::atomic<uint64_t> bytes_allocated { 0u };
+  std::atomic<uint64_t> submissions { 0u };
+  std::atomic<uint64_t> cmd_buffers_submitted { 0u };
+  std::atomic<uint64_t> cmds_submitted[NGF_NULL_CMD_TYPE_COUNT];
+  std::atomic<uint64_t> validation_errors { 0u };
+  std::vector<ngf_null_cmd> current_frame_log;
+  std::vector<ngf_null_cmd> last_frame_log;
+  ngf_context               current_context = nullptr;
+  uint64_t                  frame_id = 0u;
+  bool                      frame_active = false;
+
+  state() {
+    for (auto &c : objects_created) c = 0u;
+    for (auto &c : objects_live) c = 0u;
+    for (auto &c : cmds_submitted) c = 0u;
+  }
+};
+
+state& g() {
+  static state s;
+  return s;
+}
+
+void validation_error(const char *fmt, ...) {
+  ++g().validation_errors;
+  va_list a;
+  va_start(a, fmt);
+  fprintf(stderr, "nicegraf (null backend) validation error: ");
+  vfprintf(stderr, fmt, a);
+  fprintf(stderr, "\n");
+  va_end(a);
+}
+
+#define NULL_CHECK(cond, err, ...) \
+  if (!(cond)) { validation_error(__VA_ARGS__); return err; }
+
+void track(const void *obj, ngf_null_object_type type) {
+  std::lock_guard<std::mutex> lock(g().mut);
+  g().live_objects[obj] = type;
+  ++g().objects_created[type];
+  ++g().objects_live[type];
+}
+
+bool untrack(const void *obj, ngf_null_object_type type) {
+  std::lock_guard<std::mutex> lock(g().mut);
+  auto it = g().live_objects.find(obj);
+  if (it == g().live_objects.end() || it->second != type) {
+    validation_error("attempt to destroy an unknown or already destroyed "
+                     "object (%p)", obj);
+    return false;
+  }
+  g().live_objects.erase(it);
+  --g().objects_live[type];
+  return true;
+}
+
+bool is_live(const void *obj, ngf_null_object_type type) {
+  std::lock_guard<std::mutex> lock(g().mut);
+  auto it = g().live_objects.find(obj);
+  return it != g().live_objects.end() && it->second == type;
+}
+
+template <class T>
+ngf_error create_object(ngf_null_object_type type, T **result) {
+  NULL_CHECK(result != nullptr, NGF_ERROR_INVALID_OPERATION,
+             "null result pointer passed to a create function");
+  T *obj = new (std::nothrow) T;
+  if (obj == nullptr) return NGF_ERROR_OUT_OF_MEM;
+  track(obj, type);
+  *result = obj;
+  return NGF_ERROR_OK;
+}
+
+template <class T>
+void destroy_object(ngf_null_object_type type, T *obj) {
+  if (obj == nullptr) return;
+  if (untrack(obj, type)) delete obj;
+}
+
+ngf_error init_buffer(buffer_storage &b, const ngf_buffer_info *info) {
+  NULL_CHECK(info != nullptr, NGF_ERROR_INVALID_OPERATION,
+             "null buffer info");
+  NULL_CHECK(info->size > 0u, NGF_ERROR_INVALID_SIZE,
+             "attempt to create a zero-sized buffer");
+  b.data.resize(info->size);
+  b.host_visible = info->storage_type != NGF_BUFFER_STORAGE_PRIVATE;
+  g().bytes_allocated += info->size;
+  return NGF_ERROR_OK;
+}
+
+void* map_buffer(buffer_storage &b, size_t offset, size_t size) {
+  NULL_CHECK(b.host_visible, nullptr,
+             "attempt to map a buffer with private storage");
+  NULL_CHECK(!b.mapped, nullptr, "attempt to map an already mapped buffer");
+  NULL_CHECK(offset + size <= b.data.size(), nullptr,
+             "mapped range [%zu, %zu) is out of bounds (buffer size %zu)",
+             offset, offset + size, b.data.size());
+  b.mapped = true;
+  b.mapped_offset = offset;
+  b.mapped_size = size;
+  return b.data.data() + offset;
+}
+
+void flush_buffer(buffer_storage &b, size_t offset, size_t size) {
+  NULL_CHECK(b.mapped, , "attempt to flush a buffer that is not mapped");
+  // Flushed ranges are relative to the start of the mapped range.
+  NULL_CHECK(offset + size <= b.mapped_size, ,
+             "flushed range [%zu, %zu) is outside of the mapped range",
+             offset, offset + size);
+}
+
+void unmap_buffer(buffer_storage &b) {
+  NULL_CHECK(b.mapped, , "attempt to unmap a buffer that is not mapped");
+  b.mapped = false;
+}
+
+}  // namespace
+
+struct ngf_context_t {
+  uint32_t width = 0u;
+  uint32_t height = 0u;
+};
+
+struct ngf_shader_stage_t {
+  ngf_stage_type type;
+};
+
+struct ngf_graphics_pipeline_t {
+  uint32_t nstages = 0u;
+};
+
+struct ngf_image_t {
+  ngf_image_info info;
+};
+
+struct ngf_sampler_t {
+  ngf_sampler_info info;
+};
+
+struct ngf_render_target_t {
+  bool is_default = false;
+};
+
+struct ngf_attrib_buffer_t  { buffer_storage storage; };
+struct ngf_index_buffer_t   { buffer_storage storage; };
+struct ngf_uniform_buffer_t { buffer_storage storage; };
+struct ngf_pixel_buffer_t   { buffer_storage storage; };
+
+struct ngf_cmd_buffer_t {
+  cmd_buffer_state          state = cmd_buffer_state::NEW;
+  uint64_t                  frame_id = 0u;
+  bool                      in_pass = false;
+  bool                      pipeline_bound = false;
+  bool                      index_buffer_bound = false;
+  std::vector<ngf_null_cmd> cmds;
+};
+
+namespace {
+
+// Encoders are opaque single-word handles; the null backend stores the
+// command buffer pointer in them.
+static_assert(sizeof(ngf_render_encoder) == sizeof(uintptr_t),
+              "unexpected render encoder layout");
+static_assert(sizeof(ngf_xfer_encoder) == sizeof(uintptr_t),
+              "unexpected transfer encoder layout");
+
+template <class Enc>
+Enc make_encoder(ngf_cmd_buffer buf) {
+  Enc enc;
+  const uintptr_t h = (uintptr_t)buf;
+  memcpy(&enc, &h, sizeof(h));
+  return enc;
+}
+
+template <class Enc>
+ngf_cmd_buffer encoder_cmd_buffer(Enc enc) {
+  uintptr_t h;
+  memcpy(&h, &enc, sizeof(h));
+  return (ngf_cmd_buffer)h;
+}
+
+template <class Enc>
+ngf_cmd_buffer recording_cmd_buffer(Enc enc, const char *cmd_name) {
+  ngf_cmd_buffer buf = encoder_cmd_buffer(enc);
+  if (buf == nullptr || buf->state != cmd_buffer_state::RECORDING) {
+    validation_error("%s recorded with an inactive encoder", cmd_name);
+    return nullptr;
+  }
+  return buf;
+}
+
+void record(ngf_cmd_buffer buf, ngf_null_cmd_type type, const void *obj,
+            uint64_t a0 = 0u, uint64_t a1 = 0u, uint64_t a2 = 0u,
+            uint64_t a3 = 0u) {
+  buf->cmds.push_back(ngf_null_cmd { type, obj, { a0, a1, a2, a3 } });
+}
+
+}  // namespace
+
+extern "C" {
+
+ngf_error ngf_initialize(const ngf_init_info*) {
+  return NGF_ERROR_OK;
+}
+
+ngf_error ngf_create_context(const ngf_context_info *info,
+                             ngf_context *result) {
+  NULL_CHECK(info != nullptr, NGF_ERROR_INVALID_OPERATION,
+             "null context info");
+  return create_object(NGF_NULL_OBJECT_CONTEXT, result);
+}
+
+void ngf_destroy_context(ngf_context ctx) {
+  if (g().current_context == ctx) g().current_context = nullptr;
+  destroy_object(NGF_NULL_OBJECT_CONTEXT, ctx);
+}
+
+ngf_error ngf_resize_context(ngf_context ctx,
+                             uint32_t new_width,
+                             uint32_t new_height) {
+  NULL_CHECK(is_live(ctx, NGF_NULL_OBJECT_CONTEXT),
+             NGF_ERROR_INVALID_OPERATION, "attempt to resize invalid context");
+  ctx->width = new_width;
+  ctx->height = new_height;
+  return NGF_ERROR_OK;
+}
+
+ngf_error ngf_set_context(ngf_context ctx) {
+  NULL_CHECK(is_live(ctx, NGF_NULL_OBJECT_CONTEXT),
+             NGF_ERROR_INVALID_OPERATION,
+             "attempt to set an invalid context as current");
+  g().current_context = ctx;
+  return NGF_ERROR_OK;
+}
+
+ngf_error ngf_begin_frame(ngf_frame_token *token) {
+  NULL_CHECK(g().current_context != nullptr, NGF_ERROR_INVALID_OPERATION,
+             "ngf_begin_frame called without a current context");
+  NULL_CHECK(!g().frame_active, NGF_ERROR_INVALID_OPERATION,
+             "ngf_begin_frame called twice without ngf_end_frame");
+  g().frame_active = true;
+  ++g().frame_id;
+  *token = (ngf_frame_token)g().frame_id;
+  return NGF_ERROR_OK;
+}
+
+ngf_error ngf_end_frame(ngf_frame_token token) {
+  NULL_CHECK(g().frame_active && (uint64_t)token == g().frame_id,
+             NGF_ERROR_INVALID_OPERATION,
+             "ngf_end_frame called with a stale frame token");
+  g().frame_active = false;
+  ++g().frames;
+  std::lock_guard<std::mutex> lock(g().mut);
+  g().last_frame_log.swap(g().current_frame_log);
+  g().current_frame_log.clear();
+  return NGF_ERROR_OK;
+}
+
+ngf_error ngf_create_shader_stage(const ngf_shader_stage_info *info,
+                                  ngf_shader_stage *result) {
+  NULL_CHECK(info != nullptr, NGF_ERROR_INVALID_OPERATION,
+             "null shader stage info");
+  NULL_CHECK(info->content != nullptr && info->content_length > 0u,
+             NGF_ERROR_INVALID_SIZE, "empty shader stage content");
+  const ngf_error err = create_object(NGF_NULL_OBJECT_SHADER_STAGE, result);
+  if (err == NGF_ERROR_OK) (*result)->type = info->type;
+  return err;
+}
+
+void ngf_destroy_shader_stage(ngf_shader_stage stage) {
+  destroy_object(NGF_NULL_OBJECT_SHADER_STAGE, stage);
+}
+
+ngf_error ngf_create_graphics_pipeline(const ngf_graphics_pipeline_info *info,
+                                       ngf_graphics_pipeline *result) {
+  NULL_CHECK(info != nullptr, NGF_ERROR_INVALID_OPERATION,
+             "null graphics pipeline info");
+  NULL_CHECK(info->nshader_stages > 0u, NGF_ERROR_INVALID_OPERATION,
+             "graphics pipeline has no shader stages");
+  for (uint32_t i = 0u; i < info->nshader_stages; ++i) {
+    NULL_CHECK(is_live(info->shader_stages[i], NGF_NULL_OBJECT_SHADER_STAGE),
+               NGF_ERROR_INVALID_OPERATION,
+               "graphics pipeline refers to an invalid shader stage");
+  }
+  NULL_CHECK(is_live(info->compatible_render_target,
+                     NGF_NULL_OBJECT_RENDER_TARGET),
+             NGF_ERROR_INVALID_OPERATION,
+             "graphics pipeline has no valid compatible render target");
+  const ngf_error err =
+      create_object(NGF_NULL_OBJECT_GRAPHICS_PIPELINE, result);
+  if (err == NGF_ERROR_OK) (*result)->nstages = info->nshader_stages;
+  return err;
+}
+
+void ngf_destroy_graphics_pipeline(ngf_graphics_pipeline p) {
+  destroy_object(NGF_NULL_OBJECT_GRAPHICS_PIPELINE, p);
+}
+
+ngf_error ngf_create_image(const ngf_image_info *info, ngf_image *result) {
+  NULL_CHECK(info != nullptr, NGF_ERROR_INVALID_OPERATION, "null image info");
+  NULL_CHECK(info->extent.width > 0u && info->extent.height > 0u &&
+             info->extent.depth > 0u && info->nmips > 0u,
+             NGF_ERROR_INVALID_SIZE, "attempt to create an empty image");
+  const ngf_error err = create_object(NGF_NULL_OBJECT_IMAGE, result);
+  if (err == NGF_ERROR_OK) (*result)->info = *info;
+  return err;
+}
+
+void ngf_destroy_image(ngf_image image) {
+  destroy_object(NGF_NULL_OBJECT_IMAGE, image);
+}
+
+ngf_error ngf_create_sampler(const ngf_sampler_info *info,
+                             ngf_sampler *result) {
+  NULL_CHECK(info != nullptr, NGF_ERROR_INVALID_OPERATION,
+             "null sampler info");
+  const ngf_error err = create_object(NGF_NULL_OBJECT_SAMPLER, result);
+  if (err == NGF_ERROR_OK) (*result)->info = *info;
+  return err;
+}
+
+void ngf_destroy_sampler(ngf_sampler sampler) {
+  destroy_object(NGF_NULL_OBJECT_SAMPLER, sampler);
+}
+
+ngf_error ngf_create_render_target(const ngf_render_target_info *info,
+                                   ngf_render_target *result) {
+  NULL_CHECK(info != nullptr, NGF_ERROR_INVALID_OPERATION,
+             "null render target info");
+  return create_object(NGF_NULL_OBJECT_RENDER_TARGET, result);
+}
+
+ngf_error ngf_default_render_target(ngf_attachment_load_op,
+                                    ngf_attachment_load_op,
+                                    ngf_attachment_store_op,
+                                    ngf_attachment_store_op,
+                                    const ngf_clear*,
+                                    const ngf_clear*,
+                                    ngf_render_target *result) {
+  NULL_CHECK(g().current_context != nullptr, NGF_ERROR_INVALID_OPERATION,
+             "default render target requested without a current context");
+  const ngf_error err = create_object(NGF_NULL_OBJECT_RENDER_TARGET, result);
+  if (err == NGF_ERROR_OK) (*result)->is_default = true;
+  return err;
+}
+
+void ngf_destroy_render_target(ngf_render_target target) {
+  destroy_object(NGF_NULL_OBJECT_RENDER_TARGET, target);
+}
+
+#define NULL_BUFFER_IMPL(name, type_enum, info_type)                         \
+ngf_error ngf_create_##name(const info_type *info, ngf_##name *result) {     \
+  ngf_##name buf = nullptr;                                                  \
+  ngf_error err = create_object(type_enum, &buf);                            \
+  if (err != NGF_ERROR_OK) return err;                                       \
+  err = init_buffer(buf->storage, info);                                     \
+  if (err != NGF_ERROR_OK) {                                                 \
+    destroy_object(type_enum, buf);                                          \
+    return err;                                                              \
+  }                                                                          \
+  *result = buf;                                                             \
+  return NGF_ERROR_OK;                                                       \
+}                                                                            \
+void ngf_destroy_##name(ngf_##name buf) {                                    \
+  if (buf != nullptr && buf->storage.mapped) {                               \
+    validation_error("destroying a mapped buffer (%p)", (void*)buf);         \
+  }                                                                          \
+  destroy_object(type_enum, buf);                                            \
+}                                                                            \
+void* ngf_##name##_map_range(ngf_##name buf, size_t offset, size_t size,     \
+                             uint32_t) {                                     \
+  NULL_CHECK(is_live(buf, type_enum), nullptr,                               \
+             "attempt to map an invalid buffer");                            \
+  return map_buffer(buf->storage, offset, size);                             \
+}                                                                            \
+void ngf_##name##_flush_range(ngf_##name buf, size_t offset, size_t size) {  \
+  flush_buffer(buf->storage, offset, size);                                  \
+}                                                                            \
+void ngf_##name##_unmap(ngf_##name buf) {                                    \
+  unmap_buffer(buf->storage);                                                \
+}
+
+NULL_BUFFER_IMPL(attrib_buffer, NGF_NULL_OBJECT_ATTRIB_BUFFER,
+                 ngf_attrib_buffer_info)
+NULL_BUFFER_IMPL(index_buffer, NGF_NULL_OBJECT_INDEX_BUFFER,
+                 ngf_index_buffer_info)
+NULL_BUFFER_IMPL(uniform_buffer, NGF_NULL_OBJECT_UNIFORM_BUFFER,
+                 ngf_uniform_buffer_info)
+
+#undef NULL_BUFFER_IMPL
+
+ngf_error ngf_create_pixel_buffer(const ngf_pixel_buffer_info *info,
+                                  ngf_pixel_buffer *result) {
+  NULL_CHECK(info != nullptr && info->size > 0u, NGF_ERROR_INVALID_SIZE,
+             "attempt to create an empty pixel buffer");
+  ngf_pixel_buffer buf = nullptr;
+  const ngf_error err = create_object(NGF_NULL_OBJECT_PIXEL_BUFFER, &buf);
+  if (err != NGF_ERROR_OK) return err;
+  buf->storage.data.resize(info->size);
+  buf->storage.host_visible = true;
+  g().bytes_allocated += info->size;
+  *result = buf;
+  return NGF_ERROR_OK;
+}
+
+void ngf_destroy_pixel_buffer(ngf_pixel_buffer buf) {
+  destroy_object(NGF_NULL_OBJECT_PIXEL_BUFFER, buf);
+}
+
+void* ngf_pixel_buffer_map_range(ngf_pixel_buffer buf,
+                                 size_t offset,
+                                 size_t size,
+                                 uint32_t) {
+  NULL_CHECK(is_live(buf, NGF_NULL_OBJECT_PIXEL_BUFFER), nullptr,
+             "attempt to map an invalid pixel buffer");
+  return map_buffer(buf->storage, offset, size);
+}
+
+void ngf_pixel_buffer_flush_range(ngf_pixel_buffer buf,
+                                  size_t offset,
+                                  size_t size) {
+  flush_buffer(buf->storage, offset, size);
+}
+
+void ngf_pixel_buffer_unmap(ngf_pixel_buffer buf) {
+  unmap_buffer(buf->storage);
+}
+
+ngf_error ngf_create_cmd_buffer(const ngf_cmd_buffer_info*,
+                                ngf_cmd_buffer *result) {
+  return create_object(NGF_NULL_OBJECT_CMD_BUFFER, result);
+}
+
+void ngf_destroy_cmd_buffer(ngf_cmd_buffer buf) {
+  if (buf != nullptr && buf->state == cmd_buffer_state::RECORDING) {
+    validation_error("destroying a command buffer with an active encoder");
+  }
+  destroy_object(NGF_NULL_OBJECT_CMD_BUFFER, buf);
+}
+
+ngf_error ngf_start_cmd_buffer(ngf_cmd_buffer buf, ngf_frame_token token) {
+  NULL_CHECK(is_live(buf, NGF_NULL_OBJECT_CMD_BUFFER),
+             NGF_ERROR_INVALID_OPERATION,
+             "attempt to start an invalid command buffer");
+  NULL_CHECK(g().frame_active && (uint64_t)token == g().frame_id,
+             NGF_ERROR_INVALID_OPERATION,
+             "command buffer started with a stale frame token");
+  NULL_CHECK(buf->state != cmd_buffer_state::RECORDING,
+             NGF_ERROR_INVALID_OPERATION,
+             "attempt to start a command buffer with an active encoder");
+  buf->state = cmd_buffer_state::READY;
+  buf->frame_id = (uint64_t)token;
+  buf->in_pass = false;
+  buf->pipeline_bound = false;
+  buf->index_buffer_bound = false;
+  buf->cmds.clear();
+  return NGF_ERROR_OK;
+}
+
+ngf_error ngf_submit_cmd_buffers(uint32_t nbuffers, ngf_cmd_buffer *bufs) {
+  NULL_CHECK(nbuffers == 0u || bufs != nullptr, NGF_ERROR_INVALID_OPERATION,
+             "null command buffer array");
+  for (uint32_t i = 0u; i < nbuffers; ++i) {
+    ngf_cmd_buffer buf = bufs[i];
+    NULL_CHECK(is_live(buf, NGF_NULL_OBJECT_CMD_BUFFER),
+               NGF_ERROR_INVALID_OPERATION,
+               "attempt to submit an invalid command buffer");
+    NULL_CHECK(buf->state == cmd_buffer_state::READY,
+               NGF_ERROR_INVALID_OPERATION,
+               "submitted command buffer is not ready for submission");
+    NULL_CHECK(buf->frame_id == g().frame_id, NGF_ERROR_INVALID_OPERATION,
+               "command buffer was started in a different frame");
+  }
+  ++g().submissions;
+  std::lock_guard<std::mutex> lock(g().mut);
+  for (uint32_t i = 0u; i < nbuffers; ++i) {
+    ngf_cmd_buffer buf = bufs[i];
+    for (const ngf_null_cmd &cmd : buf->cmds) {
+      if (cmd.object != nullptr &&
+          g().live_objects.find(cmd.object) == g().live_objects.end()) {
+        validation_error("submitted command refers to a destroyed object");
+      }
+      ++g().cmds_submitted[cmd.type];
+    }
+    g().current_frame_log.insert(g().current_frame_log.end(),
+                                 buf->cmds.begin(), buf->cmds.end());
+    buf->state = cmd_buffer_state::SUBMITTED;
+    ++g().cmd_buffers_submitted;
+  }
+  return NGF_ERROR_OK;
+}
+
+ngf_error ngf_cmd_buffer_start_render(ngf_cmd_buffer buf,
+                                      ngf_render_encoder *enc) {
+  NULL_CHECK(is_live(buf, NGF_NULL_OBJECT_CMD_BUFFER) &&
+             buf->state == cmd_buffer_state::READY,
+             NGF_ERROR_INVALID_OPERATION,
+             "render encoder requested from a command buffer that is not "
+             "ready for recording");
+  buf->state = cmd_buffer_state::RECORDING;
+  *enc = make_encoder<ngf_render_encoder>(buf);
+  return NGF_ERROR_OK;
+}
+
+ngf_error ngf_cmd_buffer_start_xfer(ngf_cmd_buffer buf,
+                                    ngf_xfer_encoder *enc) {
+  NULL_CHECK(is_live(buf, NGF_NULL_OBJECT_CMD_BUFFER) &&
+             buf->state == cmd_buffer_state::READY,
+             NGF_ERROR_INVALID_OPERATION,
+             "transfer encoder requested from a command buffer that is not "
+             "ready for recording");
+  buf->state = cmd_buffer_state::RECORDING;
+  *enc = make_encoder<ngf_xfer_encoder>(buf);
+  return NGF_ERROR_OK;
+}
+
+ngf_error ngf_render_encoder_end(ngf_render_encoder enc) {
+  ngf_cmd_buffer buf = recording_cmd_buffer(enc, "ngf_render_encoder_end");
+  if (buf == nullptr) return NGF_ERROR_INVALID_OPERATION;
+  NULL_CHECK(!buf->in_pass, NGF_ERROR_INVALID_OPERATION,
+             "render encoder ended inside of a render pass");
+  buf->state = cmd_buffer_state::READY;
+  return NGF_ERROR_OK;
+}
+
+ngf_error ngf_xfer_encoder_end(ngf_xfer_encoder enc) {
+  ngf_cmd_buffer buf = recording_cmd_buffer(enc, "ngf_xfer_encoder_end");
+  if (buf == nullptr) return NGF_ERROR_INVALID_OPERATION;
+  buf->state = cmd_buffer_state::READY;
+  return NGF_ERROR_OK;
+}
+
+void ngf_cmd_begin_pass(ngf_render_encoder enc,
+                        const ngf_render_target target) {
+  ngf_cmd_buffer buf = recording_cmd_buffer(enc, "ngf_cmd_begin_pass");
+  if (buf == nullptr) return;
+  NULL_CHECK(!buf->in_pass, , "render passes may not be nested");
+  NULL_CHECK(target != nullptr, , "render pass started with a null target");
+  buf->in_pass = true;
+  buf->pipeline_bound = false;
+  record(buf, NGF_NULL_CMD_BEGIN_PASS, target);
+}
+
+void ngf_cmd_end_pass(ngf_render_encoder enc) {
+  ngf_cmd_buffer buf = recording_cmd_buffer(enc, "ngf_cmd_end_pass");
+  if (buf == nullptr) return;
+  NULL_CHECK(buf->in_pass, , "ngf_cmd_end_pass called outside of a pass");
+  buf->in_pass = false;
+  record(buf, NGF_NULL_CMD_END_PASS, nullptr);
+}
+
+void ngf_cmd_bind_gfx_pipeline(ngf_render_encoder enc,
+                               const ngf_graphics_pipeline pipeline) {
+  ngf_cmd_buffer buf = recording_cmd_buffer(enc, "ngf_cmd_bind_gfx_pipeline");
+  if (buf == nullptr) return;
+  NULL_CHECK(pipeline != nullptr, , "attempt to bind a null pipeline");
+  buf->pipeline_bound = true;
+  record(buf, NGF_NULL_CMD_BIND_PIPELINE, pipeline);
+}
+
+void ngf_cmd_viewport(ngf_render_encoder enc, const ngf_irect2d *r) {
+  ngf_cmd_buffer buf = recording_cmd_buffer(enc, "ngf_cmd_viewport");
+  if (buf == nullptr) return;
+  NULL_CHECK(r != nullptr, , "null viewport rectangle");
+  record(buf, NGF_NULL_CMD_VIEWPORT, nullptr, (uint64_t)(int64_t)r->x,
+         (uint64_t)(int64_t)r->y, r->width, r->height);
+}
+
+void ngf_cmd_scissor(ngf_render_encoder enc, const ngf_irect2d *r) {
+  ngf_cmd_buffer buf = recording_cmd_buffer(enc, "ngf_cmd_scissor");
+  if (buf == nullptr) return;
+  NULL_CHECK(r != nullptr, , "null scissor rectangle");
+  record(buf, NGF_NULL_CMD_SCISSOR, nullptr, (uint64_t)(int64_t)r->x,
+         (uint64_t)(int64_t)r->y, r->width, r->height);
+}
+
+void ngf_cmd_bind_gfx_resources(ngf_render_encoder enc,
+                                const ngf_resource_bind_op *bind_ops,
+                                uint32_t nbinds) {
+  ngf_cmd_buffer buf =
+      recording_cmd_buffer(enc, "ngf_cmd_bind_gfx_resources");
+  if (buf == nullptr) return;
+  NULL_CHECK(buf->pipeline_bound, ,
+             "resources bound before binding a pipeline");
+  for (uint32_t i = 0u; i < nbinds; ++i) {
+    const ngf_resource_bind_op &op = bind_ops[i];
+    const void *obj = nullptr;
+    uint64_t offset = 0u, range = 0u;
+    switch (op.type) {
+    case NGF_DESCRIPTOR_UNIFORM_BUFFER:
+      obj = op.info.uniform_buffer.buffer;
+      offset = op.info.uniform_buffer.offset;
+      range = op.info.uniform_buffer.range;
+      NULL_CHECK(obj != nullptr &&
+                 offset + range <= op.info.uniform_buffer.buffer->
+                                       storage.data.size(), ,
+                 "uniform buffer binding is out of bounds");
+      break;
+    case NGF_DESCRIPTOR_TEXTURE:
+      obj = op.info.image_sampler.image_subresource.image;
+      break;
+    case NGF_DESCRIPTOR_SAMPLER:
+      obj = op.info.image_sampler.sampler;
+      break;
+    default:
+      obj = op.info.image_sampler.image_subresource.image;
+      break;
+    }
+    record(buf, NGF_NULL_CMD_BIND_RESOURCES, obj,
+           op.target_set, op.target_binding, offset, range);
+  }
+}
+
+void ngf_cmd_bind_attrib_buffer(ngf_render_encoder enc,
+                                const ngf_attrib_buffer vbuf,
+                                uint32_t binding,
+                                uint32_t offset) {
+  ngf_cmd_buffer buf =
+      recording_cmd_buffer(enc, "ngf_cmd_bind_attrib_buffer");
+  if (buf == nullptr) return;
+  NULL_CHECK(vbuf != nullptr && offset <= vbuf->storage.data.size(), ,
+             "invalid attribute buffer binding");
+  record(buf, NGF_NULL_CMD_BIND_ATTRIB_BUFFER, vbuf, binding, offset);
+}
+
+void ngf_cmd_bind_index_buffer(ngf_render_encoder enc,
+                               const ngf_index_buffer idxbuf,
+                               ngf_type index_type) {
+  ngf_cmd_buffer buf = recording_cmd_buffer(enc, "ngf_cmd_bind_index_buffer");
+  if (buf == nullptr) return;
+  NULL_CHECK(idxbuf != nullptr, , "attempt to bind a null index buffer");
+  NULL_CHECK(index_type == NGF_TYPE_UINT16 || index_type == NGF_TYPE_UINT32, ,
+             "index type must be either UINT16 or UINT32");
+  buf->index_buffer_bound = true;
+  record(buf, NGF_NULL_CMD_BIND_INDEX_BUFFER, idxbuf, (uint64_t)index_type);
+}
+
+void ngf_cmd_draw(ngf_render_encoder enc,
+                  bool indexed,
+                  uint32_t first_element,
+                  uint32_t nelements,
+                  uint32_t ninstances) {
+  ngf_cmd_buffer buf = recording_cmd_buffer(enc, "ngf_cmd_draw");
+  if (buf == nullptr) return;
+  NULL_CHECK(buf->in_pass, , "draw recorded outside of a render pass");
+  NULL_CHECK(buf->pipeline_bound, , "draw recorded without a pipeline");
+  NULL_CHECK(!indexed || buf->index_buffer_bound, ,
+             "indexed draw recorded without an index buffer");
+  record(buf, NGF_NULL_CMD_DRAW, nullptr, indexed ? 1u : 0u, first_element,
+         nelements, ninstances);
+}
+
+#define NULL_COPY_IMPL(name)                                                 \
+void ngf_cmd_copy_##name(ngf_xfer_encoder enc, const ngf_##name src,         \
+                         ngf_##name dst, size_t size, size_t src_offset,     \
+                         size_t dst_offset) {                                \
+  ngf_cmd_buffer buf = recording_cmd_buffer(enc, "ngf_cmd_copy_" #name);     \
+  if (buf == nullptr) return;                                                \
+  NULL_CHECK(src != nullptr && dst != nullptr, , "null copy operand");       \
+  NULL_CHECK(src_offset + size <= src->storage.data.size() &&                \
+             dst_offset + size <= dst->storage.data.size(), ,                \
+             "buffer copy is out of bounds");                                \
+  memcpy(dst->storage.data.data() + dst_offset,                              \
+         src->storage.data.data() + src_offset, size);                       \
+  record(buf, NGF_NULL_CMD_COPY_BUFFER, dst, size, src_offset, dst_offset);  \
+}
+
+NULL_COPY_IMPL(attrib_buffer)
+NULL_COPY_IMPL(index_buffer)
+NULL_COPY_IMPL(uniform_buffer)
+
+#undef NULL_COPY_IMPL
+
+void ngf_cmd_write_image(ngf_xfer_encoder enc,
+                         const ngf_pixel_buffer src,
+                         size_t src_offset,
+                         ngf_image_ref dst,
+                         const ngf_offset3d *offset,
+                         const ngf_extent3d *extent) {
+  ngf_cmd_buffer buf = recording_cmd_buffer(enc, "ngf_cmd_write_image");
+  if (buf == nullptr) return;
+  NULL_CHECK(src != nullptr && dst.image != nullptr, ,
+             "null image write operand");
+  NULL_CHECK(offset != nullptr && extent != nullptr, ,
+             "null image write region");
+  NULL_CHECK(dst.mip_level < dst.image->info.nmips, ,
+             "image write targets a nonexistent mip level");
+  NULL_CHECK(src_offset < src->storage.data.size(), ,
+             "image write source offset is out of bounds");
+  record(buf, NGF_NULL_CMD_WRITE_IMAGE, dst.image, src_offset,
+         extent->width, extent->height, extent->depth);
+}
+
+}  // extern "C"
+
+ngf_null_stats ngf_null_get_stats() {
+  ngf_null_stats s;
+  s.frames = g().frames;
+  for (uint32_t i = 0u; i < NGF_NULL_OBJECT_TYPE_COUNT; ++i) {
+    s.objects_created[i] = g().objects_created[i];
+    s.objects_live[i] = g().objects_live[i];
+  }
+  s.bytes_allocated = g().bytes_allocated;
+  s.submissions = g().submissions;
+  s.cmd_buffers_submitted = g().cmd_buffers_submitted;
+  for (uint32_t i = 0u; i < NGF_NULL_CMD_TYPE_COUNT; ++i) {
+    s.cmds_submitted[i] = g().cmds_submitted[i];
+  }
+  s.validation_errors = g().validation_errors;
+  return s;
+}
+
+void ngf_null_reset_stats() {
+  g().frames = 0u;
+  for (auto &c : g().objects_created) c = 0u;
+  g().bytes_allocated = 0u;
+  g().submissions = 0u;
+  g().cmd_buffers_submitted = 0u;
+  for (auto &c : g().cmds_submitted) c = 0u;
+  g().validation_errors = 0u;
+}
+
+const ngf_null_cmd* ngf_null_last_frame_log(size_t *ncmds) {
+  *ncmds = g().last_frame_log.size();
+  return g().last_frame_log.data();
+}
+
+void ngf_null_dump_stats(FILE *out) {
+  static const char *object_names[NGF_NULL_OBJECT_TYPE_COUNT] = {
+    "context", "shader stage", "graphics pipeline", "image", "sampler",
+    "render target", "attrib buffer", "index buffer", "uniform buffer",
+    "pixel buffer", "cmd buffer"
+  };
+  static const char *cmd_names[NGF_NULL_CMD_TYPE_COUNT] = {
+    "begin pass", "end pass", "bind pipeline", "viewport", "scissor",
+    "bind resources", "bind attrib buffer", "bind index buffer", "draw",
+    "copy buffer", "write image"
+  };
+  const ngf_null_stats s = ngf_null_get_stats();
+  const double nframes = s.frames > 0u ? (double)s.frames : 1.0;
+  fprintf(out, "frames: %llu\n", (unsigned long long)s.frames);
+  fprintf(out, "%-20s %12s %12s %12s\n", "object", "created", "per frame",
+          "live");
+  for (uint32_t i = 0u; i < NGF_NULL_OBJECT_TYPE_COUNT; ++i) {
+    fprintf(out, "%-20s %12llu %12.2f %12llu\n", object_names[i],
+            (unsigned long long)s.objects_created[i],
+            (double)s.objects_created[i] / nframes,
+            (unsigned long long)s.objects_live[i]);
+  }
+  fprintf(out, "bytes allocated: %llu (%.1f per frame)\n",
+          (unsigned long long)s.bytes_allocated,
+          (double)s.bytes_allocated / nframes);
+  fprintf(out, "submissions: %llu (%.2f per frame)\n",
+          (unsigned long long)s.submissions, (double)s.submissions / nframes);
+  fprintf(out, "cmd buffers submitted: %llu (%.2f per frame)\n",
+          (unsigned long long)s.cmd_buffers_submitted,
+          (double)s.cmd_buffers_submitted / nframes);
+  for (uint32_t i = 0u; i < NGF_NULL_CMD_TYPE_COUNT; ++i) {
+    fprintf(out, "  %-20s %12llu (%.2f per frame)\n", cmd_names[i],
+            (unsigned long long)s.cmds_submitted[i],
+            (double)s.cmds_submitted[i] / nframes);
+  }
+  fprintf(out, "validation errors: %llu\n",
+          (unsigned long long)s.validation_errors);
+}
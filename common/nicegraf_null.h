@@ -0,0 +1,99 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <nicegraf.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// The null backend is a stand-in for a real nicegraf backend. It implements
+// the subset of the nicegraf API used by the samples without talking to a GPU:
+// arguments are validated, object lifetimes are tracked and the contents of
+// submitted command buffers are recorded into a log that can be inspected.
+// It is meant for testing and for measuring the CPU-side cost of the samples
+// on machines that don't have a GPU.
+// Build with -DNGF_SAMPLES_NULL_BACKEND=ON to link the samples against it.
+
+enum ngf_null_object_type {
+  NGF_NULL_OBJECT_CONTEXT,
+  NGF_NULL_OBJECT_SHADER_STAGE,
+  NGF_NULL_OBJECT_GRAPHICS_PIPELINE,
+  NGF_NULL_OBJECT_IMAGE,
+  NGF_NULL_OBJECT_SAMPLER,
+  NGF_NULL_OBJECT_RENDER_TARGET,
+  NGF_NULL_OBJECT_ATTRIB_BUFFER,
+  NGF_NULL_OBJECT_INDEX_BUFFER,
+  NGF_NULL_OBJECT_UNIFORM_BUFFER,
+  NGF_NULL_OBJECT_PIXEL_BUFFER,
+  NGF_NULL_OBJECT_CMD_BUFFER,
+  NGF_NULL_OBJECT_TYPE_COUNT
+};
+
+enum ngf_null_cmd_type {
+  NGF_NULL_CMD_BEGIN_PASS,
+  NGF_NULL_CMD_END_PASS,
+  NGF_NULL_CMD_BIND_PIPELINE,
+  NGF_NULL_CMD_VIEWPORT,
+  NGF_NULL_CMD_SCISSOR,
+  NGF_NULL_CMD_BIND_RESOURCES,
+  NGF_NULL_CMD_BIND_ATTRIB_BUFFER,
+  NGF_NULL_CMD_BIND_INDEX_BUFFER,
+  NGF_NULL_CMD_DRAW,
+  NGF_NULL_CMD_COPY_BUFFER,
+  NGF_NULL_CMD_WRITE_IMAGE,
+  NGF_NULL_CMD_TYPE_COUNT
+};
+
+// A single recorded command. `object` is the main object the command refers
+// to (pipeline, render target, buffer...), the meaning of `args` depends on
+// the command type (e.g. for draws it is {indexed, first, count, instances}).
+struct ngf_null_cmd {
+  ngf_null_cmd_type type;
+  const void       *object;
+  uint64_t          args[4];
+};
+
+// Counters accumulated since initialization (or the last reset).
+struct ngf_null_stats {
+  uint64_t frames;
+  uint64_t objects_created[NGF_NULL_OBJECT_TYPE_COUNT];
+  uint64_t objects_live[NGF_NULL_OBJECT_TYPE_COUNT];
+  uint64_t bytes_allocated;
+  uint64_t submissions;
+  uint64_t cmd_buffers_submitted;
+  uint64_t cmds_submitted[NGF_NULL_CMD_TYPE_COUNT];
+  uint64_t validation_errors;
+};
+
+// Returns a snapshot of the counters.
+ngf_null_stats ngf_null_get_stats();
+
+// Resets all counters except the numbers of live objects.
+void ngf_null_reset_stats();
+
+// Returns the commands submitted during the last completed frame, in
+// submission order. The returned pointer is valid until the next call to
+// ngf_end_frame.
+const ngf_null_cmd* ngf_null_last_frame_log(size_t *ncmds);
+
+// Prints a human-readable summary of the counters (with per-frame averages).
+void ngf_null_dump_stats(FILE *out);
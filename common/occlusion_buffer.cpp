@@ -0,0 +1,274 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "occlusion_buffer.h"
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define OCCLUSION_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+// Vertices with a smaller w are considered to be behind the camera.
+static constexpr float MIN_W = 1e-3f;
+
+// Clamps a screen coordinate to [0, limit] and truncates it.
+static uint32_t to_pixel(float v, uint32_t limit) {
+  return (uint32_t)std::min(std::max(v, 0.0f), (float)limit);
+}
+
+occlusion_buffer::occlusion_buffer(uint32_t width, uint32_t height) :
+    width_(width),
+    height_(height),
+    tiles_x_(width / TILE_WIDTH),
+    tiles_y_(height / TILE_HEIGHT),
+    world_to_clip_(nm::float4x4::identity()),
+    bins_(tiles_x_ * tiles_y_),
+    depth_(width * height, 0.0f),
+    block_depth_((width / BLOCK_SIZE) * (height / BLOCK_SIZE), 0.0f) {
+  assert(width % TILE_WIDTH == 0u && height % TILE_HEIGHT == 0u);
+}
+
+void occlusion_buffer::begin_frame(const nm::float4x4 &world_to_clip) {
+  world_to_clip_ = world_to_clip;
+  triangles_.clear();
+  for (std::vector<uint32_t> &bin : bins_) bin.clear();
+}
+
+void occlusion_buffer::add_occluder(const float        *positions,
+                                    const uint16_t     *indices,
+                                    uint32_t            nindices,
+                                    const nm::float4x4 &model_to_world) {
+  const nm::float4x4 model_to_clip = world_to_clip_ * model_to_world;
+  const float w = (float)width_, h = (float)height_;
+  for (uint32_t i = 0u; i + 2u < nindices; i += 3u) {
+    screen_triangle t;
+    bool behind = false;
+    for (uint32_t v = 0u; v < 3u; ++v) {
+      const float *p = &positions[3u * indices[i + v]];
+      const nm::float4 clip =
+          model_to_clip * nm::float4 { p[0], p[1], p[2], 1.0f };
+      behind = behind || clip[3] < MIN_W;
+      t.inv_w[v] = 1.0f / clip[3];
+      t.x[v] = (clip[0] * t.inv_w[v] * 0.5f + 0.5f) * w;
+      t.y[v] = (clip[1] * t.inv_w[v] * 0.5f + 0.5f) * h;
+    }
+    if (behind) continue;
+
+    // Put the triangle into the bins of the tiles its bounds overlap.
+    const float min_x = std::min(t.x[0], std::min(t.x[1], t.x[2]));
+    const float max_x = std::max(t.x[0], std::max(t.x[1], t.x[2]));
+    const float min_y = std::min(t.y[0], std::min(t.y[1], t.y[2]));
+    const float max_y = std::max(t.y[0], std::max(t.y[1], t.y[2]));
+    if (max_x < 0.0f || max_y < 0.0f || min_x >= w || min_y >= h) continue;
+    const uint32_t tx0 = to_pixel(min_x, width_ - 1u) / TILE_WIDTH;
+    const uint32_t ty0 = to_pixel(min_y, height_ - 1u) / TILE_HEIGHT;
+    const uint32_t tx1 = to_pixel(max_x, width_ - 1u) / TILE_WIDTH;
+    const uint32_t ty1 = to_pixel(max_y, height_ - 1u) / TILE_HEIGHT;
+    const uint32_t index = (uint32_t)triangles_.size();
+    triangles_.push_back(t);
+    for (uint32_t ty = ty0; ty <= ty1; ++ty) {
+      for (uint32_t tx = tx0; tx <= tx1; ++tx) {
+        bins_[ty * tiles_x_ + tx].push_back(index);
+      }
+    }
+  }
+}
+
+void occlusion_buffer::rasterize(thread_pool &pool) {
+  pool.parallel_for(tiles_x_ * tiles_y_, 1u,
+                    [this](uint32_t begin, uint32_t end) {
+                      for (uint32_t t = begin; t < end; ++t) {
+                        rasterize_tile(t);
+                      }
+                    });
+}
+
+void occlusion_buffer::rasterize_tile(uint32_t tile) {
+  const uint32_t tile_x0 = (tile % tiles_x_) * TILE_WIDTH;
+  const uint32_t tile_y0 = (tile / tiles_x_) * TILE_HEIGHT;
+  const uint32_t tile_x1 = tile_x0 + TILE_WIDTH;
+  const uint32_t tile_y1 = tile_y0 + TILE_HEIGHT;
+  for (uint32_t y = tile_y0; y < tile_y1; ++y) {
+    std::fill_n(&depth_[y * width_ + tile_x0], TILE_WIDTH, 0.0f);
+  }
+
+  for (uint32_t index : bins_[tile]) {
+    screen_triangle t = triangles_[index];
+    float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) -
+                 (t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+    if (fabsf(area) < 1e-6f) continue;
+    if (area < 0.0f) {
+      // Make the winding counter-clockwise.
+      std::swap(t.x[1], t.x[2]);
+      std::swap(t.y[1], t.y[2]);
+      std::swap(t.inv_w[1], t.inv_w[2]);
+      area = -area;
+    }
+
+    // Edge functions e_i(x, y) = a_i * x + b_i * y + c_i, where edge i is
+    // the one opposite vertex i. Inside the triangle, all of them are
+    // non-negative, and e_i / area is the barycentric weight of vertex i.
+    float a[3], b[3], c[3];
+    for (int i = 0; i < 3; ++i) {
+      const int v0 = (i + 1) % 3, v1 = (i + 2) % 3;
+      a[i] = t.y[v0] - t.y[v1];
+      b[i] = t.x[v1] - t.x[v0];
+      c[i] = t.x[v0] * t.y[v1] - t.x[v1] * t.y[v0];
+    }
+    // 1/w is linear in screen space.
+    float za = 0.0f, zb = 0.0f, zc = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+      za += a[i] * t.inv_w[i] / area;
+      zb += b[i] * t.inv_w[i] / area;
+      zc += c[i] * t.inv_w[i] / area;
+    }
+
+    // Bounds within the tile. The left edge is aligned to 4 pixels, which
+    // are processed together.
+    const float min_x = std::min(t.x[0], std::min(t.x[1], t.x[2]));
+    const float max_x = std::max(t.x[0], std::max(t.x[1], t.x[2]));
+    const float min_y = std::min(t.y[0], std::min(t.y[1], t.y[2]));
+    const float max_y = std::max(t.y[0], std::max(t.y[1], t.y[2]));
+    const uint32_t x0 = std::max(to_pixel(min_x, tile_x1) & ~3u, tile_x0);
+    const uint32_t y0 = std::max(to_pixel(min_y, tile_y1), tile_y0);
+    const uint32_t x1 = to_pixel(max_x + 1.0f, tile_x1);
+    const uint32_t y1 = to_pixel(max_y + 1.0f, tile_y1);
+
+    for (uint32_t y = y0; y < y1; ++y) {
+      const float py = (float)y + 0.5f;
+      float *row = &depth_[y * width_];
+#if defined(OCCLUSION_USE_SSE)
+      // Pixel centers of the first 4 pixels.
+      const __m128 px = _mm_add_ps(_mm_set1_ps((float)x0),
+                                   _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f));
+      __m128 e[3], e_step[3];
+      for (int i = 0; i < 3; ++i) {
+        e[i] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[i]), px),
+                          _mm_set1_ps(b[i] * py + c[i]));
+        e_step[i] = _mm_set1_ps(a[i] * 4.0f);
+      }
+      __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(za), px),
+                            _mm_set1_ps(zb * py + zc));
+      const __m128 z_step = _mm_set1_ps(za * 4.0f);
+      const __m128 zero = _mm_setzero_ps();
+      for (uint32_t x = x0; x < x1; x += 4u) {
+        const __m128 inside =
+            _mm_and_ps(_mm_cmpge_ps(e[0], zero),
+                       _mm_and_ps(_mm_cmpge_ps(e[1], zero),
+                                  _mm_cmpge_ps(e[2], zero)));
+        if (_mm_movemask_ps(inside) != 0) {
+          const __m128 old_depth = _mm_loadu_ps(&row[x]);
+          const __m128 new_depth = _mm_max_ps(old_depth, z);
+          _mm_storeu_ps(&row[x],
+                        _mm_or_ps(_mm_and_ps(inside, new_depth),
+                                  _mm_andnot_ps(inside, old_depth)));
+        }
+        for (int i = 0; i < 3; ++i) e[i] = _mm_add_ps(e[i], e_step[i]);
+        z = _mm_add_ps(z, z_step);
+      }
+#else
+      for (uint32_t x = x0; x < x1; ++x) {
+        const float px = (float)x + 0.5f;
+        bool inside = true;
+        for (int i = 0; i < 3; ++i) {
+          inside = inside && a[i] * px + b[i] * py + c[i] >= 0.0f;
+        }
+        if (inside) row[x] = std::max(row[x], za * px + zb * py + zc);
+      }
+#endif
+    }
+  }
+
+  // Update the coarse level for the tile's blocks.
+  const uint32_t blocks_x = width_ / BLOCK_SIZE;
+  for (uint32_t by = tile_y0; by < tile_y1; by += BLOCK_SIZE) {
+    for (uint32_t bx = tile_x0; bx < tile_x1; bx += BLOCK_SIZE) {
+      float block_min = depth_[by * width_ + bx];
+      for (uint32_t y = by; y < by + BLOCK_SIZE; ++y) {
+        for (uint32_t x = bx; x < bx + BLOCK_SIZE; ++x) {
+          block_min = std::min(block_min, depth_[y * width_ + x]);
+        }
+      }
+      block_depth_[(by / BLOCK_SIZE) * blocks_x + bx / BLOCK_SIZE] =
+          block_min;
+    }
+  }
+}
+
+bool occlusion_buffer::is_occluded(const float *box_min,
+                                   const float *box_max) const {
+  // Project the corners, and find the box's screen bounds and the 1/w of
+  // its nearest point.
+  float min_x = (float)width_, max_x = 0.0f;
+  float min_y = (float)height_, max_y = 0.0f;
+  float nearest = 0.0f;
+  for (uint32_t corner = 0u; corner < 8u; ++corner) {
+    const nm::float4 p {
+      (corner & 1u) ? box_max[0] : box_min[0],
+      (corner & 2u) ? box_max[1] : box_min[1],
+      (corner & 4u) ? box_max[2] : box_min[2],
+      1.0f
+    };
+    const nm::float4 clip = world_to_clip_ * p;
+    if (clip[3] < MIN_W) return false;
+    const float inv_w = 1.0f / clip[3];
+    const float x = (clip[0] * inv_w * 0.5f + 0.5f) * (float)width_;
+    const float y = (clip[1] * inv_w * 0.5f + 0.5f) * (float)height_;
+    min_x = std::min(min_x, x);
+    max_x = std::max(max_x, x);
+    min_y = std::min(min_y, y);
+    max_y = std::max(max_y, y);
+    nearest = std::max(nearest, inv_w);
+  }
+  if (max_x < 0.0f || max_y < 0.0f || min_x >= (float)width_ ||
+      min_y >= (float)height_) {
+    return false;
+  }
+
+  // Pixels the box may touch, with a pixel of margin.
+  const uint32_t x0 = to_pixel(min_x - 1.0f, width_ - 1u);
+  const uint32_t y0 = to_pixel(min_y - 1.0f, height_ - 1u);
+  const uint32_t x1 = to_pixel(max_x + 1.0f, width_ - 1u);
+  const uint32_t y1 = to_pixel(max_y + 1.0f, height_ - 1u);
+
+  // Blocks whose farthest pixel is in front of the box hide it entirely.
+  // Only look at the pixels of the other blocks.
+  const uint32_t blocks_x = width_ / BLOCK_SIZE;
+  for (uint32_t by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; ++by) {
+    for (uint32_t bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; ++bx) {
+      if (block_depth_[by * blocks_x + bx] > nearest) continue;
+      const uint32_t px0 = std::max(bx * BLOCK_SIZE, x0);
+      const uint32_t px1 = std::min(bx * BLOCK_SIZE + BLOCK_SIZE - 1u, x1);
+      const uint32_t py0 = std::max(by * BLOCK_SIZE, y0);
+      const uint32_t py1 = std::min(by * BLOCK_SIZE + BLOCK_SIZE - 1u, y1);
+      for (uint32_t y = py0; y <= py1; ++y) {
+        for (uint32_t x = px0; x <= px1; ++x) {
+          if (depth_[y * width_ + x] <= nearest) return false;
+        }
+      }
+    }
+  }
+  return true;
+}
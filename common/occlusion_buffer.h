@@ -0,0 +1,89 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include "nicemath.h"
+#include "thread_pool.h"
+#include <stdint.h>
+#include <vector>
+
+// A low-resolution depth buffer for occlusion culling on the CPU.
+//
+// Each frame, designated occluders are rasterized into the buffer, tile by
+// tile across the thread pool, with SSE where it's available. The buffer
+// keeps 1/w for each pixel, and the minimum of that over 8x8-pixel blocks
+// as a coarser level. Bounding boxes are then tested against the coarse
+// level first, and against individual pixels only where that isn't enough.
+//
+// Occluder triangles crossing the near plane are skipped, and pixels are
+// covered if their centers are, so the results are approximate, erring on
+// the side of keeping objects visible.
+class occlusion_buffer {
+public:
+  static constexpr uint32_t TILE_WIDTH = 32u;
+  static constexpr uint32_t TILE_HEIGHT = 32u;
+  static constexpr uint32_t BLOCK_SIZE = 8u;
+
+  // Dimensions must be multiples of the tile size.
+  explicit occlusion_buffer(uint32_t width = 256u, uint32_t height = 128u);
+
+  // Clears the buffer and sets the transform for this frame's occluders and
+  // tests.
+  void begin_frame(const nm::float4x4 &world_to_clip);
+
+  // Queues an indexed triangle mesh for rasterization. `positions` holds
+  // three floats per vertex.
+  void add_occluder(const float        *positions,
+                    const uint16_t     *indices,
+                    uint32_t            nindices,
+                    const nm::float4x4 &model_to_world);
+
+  // Rasterizes the queued occluders.
+  void rasterize(thread_pool &pool);
+
+  // Whether the given world-space box is hidden by the occluders. Boxes
+  // that are partly behind the camera, or entirely off the screen, are
+  // never reported as hidden. Safe to call from multiple threads at once.
+  bool is_occluded(const float *box_min, const float *box_max) const;
+
+  // Triangles queued since the last call to begin_frame.
+  uint32_t triangle_count() const { return (uint32_t)triangles_.size(); }
+
+private:
+  struct screen_triangle {
+    float x[3];
+    float y[3];
+    float inv_w[3];
+  };
+
+  void rasterize_tile(uint32_t tile);
+
+  uint32_t                           width_;
+  uint32_t                           height_;
+  uint32_t                           tiles_x_;
+  uint32_t                           tiles_y_;
+  nm::float4x4                       world_to_clip_;
+  std::vector<screen_triangle>       triangles_;
+  std::vector<std::vector<uint32_t>> bins_; // Triangles touching each tile.
+  std::vector<float>                 depth_; // 1/w, 0 where nothing's drawn.
+  std::vector<float>                 block_depth_; // Minimums over blocks.
+};
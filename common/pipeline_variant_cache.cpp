@@ -0,0 +1,214 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "pipeline_variant_cache.h"
+#include "common.h"
+#include <assert.h>
+#include <string.h>
+
+// FNV-1a.
+static uint64_t hash_bytes(uint64_t h, const void *bytes, size_t size) {
+  const uint8_t *p = (const uint8_t*)bytes;
+  for (size_t i = 0u; i < size; ++i) h = (h ^ p[i]) * 1099511628211ull;
+  return h;
+}
+
+pipeline_variant_cache::pipeline_variant_cache(uint32_t max_variants) :
+    max_variants_(max_variants) {}
+
+pipeline_variant_cache::~pipeline_variant_cache() {
+  for (auto &bucket : variants_) {
+    for (variant &v : bucket.second) {
+      if (v.job.valid()) v.job.wait();
+    }
+  }
+}
+
+uint32_t pipeline_variant_cache::add_base(
+    const ngf_graphics_pipeline_info  &info,
+    const ngf_constant_specialization *specializations,
+    uint32_t                           nspecializations,
+    size_t                             values_size,
+    const void                        *generic_values) {
+  std::unique_ptr<base_pipeline> base { new base_pipeline };
+  base->info = &info;
+  base->specializations.assign(specializations,
+                               specializations + nspecializations);
+  base->values_size = values_size;
+
+  // A base is identified by its shader stages, its state and the layout of
+  // its constants.
+  uint64_t h = 14695981039346656037ull;
+  h = hash_bytes(h, info.shader_stages,
+                 sizeof(ngf_shader_stage) * info.nshader_stages);
+  const void *state[] = {
+    info.input_info, info.multisample, info.depth_stencil, info.blend,
+    info.layout, info.compatible_render_target
+  };
+  h = hash_bytes(h, state, sizeof(state));
+  for (const ngf_constant_specialization &s : base->specializations) {
+    h = hash_bytes(h, &s.constant_id, sizeof(s.constant_id));
+    h = hash_bytes(h, &s.offset, sizeof(s.offset));
+    h = hash_bytes(h, &s.type, sizeof(s.type));
+  }
+  base->hash = h;
+
+  const ngf_error err = create_variant(*base, generic_values, base->generic);
+  assert(err == NGF_ERROR_OK);
+  bases_.push_back(std::move(base));
+  return (uint32_t)bases_.size() - 1u;
+}
+
+ngf_error pipeline_variant_cache::create_variant(
+    const base_pipeline    &base,
+    const void             *values,
+    ngf::graphics_pipeline &result) {
+  std::vector<uint8_t> values_copy((const uint8_t*)values,
+                                   (const uint8_t*)values + base.values_size);
+  std::vector<ngf_constant_specialization> specs = base.specializations;
+  ngf_specialization_info spec_info;
+  spec_info.specializations = specs.data();
+  spec_info.nspecializations = (uint32_t)specs.size();
+  spec_info.value_buffer = values_copy.data();
+  ngf_graphics_pipeline_info info = *base.info;
+  info.spec_info = &spec_info;
+  return result.initialize(info);
+}
+
+uint64_t pipeline_variant_cache::variant_key(const base_pipeline &base,
+                                             const void *values) const {
+  return hash_bytes(base.hash, values, base.values_size);
+}
+
+void pipeline_variant_cache::start_creation(variant &v) {
+  if (!compiler_) compiler_ = create_background_thread_pool(1u);
+  v.pipeline = std::make_shared<ngf::graphics_pipeline>();
+  v.failed = false;
+  std::shared_ptr<ngf::graphics_pipeline> result = v.pipeline;
+  const base_pipeline *base_ptr = bases_[v.base].get();
+  std::vector<uint8_t> job_values = v.values;
+  v.job = compiler_->enqueue([result, base_ptr, job_values] {
+    if (create_variant(*base_ptr, job_values.data(), *result) !=
+        NGF_ERROR_OK) {
+      result->reset(nullptr);
+    }
+  });
+  ++stats_.pending;
+}
+
+ngf_graphics_pipeline pipeline_variant_cache::get(uint32_t    base_index,
+                                                  const void *values) {
+  assert(base_index < bases_.size());
+  const base_pipeline &base = *bases_[base_index];
+  std::vector<variant> &bucket = variants_[variant_key(base, values)];
+  for (variant &v : bucket) {
+    if (v.base != base_index ||
+        memcmp(v.values.data(), values, base.values_size) != 0) {
+      continue;
+    }
+    v.last_used_frame = frame_;
+    if (v.ready) {
+      ++stats_.hits;
+      return v.pipeline->get();
+    }
+    if (v.failed) {
+      // Try again once in a while, in case the failure was transient.
+      ++stats_.failed_requests;
+      if (frame_ >= v.retry_frame && stats_.pending < max_pending) {
+        --stats_.failed;
+        start_creation(v);
+      }
+      return base.generic.get();
+    }
+    ++stats_.misses;
+    return base.generic.get();
+  }
+
+  // Not seen before: start creating it on the compile thread, which has the
+  // context current. If enough variants are being created already, make do
+  // with the generic one; the variant gets requested again later if it's
+  // still wanted.
+  ++stats_.misses;
+  if (stats_.pending >= max_pending) return base.generic.get();
+  variant v;
+  v.base = base_index;
+  v.values.assign((const uint8_t*)values,
+                  (const uint8_t*)values + base.values_size);
+  v.last_used_frame = frame_;
+  start_creation(v);
+  bucket.push_back(std::move(v));
+  return base.generic.get();
+}
+
+void pipeline_variant_cache::update() {
+  ++frame_;
+  // Variants used by frames that may still be in flight can't be destroyed.
+  const uint64_t frames_in_flight =
+      get_active_context_profile().capacity_hint + 1u;
+  uint32_t nready = 0u;
+  for (auto &bucket : variants_) {
+    for (variant &v : bucket.second) {
+      if (v.job.valid() &&
+          v.job.wait_for(std::chrono::seconds(0)) ==
+              std::future_status::ready) {
+        v.job.get();
+        v.ready = v.pipeline->get() != nullptr;
+        --stats_.pending;
+        if (!v.ready) {
+          v.failed = true;
+          v.retry_frame = frame_ + retry_delay_frames;
+          ++stats_.failed;
+          ++stats_.failures;
+        }
+      }
+      if (v.ready) ++nready;
+    }
+  }
+
+  // Evict the least recently used variants until there are few enough.
+  // Failed variants hold no pipeline, but count towards the limit, so that
+  // they don't pile up either.
+  uint32_t nfailed = stats_.failed;
+  while (nready + nfailed > max_variants_) {
+    variant *lru = nullptr;
+    std::vector<variant> *lru_bucket = nullptr;
+    for (auto &bucket : variants_) {
+      for (variant &v : bucket.second) {
+        if ((v.ready || v.failed) &&
+            v.last_used_frame + frames_in_flight <= frame_ &&
+            (lru == nullptr || v.last_used_frame < lru->last_used_frame)) {
+          lru = &v;
+          lru_bucket = &bucket.second;
+        }
+      }
+    }
+    if (lru == nullptr) break;
+    if (lru->ready) {
+      --nready;
+    } else {
+      --nfailed;
+    }
+    lru_bucket->erase(lru_bucket->begin() + (lru - lru_bucket->data()));
+    ++stats_.evictions;
+  }
+  stats_.variants = nready;
+  stats_.failed = nfailed;
+}
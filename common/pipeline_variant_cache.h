@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <nicegraf.h>
+#include <nicegraf_wrappers.h>
+#include <future>
+#include <memory>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include "thread_pool.h"
+
+// Keeps variants of graphics pipelines that differ only in the values of
+// their specialization constants, keyed by (base pipeline hash, values).
+//
+// Each base pipeline has a generic variant, which is created up front. Other
+// variants are created on demand on a compile thread owned by the cache, so
+// that they don't hold up the per-frame jobs on the shared worker pool. At
+// most a couple of variants are created at a time; until a variant is ready,
+// the generic one is returned instead, so asking for a new variant never
+// stalls the frame. A variant that fails to be created falls back to the
+// generic one as well, and creating it is retried every few seconds while it
+// keeps getting requested. When there are more than the given number of
+// variants, the least recently used ones are destroyed.
+//
+// All methods must be called from the main thread, and get() only while the
+// sample runs.
+class pipeline_variant_cache {
+public:
+  explicit pipeline_variant_cache(uint32_t max_variants = 16u);
+  ~pipeline_variant_cache();
+
+  pipeline_variant_cache(const pipeline_variant_cache&) = delete;
+  pipeline_variant_cache& operator=(const pipeline_variant_cache&) = delete;
+
+  // Registers a base pipeline and creates its generic variant, specialized
+  // with `generic_values`. The pipeline info's own spec_info is ignored.
+  // `specializations` describes the constants, whose values take up
+  // `values_size` bytes. Everything the pipeline info points to must stay
+  // alive as long as the cache. Returns the base's index.
+  uint32_t add_base(const ngf_graphics_pipeline_info &info,
+                    const ngf_constant_specialization *specializations,
+                    uint32_t                           nspecializations,
+                    size_t                             values_size,
+                    const void                        *generic_values);
+
+  // Returns the variant of the given base for the given values, or the
+  // base's generic variant if that one isn't ready yet (in which case it
+  // starts getting created, unless too many variants already are).
+  ngf_graphics_pipeline get(uint32_t base, const void *values);
+
+  // Picks up variants that finished creation, and evicts the least recently
+  // used ones. Must be called once per frame.
+  void update();
+
+  struct stats {
+    uint32_t variants = 0u; // Variants that are ready.
+    uint32_t pending = 0u; // Variants being created.
+    uint32_t failed = 0u; // Variants that failed to be created.
+    uint64_t hits = 0u; // Requests served by the requested variant.
+    uint64_t misses = 0u; // Requests served by the generic variant.
+    uint64_t failed_requests = 0u; // Requests for failed variants.
+    uint64_t failures = 0u; // Failed attempts to create a variant.
+    uint64_t evictions = 0u;
+  };
+  const stats& get_stats() const { return stats_; }
+
+private:
+  struct base_pipeline {
+    const ngf_graphics_pipeline_info *info;
+    std::vector<ngf_constant_specialization> specializations;
+    size_t values_size;
+    uint64_t hash;
+    ngf::graphics_pipeline generic;
+  };
+  struct variant {
+    uint32_t base;
+    std::vector<uint8_t> values;
+    std::shared_ptr<ngf::graphics_pipeline> pipeline; // Written by job.
+    std::future<void> job; // Creation in progress, if any.
+    bool ready = false;
+    bool failed = false;
+    uint64_t retry_frame = 0u; // When to try creating a failed variant again.
+    uint64_t last_used_frame = 0u;
+  };
+
+  // Creates a pipeline from the given base, specialized with the values.
+  static ngf_error create_variant(const base_pipeline  &base,
+                                  const void           *values,
+                                  ngf::graphics_pipeline &result);
+
+  uint64_t variant_key(const base_pipeline &base, const void *values) const;
+
+  // Starts creating the given variant on the compile thread.
+  void start_creation(variant &v);
+
+  // Variants that may be getting created at the same time.
+  static constexpr uint32_t max_pending = 2u;
+  // Frames to wait before creating a failed variant again.
+  static constexpr uint64_t retry_delay_frames = 300u;
+
+  uint32_t max_variants_;
+  uint64_t frame_ = 0u;
+  std::vector<std::unique_ptr<base_pipeline>> bases_;
+  // Variants that hash the same are kept in the same bucket.
+  std::unordered_map<uint64_t, std::vector<variant>> variants_;
+  stats stats_;
+  // Started on the first variant request. Declared last, so that its thread
+  // is joined before anything the jobs refer to goes away.
+  std::unique_ptr<thread_pool> compiler_;
+};
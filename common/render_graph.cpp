@@ -0,0 +1,397 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "render_graph.h"
+#include "common.h"
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+
+// Position of uses that extend to the end of the frame.
+static constexpr uint32_t END_OF_FRAME = ~0u;
+
+// FNV-1a.
+static uint64_t hash_bytes(uint64_t h, const void *bytes, size_t size) {
+  const uint8_t *p = (const uint8_t*)bytes;
+  for (size_t i = 0u; i < size; ++i) h = (h ^ p[i]) * 1099511628211ull;
+  return h;
+}
+
+// Approximate size of a pixel in the given format, for reporting.
+static size_t bytes_per_pixel(ngf_image_format format) {
+  switch (format) {
+  case NGF_IMAGE_FORMAT_R8:
+    return 1u;
+  case NGF_IMAGE_FORMAT_DEPTH16:
+    return 2u;
+  default:
+    return 4u;
+  }
+}
+
+static size_t image_bytes(const render_graph::image_desc &desc) {
+  return (size_t)desc.width * desc.height * bytes_per_pixel(desc.format) *
+         (size_t)desc.sample_count;
+}
+
+static bool same_desc(const render_graph::image_desc &a,
+                      const render_graph::image_desc &b) {
+  return a.width == b.width && a.height == b.height &&
+         a.format == b.format && a.sample_count == b.sample_count;
+}
+
+void render_graph::pass_builder::read(resource r) {
+  assert(r != BACKBUFFER);
+  graph_.passes_[pass_].reads.push_back(r);
+}
+
+void render_graph::pass_builder::write_color(resource               r,
+                                             ngf_attachment_load_op load_op,
+                                             const ngf_clear       &clear) {
+  graph_.passes_[pass_].writes.push_back(
+      attachment_use { r, NGF_ATTACHMENT_COLOR, load_op, clear });
+}
+
+void render_graph::pass_builder::write_depth(resource               r,
+                                             ngf_attachment_load_op load_op,
+                                             const ngf_clear       &clear) {
+  graph_.passes_[pass_].writes.push_back(
+      attachment_use { r, NGF_ATTACHMENT_DEPTH, load_op, clear });
+}
+
+render_graph::render_graph() {
+  reset();
+}
+
+void render_graph::reset() {
+  passes_.clear();
+  resources_.clear();
+  order_.clear();
+  resources_.emplace_back();
+  resources_.back().name = "backbuffer";
+  compiled_ = false;
+}
+
+render_graph::resource render_graph::create_image(const char       *name,
+                                                  const image_desc &desc) {
+  resources_.emplace_back();
+  resources_.back().name = name;
+  resources_.back().desc = desc;
+  return (resource)resources_.size() - 1u;
+}
+
+void render_graph::mark_output(resource r) {
+  resources_[r].output = true;
+}
+
+render_graph::pass render_graph::add_pass(
+    const char                               *name,
+    const std::function<void(pass_builder&)> &setup,
+    execute_fn                                execute) {
+  passes_.emplace_back();
+  passes_.back().name = name;
+  passes_.back().execute = std::move(execute);
+  const pass p = (pass)passes_.size() - 1u;
+  pass_builder builder { *this, p };
+  setup(builder);
+  return p;
+}
+
+ngf_error render_graph::compile() {
+  const uint32_t npasses = (uint32_t)passes_.size();
+  const uint32_t nresources = (uint32_t)resources_.size();
+
+  // Work out what each pass has to wait for: the previous pass that wrote
+  // to the same image, and every pass writing to an image it reads.
+  std::vector<std::vector<pass>> writers(nresources);
+  for (pass p = 0u; p < npasses; ++p) {
+    for (const attachment_use &w : passes_[p].writes) {
+      writers[w.res].push_back(p);
+    }
+  }
+  std::vector<std::vector<pass>> dependents(npasses);
+  std::vector<uint32_t> ndependencies(npasses, 0u);
+  auto add_dependency = [&](pass before, pass after) {
+    dependents[before].push_back(after);
+    ++ndependencies[after];
+  };
+  for (const std::vector<pass> &w : writers) {
+    for (size_t i = 1u; i < w.size(); ++i) add_dependency(w[i - 1u], w[i]);
+  }
+  for (pass p = 0u; p < npasses; ++p) {
+    for (resource r : passes_[p].reads) {
+      for (pass w : writers[r]) {
+        if (w == p) return NGF_ERROR_INVALID_OPERATION;
+        add_dependency(w, p);
+      }
+    }
+  }
+
+  // Sort the passes topologically, preferring the order they were added in.
+  std::vector<pass> sorted;
+  std::vector<bool> scheduled(npasses, false);
+  while (sorted.size() < npasses) {
+    pass next = npasses;
+    for (pass p = 0u; p < npasses && next == npasses; ++p) {
+      if (!scheduled[p] && ndependencies[p] == 0u) next = p;
+    }
+    if (next == npasses) return NGF_ERROR_INVALID_OPERATION; // Cycle.
+    scheduled[next] = true;
+    sorted.push_back(next);
+    for (pass d : dependents[next]) --ndependencies[d];
+  }
+
+  // Walk the passes backwards, keeping the ones that write something that's
+  // still needed. A write that doesn't load the image's previous contents
+  // makes them unneeded for the passes before it.
+  std::vector<bool> needed(nresources, false);
+  needed[BACKBUFFER] = true;
+  for (resource r = 0u; r < nresources; ++r) {
+    if (resources_[r].output) needed[r] = true;
+  }
+  for (auto it = sorted.rbegin(); it != sorted.rend(); ++it) {
+    pass_data &pd = passes_[*it];
+    pd.alive = false;
+    pd.target = nullptr;
+    for (const attachment_use &w : pd.writes) {
+      if (needed[w.res]) pd.alive = true;
+    }
+    if (!pd.alive) continue;
+    for (const attachment_use &w : pd.writes) {
+      needed[w.res] = w.load_op == NGF_LOAD_OP_KEEP;
+    }
+    for (resource r : pd.reads) needed[r] = true;
+  }
+  order_.clear();
+  for (pass p : sorted) {
+    if (passes_[p].alive) order_.push_back(p);
+  }
+
+  // Find where each image's contents live.
+  std::vector<bool> used(nresources, false);
+  for (resource_data &rd : resources_) {
+    rd.sampled = rd.output;
+    rd.image = nullptr;
+  }
+  for (uint32_t i = 0u; i < (uint32_t)order_.size(); ++i) {
+    const pass_data &pd = passes_[order_[i]];
+    auto use = [&](resource r) {
+      resource_data &rd = resources_[r];
+      if (!used[r]) rd.first_use = i;
+      used[r] = true;
+      rd.last_use = rd.output ? END_OF_FRAME : i;
+    };
+    for (resource r : pd.reads) {
+      use(r);
+      resources_[r].sampled = true;
+    }
+    for (const attachment_use &w : pd.writes) use(w.res);
+  }
+  used[BACKBUFFER] = false;
+  for (resource r = 0u; r < nresources; ++r) {
+    if (!used[r]) resources_[r].first_use = END_OF_FRAME;
+  }
+
+  ngf_error err = assign_backing_images();
+  if (err == NGF_ERROR_OK) err = create_render_targets();
+  if (err != NGF_ERROR_OK) return err;
+
+  stats_.passes = npasses;
+  stats_.culled_passes = npasses - (uint32_t)order_.size();
+  compiled_ = true;
+  return NGF_ERROR_OK;
+}
+
+ngf_error render_graph::assign_backing_images() {
+  for (std::unique_ptr<backing_image> &b : backing_images_) {
+    b->assigned = false;
+    b->busy_until = 0u;
+  }
+
+  // Hand out backing images in order of first use, reusing any with a
+  // matching description whose current user is done with it.
+  std::vector<resource> live;
+  for (resource r = 1u; r < (resource)resources_.size(); ++r) {
+    if (resources_[r].first_use != END_OF_FRAME) live.push_back(r);
+  }
+  std::stable_sort(live.begin(), live.end(), [this](resource a, resource b) {
+    return resources_[a].first_use < resources_[b].first_use;
+  });
+  stats_.images = (uint32_t)live.size();
+  stats_.image_bytes = 0u;
+  stats_.backing_images = 0u;
+  stats_.backing_bytes = 0u;
+  for (resource r : live) {
+    resource_data &rd = resources_[r];
+    const uint32_t usage = NGF_IMAGE_USAGE_ATTACHMENT |
+                           (rd.sampled ? NGF_IMAGE_USAGE_SAMPLE_FROM : 0u);
+    backing_image *match = nullptr;
+    for (std::unique_ptr<backing_image> &b : backing_images_) {
+      if (same_desc(b->desc, rd.desc) && b->usage == usage &&
+          (!b->assigned || b->busy_until < rd.first_use)) {
+        match = b.get();
+        break;
+      }
+    }
+    if (match == nullptr) {
+      std::unique_ptr<backing_image> b { new backing_image };
+      b->desc = rd.desc;
+      b->usage = usage;
+      b->assigned = false;
+      b->last_used_frame = frame_;
+      const ngf_image_info info {
+        NGF_IMAGE_TYPE_IMAGE_2D,
+        { rd.desc.width, rd.desc.height, 1u },
+        1u,
+        rd.desc.format,
+        rd.desc.sample_count,
+        usage
+      };
+      const ngf_error err = b->image.initialize(info);
+      if (err != NGF_ERROR_OK) return err;
+      match = b.get();
+      backing_images_.push_back(std::move(b));
+    }
+    if (!match->assigned) {
+      ++stats_.backing_images;
+      stats_.backing_bytes += image_bytes(match->desc);
+    }
+    match->assigned = true;
+    match->busy_until = rd.last_use;
+    rd.image = match->image.get();
+    stats_.image_bytes += image_bytes(rd.desc);
+  }
+  return NGF_ERROR_OK;
+}
+
+ngf_error render_graph::create_render_targets() {
+  for (uint32_t i = 0u; i < (uint32_t)order_.size(); ++i) {
+    pass_data &pd = passes_[order_[i]];
+    bool to_backbuffer = false;
+    std::vector<ngf_attachment> attachments;
+    for (const attachment_use &w : pd.writes) {
+      const resource_data &rd = resources_[w.res];
+      // Contents that nothing looks at later don't have to be stored.
+      const bool keep = w.res == BACKBUFFER || rd.last_use > i;
+      ngf_attachment a;
+      a.image_ref = { rd.image, 0u, 0u, NGF_CUBEMAP_FACE_POSITIVE_X };
+      a.type = w.type;
+      a.load_op = w.load_op;
+      a.store_op = keep ? NGF_STORE_OP_STORE : NGF_STORE_OP_DONTCARE;
+      a.clear = w.clear;
+      attachments.push_back(a);
+      to_backbuffer = to_backbuffer || w.res == BACKBUFFER;
+    }
+
+    // Render targets are cached by their attachments.
+    uint64_t key = hash_bytes(14695981039346656037ull, &to_backbuffer,
+                              sizeof(to_backbuffer));
+    for (const ngf_attachment &a : attachments) {
+      key = hash_bytes(key, &a.image_ref.image, sizeof(a.image_ref.image));
+      key = hash_bytes(key, &a.type, sizeof(a.type));
+      key = hash_bytes(key, &a.load_op, sizeof(a.load_op));
+      key = hash_bytes(key, &a.store_op, sizeof(a.store_op));
+      key = hash_bytes(key, &a.clear, sizeof(a.clear));
+    }
+    auto cached = targets_.find(key);
+    if (cached == targets_.end()) {
+      ngf_render_target rt = nullptr;
+      ngf_error err = NGF_ERROR_OK;
+      if (to_backbuffer) {
+        const ngf_attachment *color = nullptr, *depth = nullptr;
+        for (const ngf_attachment &a : attachments) {
+          if (a.type == NGF_ATTACHMENT_COLOR) color = &a;
+          else depth = &a;
+        }
+        assert(color != nullptr);
+        err = ngf_default_render_target(
+            color->load_op,
+            depth ? depth->load_op : NGF_LOAD_OP_DONTCARE,
+            NGF_STORE_OP_STORE,
+            NGF_STORE_OP_DONTCARE,
+            &color->clear,
+            depth ? &depth->clear : nullptr,
+            &rt);
+      } else {
+        const ngf_render_target_info info {
+          attachments.data(),
+          (uint32_t)attachments.size()
+        };
+        err = ngf_create_render_target(&info, &rt);
+      }
+      if (err != NGF_ERROR_OK) return err;
+      cached = targets_.emplace(key, cached_target {}).first;
+      cached->second.target.reset(rt);
+    }
+    cached->second.last_used_frame = frame_;
+    pd.target = cached->second.target.get();
+  }
+  return NGF_ERROR_OK;
+}
+
+void render_graph::execute(ngf_render_encoder enc,
+                           uint32_t           backbuffer_width,
+                           uint32_t           backbuffer_height) {
+  assert(compiled_);
+  for (pass p : order_) {
+    const pass_data &pd = passes_[p];
+    ngf_irect2d viewport { 0, 0, backbuffer_width, backbuffer_height };
+    const resource first_write = pd.writes.front().res;
+    if (first_write != BACKBUFFER) {
+      viewport.width = resources_[first_write].desc.width;
+      viewport.height = resources_[first_write].desc.height;
+    }
+    ngf_cmd_begin_pass(enc, pd.target);
+    ngf_cmd_viewport(enc, &viewport);
+    ngf_cmd_scissor(enc, &viewport);
+    if (pd.execute) pd.execute(enc, viewport);
+    ngf_cmd_end_pass(enc);
+  }
+
+  // Release render targets and backing images that the current graph
+  // doesn't use, once no frame in flight can be using them. Targets go
+  // first, since they refer to the images.
+  ++frame_;
+  const uint64_t frames_in_flight =
+      get_active_context_profile().capacity_hint + 1u;
+  for (auto it = targets_.begin(); it != targets_.end();) {
+    bool in_use = false;
+    for (pass p : order_) {
+      if (passes_[p].target == it->second.target.get()) in_use = true;
+    }
+    if (in_use) it->second.last_used_frame = frame_;
+    if (it->second.last_used_frame + frames_in_flight <= frame_) {
+      it = targets_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (std::unique_ptr<backing_image> &b : backing_images_) {
+    if (b->assigned) b->last_used_frame = frame_;
+  }
+  backing_images_.erase(
+      std::remove_if(backing_images_.begin(), backing_images_.end(),
+                     [&](const std::unique_ptr<backing_image> &b) {
+                       return b->last_used_frame + frames_in_flight <=
+                              frame_;
+                     }),
+      backing_images_.end());
+}
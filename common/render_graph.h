@@ -0,0 +1,200 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <nicegraf.h>
+#include <nicegraf_wrappers.h>
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Schedules render passes from the resources they declare.
+//
+// Passes state which images they sample from and which ones they render to.
+// From that, compile() works out:
+//  - the order to run the passes in. A pass that samples from an image runs
+//    after every pass that renders to it, whatever the order the passes were
+//    added in. Passes that render to the same image run in the order they
+//    were added in;
+//  - which passes can be skipped, because nothing that ends up on screen or
+//    in an output image depends on them;
+//  - which images can share the same ngf_image. Images that the graph
+//    creates are transient: their contents only live from the first pass
+//    that uses them to the last one. Images with the same description and
+//    non-overlapping lifetimes are backed by the same ngf_image.
+//
+// The backing images and render targets are kept across compilations, so
+// the graph can be rebuilt whenever its structure changes. Ones that are no
+// longer needed are destroyed once no frame in flight can be using them.
+//
+// Usage:
+//  - call reset, then declare images and passes;
+//  - call compile, then create pipelines compatible with render_target(p);
+//  - every frame, call execute. Repeat the first two steps to change the
+//    graph.
+class render_graph {
+public:
+  using resource = uint32_t;
+  using pass = uint32_t;
+
+  // The default render target. Always present, and always considered needed.
+  static constexpr resource BACKBUFFER = 0u;
+
+  struct image_desc {
+    uint32_t         width;
+    uint32_t         height;
+    ngf_image_format format;
+    ngf_sample_count sample_count;
+  };
+
+  // Records a pass's commands. The pass's render target has already been
+  // begun; `viewport` covers its attachments.
+  using execute_fn =
+      std::function<void(ngf_render_encoder enc, const ngf_irect2d &viewport)>;
+
+  // Used by passes to declare the resources they access.
+  class pass_builder {
+  public:
+    // The pass samples from the image.
+    void read(resource r);
+
+    // The pass renders to the image. Only the backbuffer's color can be
+    // written together with the backbuffer. Loading the contents of a
+    // transient image that no earlier pass wrote to gives undefined results.
+    void write_color(resource               r,
+                     ngf_attachment_load_op load_op,
+                     const ngf_clear       &clear = ngf_clear {});
+    void write_depth(resource               r,
+                     ngf_attachment_load_op load_op,
+                     const ngf_clear       &clear = ngf_clear {});
+
+  private:
+    friend class render_graph;
+    pass_builder(render_graph &graph, pass p) : graph_(graph), pass_(p) {}
+
+    render_graph &graph_;
+    pass          pass_;
+  };
+
+  render_graph();
+
+  render_graph(const render_graph&) = delete;
+  render_graph& operator=(const render_graph&) = delete;
+
+  // Removes all passes and images. Backing images are kept for reuse.
+  void reset();
+
+  // Declares a transient image.
+  resource create_image(const char *name, const image_desc &desc);
+
+  // Marks an image whose contents are used after the graph has executed
+  // (e.g. shown in the UI). Its lifetime extends to the end of the frame, so
+  // no image used after it can share its memory.
+  void mark_output(resource r);
+
+  // Declares a pass. `setup` is called right away to declare the resources
+  // the pass uses.
+  pass add_pass(const char                              *name,
+                const std::function<void(pass_builder&)> &setup,
+                execute_fn                               execute);
+
+  // Orders and culls the passes, and assigns backing images and render
+  // targets to them. The context must be current.
+  ngf_error compile();
+
+  // Records all passes that weren't culled. Must be called once per frame.
+  void execute(ngf_render_encoder enc,
+               uint32_t           backbuffer_width,
+               uint32_t           backbuffer_height);
+
+  // Image backing the given resource after compilation, or null if no pass
+  // that wasn't culled uses it.
+  ngf_image image(resource r) const { return resources_[r].image; }
+
+  // Render target of the given pass after compilation, or null if the pass
+  // was culled.
+  ngf_render_target render_target(pass p) const { return passes_[p].target; }
+
+  bool is_culled(pass p) const { return !passes_[p].alive; }
+
+  struct stats {
+    uint32_t passes = 0u; // Passes declared.
+    uint32_t culled_passes = 0u;
+    uint32_t images = 0u; // Transient images used by remaining passes.
+    uint32_t backing_images = 0u; // ngf_images backing them.
+    size_t   image_bytes = 0u; // Memory the images would need on their own.
+    size_t   backing_bytes = 0u; // Memory the backing images need.
+  };
+  const stats& get_stats() const { return stats_; }
+
+private:
+  struct attachment_use {
+    resource               res;
+    ngf_attachment_type    type;
+    ngf_attachment_load_op load_op;
+    ngf_clear              clear;
+  };
+  struct pass_data {
+    std::string                 name;
+    std::vector<resource>       reads;
+    std::vector<attachment_use> writes;
+    execute_fn                  execute;
+    bool                        alive = false;
+    ngf_render_target           target = nullptr;
+  };
+  struct resource_data {
+    std::string name;
+    image_desc  desc;
+    bool        output = false;
+    bool        sampled = false;
+    uint32_t    first_use = 0u; // Positions in the execution order.
+    uint32_t    last_use = 0u;
+    ngf_image   image = nullptr;
+  };
+  struct backing_image {
+    image_desc desc;
+    uint32_t   usage;
+    ngf::image image;
+    uint32_t   busy_until; // Last position using it in the current order.
+    bool       assigned; // Whether the current graph uses it.
+    uint64_t   last_used_frame;
+  };
+  struct cached_target {
+    ngf::render_target target;
+    uint64_t           last_used_frame;
+  };
+
+  ngf_error assign_backing_images();
+  ngf_error create_render_targets();
+
+  std::vector<pass_data>     passes_;
+  std::vector<resource_data> resources_;
+  std::vector<pass>          order_; // Passes to execute, in order.
+  std::vector<std::unique_ptr<backing_image>> backing_images_;
+  std::unordered_map<uint64_t, cached_target> targets_; // By attachments.
+  stats                      stats_;
+  uint64_t                   frame_ = 0u;
+  bool                       compiled_ = false;
+};
@@ -0,0 +1,153 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <stdint.h>
+#include <thread>
+
+// A single-producer, single-consumer triple buffer. The producer always has
+// a slot of its own to write into, the consumer always has a slot of its
+// own to read from, and the third slot holds the most recently published
+// value. Neither side ever blocks or takes a lock.
+template <class T>
+class triple_buffer {
+public:
+  triple_buffer() = default;
+  explicit triple_buffer(const T &initial) {
+    for (T &s : slots_) s = initial;
+  }
+
+  // Producer side: the slot to write the next value into.
+  T& write_slot() { return slots_[back_]; }
+
+  // Producer side: makes the contents of the write slot the latest value.
+  void publish() {
+    const uint8_t old_middle =
+        middle_.exchange((uint8_t)(back_ | DIRTY_BIT),
+                         std::memory_order_acq_rel);
+    back_ = old_middle & INDEX_MASK;
+  }
+
+  // Consumer side: returns the latest published value. If nothing new has
+  // been published since the last call, returns the same value again.
+  const T& read() {
+    if (middle_.load(std::memory_order_relaxed) & DIRTY_BIT) {
+      const uint8_t old_middle =
+          middle_.exchange(front_, std::memory_order_acq_rel);
+      front_ = old_middle & INDEX_MASK;
+    }
+    return slots_[front_];
+  }
+
+private:
+  static constexpr uint8_t INDEX_MASK = 0x3u;
+  static constexpr uint8_t DIRTY_BIT = 0x4u;
+
+  T                    slots_[3];
+  uint8_t              back_ = 0u;  // Owned by the producer.
+  std::atomic<uint8_t> middle_ { 1u };
+  uint8_t              front_ = 2u; // Owned by the consumer.
+};
+
+// Runs a simulation on its own thread, ticking at a fixed rate. After each
+// tick the two most recent states are published through a triple buffer, so
+// the render thread can pick up the latest complete snapshot at any time
+// without locking and interpolate between the last two ticks to hide the
+// difference between the simulation rate and the frame rate.
+// The tick function runs on the simulation thread. Any inputs it reads from
+// the render thread (e.g. UI controls) have to be atomics or otherwise
+// synchronized.
+template <class State>
+class simulation_thread {
+public:
+  using tick_fn = std::function<void(State &state, float dt)>;
+
+  simulation_thread(float ticks_per_second, const State &initial, tick_fn tick)
+      : dt_(1.0f / ticks_per_second),
+        snapshots_(snapshot { initial, initial, clock::now() }),
+        tick_(std::move(tick)),
+        thread_([this, initial] { run(initial); }) {}
+
+  ~simulation_thread() {
+    stop_ = true;
+    thread_.join();
+  }
+
+  simulation_thread(const simulation_thread&) = delete;
+  simulation_thread& operator=(const simulation_thread&) = delete;
+
+  // Returns the state to present right now: `lerp(previous, current, t)`
+  // where `t` is how far the current time is past the latest tick, as a
+  // fraction of the tick duration. This shows the simulation one tick behind,
+  // in exchange for smooth motion. Must only be called from one thread.
+  template <class Lerp>
+  State sample(Lerp &&lerp) {
+    const snapshot &s = snapshots_.read();
+    const float since_tick =
+        std::chrono::duration<float>(clock::now() - s.tick_time).count();
+    float t = since_tick / dt_;
+    t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+    return lerp(s.previous, s.current, t);
+  }
+
+  // Duration of a single simulation step, in seconds.
+  float tick_duration() const { return dt_; }
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  struct snapshot {
+    State             previous;
+    State             current;
+    clock::time_point tick_time;
+  };
+
+  void run(State state) {
+    const auto tick_duration =
+        std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<float>(dt_));
+    clock::time_point next_tick = clock::now() + tick_duration;
+    while (!stop_) {
+      std::this_thread::sleep_until(next_tick);
+      const State previous = state;
+      tick_(state, dt_);
+      snapshot &s = snapshots_.write_slot();
+      s.previous = previous;
+      s.current = state;
+      s.tick_time = clock::now();
+      snapshots_.publish();
+      next_tick += tick_duration;
+      // Don't try to catch up after a long stall (e.g. a debugger break).
+      const clock::time_point now = clock::now();
+      if (next_tick < now) next_tick = now;
+    }
+  }
+
+  const float             dt_;
+  triple_buffer<snapshot> snapshots_;
+  tick_fn                 tick_;
+  std::atomic<bool>       stop_ { false };
+  std::thread             thread_;
+};
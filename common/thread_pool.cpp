@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+thread_pool::thread_pool(uint32_t nthreads,
+                         std::function<void()> thread_init) {
+  for (uint32_t i = 0u; i < nthreads; ++i) {
+    workers_.emplace_back([this, thread_init] { worker_main(thread_init); });
+  }
+}
+
+thread_pool::~thread_pool() {
+  {
+    std::lock_guard<std::mutex> lock(mut_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (std::thread &t : workers_) t.join();
+}
+
+std::future<void> thread_pool::enqueue(std::function<void()> job) {
+  std::packaged_task<void()> task(std::move(job));
+  std::future<void> result = task.get_future();
+  {
+    std::lock_guard<std::mutex> lock(mut_);
+    jobs_.emplace_back(std::move(task));
+  }
+  cv_.notify_one();
+  return result;
+}
+
+void thread_pool::parallel_for(uint32_t count,
+                               uint32_t batch_size,
+                               std::function<void(uint32_t, uint32_t)> fn) {
+  if (count == 0u) return;
+  // Shared with the helper jobs, which may only start running after the
+  // call has returned. Those find no batches left and exit without touching
+  // `fn`.
+  struct shared_state {
+    std::function<void(uint32_t, uint32_t)> fn;
+    uint32_t                count;
+    uint32_t                batch_size;
+    uint32_t                nbatches;
+    std::atomic<uint32_t>   next_batch { 0u };
+    std::atomic<uint32_t>   done_batches { 0u };
+    std::mutex              mut;
+    std::condition_variable cv;
+  };
+  auto state = std::make_shared<shared_state>();
+  state->fn = std::move(fn);
+  state->count = count;
+  state->batch_size = std::max(batch_size, 1u);
+  state->nbatches =
+      (count + state->batch_size - 1u) / state->batch_size;
+  auto run_batches = [](shared_state &s) {
+    for (;;) {
+      const uint32_t b = s.next_batch.fetch_add(1u);
+      if (b >= s.nbatches) return;
+      const uint32_t begin = b * s.batch_size;
+      s.fn(begin, std::min(begin + s.batch_size, s.count));
+      if (s.done_batches.fetch_add(1u) + 1u == s.nbatches) {
+        std::lock_guard<std::mutex> lock(s.mut);
+        s.cv.notify_all();
+      }
+    }
+  };
+  const uint32_t nhelpers = std::min(size(), state->nbatches - 1u);
+  for (uint32_t i = 0u; i < nhelpers; ++i) {
+    enqueue([state, run_batches] { run_batches(*state); });
+  }
+  run_batches(*state);
+  std::unique_lock<std::mutex> lock(state->mut);
+  state->cv.wait(lock, [&state] {
+    return state->done_batches.load() == state->nbatches;
+  });
+}
+
+void thread_pool::worker_main(const std::function<void()> &thread_init) {
+  if (thread_init) thread_init();
+  for (;;) {
+    std::packaged_task<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mut_);
+      cv_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+      if (jobs_.empty()) return;
+      task = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+    task();
+  }
+}
@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that execute jobs in FIFO order.
+class thread_pool {
+public:
+  // Starts `nthreads` workers. `thread_init`, if provided, runs once on each
+  // worker before it picks up any jobs (e.g. to make a nicegraf context
+  // current on it).
+  explicit thread_pool(uint32_t nthreads,
+                       std::function<void()> thread_init = nullptr);
+
+  // Waits for queued jobs to finish and joins the workers.
+  ~thread_pool();
+
+  thread_pool(const thread_pool&) = delete;
+  thread_pool& operator=(const thread_pool&) = delete;
+
+  // Queues a job for execution. The returned future becomes ready once the
+  // job has run.
+  std::future<void> enqueue(std::function<void()> job);
+
+  // Calls `fn(begin, end)` for consecutive ranges of at most `batch_size`
+  // indices covering [0, count), spreading the ranges over the workers and
+  // the calling thread, and returns once all of them have been processed.
+  // The calling thread keeps taking ranges itself, so this doesn't stall if
+  // the workers are busy with other jobs.
+  void parallel_for(uint32_t count,
+                    uint32_t batch_size,
+                    std::function<void(uint32_t, uint32_t)> fn);
+
+  // Number of worker threads.
+  uint32_t size() const { return (uint32_t)workers_.size(); }
+
+private:
+  void worker_main(const std::function<void()> &thread_init);
+
+  std::vector<std::thread>               workers_;
+  std::deque<std::packaged_task<void()>> jobs_;
+  std::mutex                             mut_;
+  std::condition_variable                cv_;
+  bool                                   stop_ = false;
+};
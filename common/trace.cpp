@@ -0,0 +1,217 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "trace.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Zones kept per thread. A frame records a few dozen at most, so this covers
+// the last several hundred frames.
+constexpr uint64_t zones_per_thread = 1u << 15u;
+
+// Slots are written and read concurrently, so their fields are atomic. All
+// accesses to them are relaxed; ordering comes from the counters in
+// thread_buffer.
+struct zone_slot {
+  std::atomic<const char*> name;
+  std::atomic<uint64_t>    begin_ns;
+  std::atomic<uint64_t>    end_ns;
+};
+
+struct thread_buffer {
+  uint32_t    tid = 0u;
+  std::string name; // Guarded by the registry mutex.
+  bool        in_use = false; // Guarded by the registry mutex.
+  // Zones whose writing has started, and zones that have been fully written.
+  // Only the owning thread modifies these.
+  std::atomic<uint64_t> nstarted;
+  std::atomic<uint64_t> nwritten;
+  zone_slot             zones[zones_per_thread];
+};
+
+// Buffers of all threads that have recorded anything. When a thread exits,
+// its buffer is kept, so that its zones still make it into the trace, and is
+// handed to the next thread that needs one. That thread continues the ring
+// under the same tid, overwriting the old zones as it goes. There are never
+// more buffers than threads that were recording at the same time.
+struct registry {
+  std::mutex                                  mut;
+  std::vector<std::unique_ptr<thread_buffer>> buffers;
+};
+
+registry& get_registry() {
+  static registry r;
+  return r;
+}
+
+// The calling thread's buffer. Released when the thread exits.
+struct buffer_owner {
+  thread_buffer *buffer = nullptr;
+
+  ~buffer_owner() {
+    if (buffer == nullptr) return;
+    std::lock_guard<std::mutex> lock(get_registry().mut);
+    buffer->in_use = false;
+    buffer = nullptr;
+  }
+};
+
+thread_local buffer_owner this_thread_buffer;
+
+thread_buffer& get_this_thread_buffer() {
+  if (this_thread_buffer.buffer == nullptr) {
+    registry &r = get_registry();
+    std::lock_guard<std::mutex> lock(r.mut);
+    for (const std::unique_ptr<thread_buffer> &b : r.buffers) {
+      if (!b->in_use) {
+        b->in_use = true;
+        b->name.clear();
+        this_thread_buffer.buffer = b.get();
+        return *b;
+      }
+    }
+    // Value-initialized, so that the counters start at zero.
+    std::unique_ptr<thread_buffer> b { new thread_buffer() };
+    b->tid = (uint32_t)r.buffers.size() + 1u;
+    b->in_use = true;
+    this_thread_buffer.buffer = b.get();
+    r.buffers.emplace_back(std::move(b));
+  }
+  return *this_thread_buffer.buffer;
+}
+
+const std::chrono::steady_clock::time_point epoch =
+    std::chrono::steady_clock::now();
+
+// Writes a string as a JSON string literal.
+void write_json_string(FILE *f, const char *s) {
+  fputc('"', f);
+  for (; *s != '\0'; ++s) {
+    const unsigned char c = (unsigned char)*s;
+    if (c == '"' || c == '\\') {
+      fputc('\\', f);
+      fputc(c, f);
+    } else if (c < 0x20u) {
+      fprintf(f, "\\u%04x", c);
+    } else {
+      fputc(c, f);
+    }
+  }
+  fputc('"', f);
+}
+
+}  // namespace
+
+uint64_t trace_timestamp() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - epoch).count();
+}
+
+void trace_record_zone(const char *name, uint64_t begin_ns, uint64_t end_ns) {
+  thread_buffer &b = get_this_thread_buffer();
+  const uint64_t i = b.nwritten.load(std::memory_order_relaxed);
+  // Let readers know that the slot is about to change before changing it.
+  b.nstarted.store(i + 1u, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  zone_slot &slot = b.zones[i % zones_per_thread];
+  slot.name.store(name, std::memory_order_relaxed);
+  slot.begin_ns.store(begin_ns, std::memory_order_relaxed);
+  slot.end_ns.store(end_ns, std::memory_order_relaxed);
+  b.nwritten.store(i + 1u, std::memory_order_release);
+}
+
+void trace_set_thread_name(const char *name) {
+  thread_buffer &b = get_this_thread_buffer();
+  std::lock_guard<std::mutex> lock(get_registry().mut);
+  b.name = name;
+}
+
+int64_t trace_write_json(const char *path) {
+  FILE *f = fopen(path, "wb");
+  if (f == nullptr) return -1;
+  struct zone {
+    const char *name;
+    uint64_t    begin_ns;
+    uint64_t    end_ns;
+  };
+  std::vector<zone> zones;
+  int64_t nwritten = 0;
+  bool first_event = true;
+  fputs("{\"traceEvents\":[", f);
+  registry &r = get_registry();
+  // Buffers are only ever added, so holding the lock keeps them in place.
+  std::lock_guard<std::mutex> lock(r.mut);
+  for (const std::unique_ptr<thread_buffer> &b : r.buffers) {
+    if (!b->name.empty()) {
+      fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                 "\"tid\":%u,\"args\":{\"name\":",
+              first_event ? "" : ",", b->tid);
+      write_json_string(f, b->name.c_str());
+      fputs("}}", f);
+      first_event = false;
+    }
+
+    // Copy the zones out, then drop the ones whose slots may have been
+    // overwritten in the meantime.
+    const uint64_t end = b->nwritten.load(std::memory_order_acquire);
+    const uint64_t begin =
+        end > zones_per_thread ? end - zones_per_thread : 0u;
+    zones.clear();
+    for (uint64_t i = begin; i < end; ++i) {
+      const zone_slot &slot = b->zones[i % zones_per_thread];
+      zones.push_back(zone {
+        slot.name.load(std::memory_order_relaxed),
+        slot.begin_ns.load(std::memory_order_relaxed),
+        slot.end_ns.load(std::memory_order_relaxed) });
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t started = b->nstarted.load(std::memory_order_relaxed);
+    const uint64_t first_intact =
+        started > zones_per_thread ? started - zones_per_thread : 0u;
+    const size_t nskipped =
+        first_intact > begin ? (size_t)(first_intact - begin) : 0u;
+
+    for (size_t i = nskipped; i < zones.size(); ++i) {
+      const zone &z = zones[i];
+      fprintf(f, "%s\n{\"name\":", first_event ? "" : ",");
+      write_json_string(f, z.name);
+      // Timestamps are in microseconds.
+      fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                 "\"ts\":%.3f,\"dur\":%.3f}",
+              b->tid,
+              (double)z.begin_ns / 1000.0,
+              (double)(z.end_ns - z.begin_ns) / 1000.0);
+      first_event = false;
+      ++nwritten;
+    }
+  }
+  fputs("\n],\"displayTimeUnit\":\"ms\"}\n", f);
+  const bool ok = fclose(f) == 0;
+  return ok ? nwritten : -1;
+}
@@ -0,0 +1,71 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// A minimal CPU tracer. Code marks regions of interest with NGF_SAMPLE_ZONE,
+// and the recorded zones can be saved in the Chrome trace event format, which
+// chrome://tracing and the Perfetto UI can open.
+//
+// Each thread records into its own fixed-size ring buffer, so recording takes
+// no locks. Once a buffer is full, the oldest zones of that thread are
+// overwritten. The buffer of a thread that has exited is reused by the next
+// new thread that records a zone.
+
+// Records a zone covering the rest of the enclosing scope. `name` must be a
+// string that outlives the tracer, e.g. a literal.
+#define NGF_SAMPLE_ZONE(name) \
+  trace_zone NGF_SAMPLE_ZONE_CONCAT(ngf_sample_zone_, __LINE__) { name }
+#define NGF_SAMPLE_ZONE_CONCAT(a, b) NGF_SAMPLE_ZONE_CONCAT_IMPL(a, b)
+#define NGF_SAMPLE_ZONE_CONCAT_IMPL(a, b) a##b
+
+// Nanoseconds since the tracer's epoch.
+uint64_t trace_timestamp();
+
+// Records a zone on the calling thread's buffer.
+void trace_record_zone(const char *name, uint64_t begin_ns, uint64_t end_ns);
+
+// Sets the name under which the calling thread's zones are shown. `name` is
+// copied.
+void trace_set_thread_name(const char *name);
+
+// Writes the zones recorded so far, on all threads, to a JSON file. Safe to
+// call while other threads are recording; zones that get overwritten while
+// the file is written are left out. Returns the number of zones written, or
+// -1 if the file couldn't be opened.
+int64_t trace_write_json(const char *path);
+
+// Measures the lifetime of an object; see NGF_SAMPLE_ZONE.
+class trace_zone {
+public:
+  explicit trace_zone(const char *name) :
+      name_(name), begin_ns_(trace_timestamp()) {}
+  ~trace_zone() { trace_record_zone(name_, begin_ns_, trace_timestamp()); }
+  trace_zone(const trace_zone&) = delete;
+  trace_zone& operator=(const trace_zone&) = delete;
+
+private:
+  const char *name_;
+  uint64_t    begin_ns_;
+};
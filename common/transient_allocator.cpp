@@ -0,0 +1,222 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "transient_allocator.h"
+#include <assert.h>
+
+// Buffer sizes are kept multiples of this.
+static constexpr size_t buffer_size_granularity = 256u;
+
+static size_t round_up(size_t size, size_t alignment) {
+  return (size + alignment - 1u) & ~(alignment - 1u);
+}
+
+ngf_error transient_allocator::initialize(uint32_t nframes,
+                                          size_t   uniform_bytes_per_frame,
+                                          size_t   attrib_bytes_per_frame,
+                                          size_t   index_bytes_per_frame) {
+  assert(nframes > 0u);
+  current_frame_ = nframes - 1u;
+  uniform_region_.capacity =
+      round_up(uniform_bytes_per_frame, buffer_size_granularity);
+  attrib_region_.capacity =
+      round_up(attrib_bytes_per_frame, buffer_size_granularity);
+  index_region_.capacity =
+      round_up(index_bytes_per_frame, buffer_size_granularity);
+
+  // Create every frame's buffers up front, so that the first few frames
+  // don't have to.
+  frames_ = std::vector<frame_buffers>(nframes);
+  for (frame_buffers &f : frames_) {
+    const ngf_error err = create_frame_buffers(f);
+    if (err != NGF_ERROR_OK) return err;
+  }
+  return NGF_ERROR_OK;
+}
+
+ngf_error transient_allocator::create_frame_buffers(frame_buffers &f) {
+  ngf_error err = NGF_ERROR_OK;
+  if (f.uniform_size < uniform_region_.capacity) {
+    const ngf_uniform_buffer_info uniform_info {
+      uniform_region_.capacity,
+      NGF_BUFFER_STORAGE_HOST_WRITEABLE,
+      0u
+    };
+    err = f.uniform_buffer.initialize(uniform_info);
+    if (err != NGF_ERROR_OK) return err;
+    f.uniform_size = uniform_region_.capacity;
+  }
+  if (f.attrib_size < attrib_region_.capacity) {
+    const ngf_attrib_buffer_info attrib_info {
+      attrib_region_.capacity,
+      NGF_BUFFER_STORAGE_HOST_WRITEABLE,
+      0u
+    };
+    err = f.attrib_buffer.initialize(attrib_info);
+    if (err != NGF_ERROR_OK) return err;
+    f.attrib_size = attrib_region_.capacity;
+  }
+  if (f.index_size < index_region_.capacity) {
+    const ngf_index_buffer_info index_info {
+      index_region_.capacity,
+      NGF_BUFFER_STORAGE_HOST_WRITEABLE,
+      0u
+    };
+    err = f.index_buffer.initialize(index_info);
+    if (err != NGF_ERROR_OK) return err;
+    f.index_size = index_region_.capacity;
+  }
+  return err;
+}
+
+void transient_allocator::destroy() {
+  frames_.clear();
+  for (region_state *r : { &uniform_region_, &attrib_region_,
+                           &index_region_ }) {
+    r->capacity = 0u;
+    r->used = 0u;
+    r->requested = 0u;
+    r->mapped = nullptr;
+  }
+}
+
+void transient_allocator::begin_frame() {
+  current_frame_ = (current_frame_ + 1u) % (uint32_t)frames_.size();
+  frame_buffers &f = frames_[current_frame_];
+
+  // The GPU is done with this frame's buffers, so they can be replaced with
+  // bigger ones if the demand has grown since they were created.
+  const ngf_error err = create_frame_buffers(f);
+  assert(err == NGF_ERROR_OK);
+
+  for (region_state *r : { &uniform_region_, &attrib_region_,
+                           &index_region_ }) {
+    r->used = 0u;
+    r->requested = 0u;
+  }
+  uniform_region_.mapped = (uint8_t*)ngf_uniform_buffer_map_range(
+      f.uniform_buffer.get(), 0u, f.uniform_size,
+      NGF_BUFFER_MAP_WRITE_BIT | NGF_BUFFER_MAP_DISCARD_BIT);
+  attrib_region_.mapped = (uint8_t*)ngf_attrib_buffer_map_range(
+      f.attrib_buffer.get(), 0u, f.attrib_size,
+      NGF_BUFFER_MAP_WRITE_BIT | NGF_BUFFER_MAP_DISCARD_BIT);
+  index_region_.mapped = (uint8_t*)ngf_index_buffer_map_range(
+      f.index_buffer.get(), 0u, f.index_size,
+      NGF_BUFFER_MAP_WRITE_BIT | NGF_BUFFER_MAP_DISCARD_BIT);
+  assert(uniform_region_.mapped && attrib_region_.mapped &&
+         index_region_.mapped);
+}
+
+void transient_allocator::end_frame() {
+  frame_buffers &f = frames_[current_frame_];
+  if (uniform_region_.used > 0u) {
+    ngf_uniform_buffer_flush_range(f.uniform_buffer.get(), 0u,
+                                   uniform_region_.used);
+  }
+  ngf_uniform_buffer_unmap(f.uniform_buffer.get());
+  if (attrib_region_.used > 0u) {
+    ngf_attrib_buffer_flush_range(f.attrib_buffer.get(), 0u,
+                                  attrib_region_.used);
+  }
+  ngf_attrib_buffer_unmap(f.attrib_buffer.get());
+  if (index_region_.used > 0u) {
+    ngf_index_buffer_flush_range(f.index_buffer.get(), 0u,
+                                 index_region_.used);
+  }
+  ngf_index_buffer_unmap(f.index_buffer.get());
+  uniform_region_.mapped = attrib_region_.mapped =
+      index_region_.mapped = nullptr;
+
+  grow(uniform_region_, UNIFORM_ALIGNMENT);
+  grow(attrib_region_, buffer_size_granularity);
+  grow(index_region_, buffer_size_granularity);
+}
+
+void transient_allocator::grow(region_state &r, size_t alignment) {
+  // Double the capacity until it covers everything that was asked for this
+  // frame. Buffers pick up the new capacity as their frames come around.
+  const size_t requested = r.requested.load(std::memory_order_relaxed);
+  while (r.capacity < requested) {
+    r.capacity = round_up(r.capacity * 2u + alignment,
+                          buffer_size_granularity);
+  }
+}
+
+void* transient_allocator::bump(region_state &r,
+                                size_t        size,
+                                size_t        alignment,
+                                size_t       *offset) {
+  assert(r.mapped != nullptr);
+  assert(alignment > 0u && (alignment & (alignment - 1u)) == 0u);
+  // Account for the worst-case alignment padding, so that growing to the
+  // requested size is always enough.
+  r.requested.fetch_add(size + alignment - 1u, std::memory_order_relaxed);
+  size_t used = r.used.load(std::memory_order_relaxed);
+  size_t start;
+  do {
+    start = round_up(used, alignment);
+    if (start + size > r.capacity) return nullptr;
+  } while (!r.used.compare_exchange_weak(used, start + size,
+                                         std::memory_order_relaxed));
+  *offset = start;
+  return r.mapped + start;
+}
+
+transient_allocation<ngf_uniform_buffer>
+transient_allocator::alloc_uniform(size_t size) {
+  transient_allocation<ngf_uniform_buffer> a {
+    frames_[current_frame_].uniform_buffer.get(), 0u, size, nullptr
+  };
+  a.ptr = bump(uniform_region_, size, UNIFORM_ALIGNMENT, &a.offset);
+  return a;
+}
+
+transient_allocation<ngf_attrib_buffer>
+transient_allocator::alloc_attrib(size_t size, size_t alignment) {
+  transient_allocation<ngf_attrib_buffer> a {
+    frames_[current_frame_].attrib_buffer.get(), 0u, size, nullptr
+  };
+  a.ptr = bump(attrib_region_, size, alignment, &a.offset);
+  return a;
+}
+
+transient_allocation<ngf_index_buffer>
+transient_allocator::alloc_index(size_t size, size_t alignment) {
+  transient_allocation<ngf_index_buffer> a {
+    frames_[current_frame_].index_buffer.get(), 0u, size, nullptr
+  };
+  a.ptr = bump(index_region_, size, alignment, &a.offset);
+  return a;
+}
+
+ngf_resource_bind_op transient_allocator::bind_op(
+    const transient_allocation<ngf_uniform_buffer> &a,
+    uint32_t set,
+    uint32_t binding) {
+  ngf_resource_bind_op op;
+  op.type = NGF_DESCRIPTOR_UNIFORM_BUFFER;
+  op.target_set = set;
+  op.target_binding = binding;
+  op.info.uniform_buffer.buffer = a.buffer;
+  op.info.uniform_buffer.offset = a.offset;
+  op.info.uniform_buffer.range = a.size;
+  return op;
+}
@@ -0,0 +1,141 @@
+/**
+ * Copyright (c) 2021 nicegraf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <nicegraf.h>
+#include <nicegraf_wrappers.h>
+#include <assert.h>
+#include <atomic>
+#include <string.h>
+#include <vector>
+
+// A sub-allocation of transient memory. `ptr` points to host memory that
+// will end up at `offset` within `buffer`. A null `ptr` indicates that the
+// allocation could not be satisfied.
+template <class BufferT>
+struct transient_allocation {
+  BufferT buffer;
+  size_t  offset;
+  size_t  size;
+  void   *ptr;
+};
+
+// A linear allocator for data that only lives for a single frame (uniforms,
+// dynamic geometry). Each frame in flight has its own set of persistent
+// host-visible buffers, one per kind of data. Allocations are bumped out of
+// the current frame's buffers, which are reset wholesale when the allocator
+// comes back around to them.
+// Allocations that don't fit fail, but the demand is remembered and the
+// capacity grows geometrically to cover it. A frame's buffers are only
+// recreated at the start of that frame, when the GPU is done with them, so
+// once the demand settles no more buffers get created.
+// Allocation is thread-safe; begin_frame and end_frame are not and must not
+// overlap with allocations.
+class transient_allocator {
+public:
+  // Minimum alignment for uniform buffer sub-allocations. This is the
+  // largest value of minUniformBufferOffsetAlignment reported by the drivers
+  // that nicegraf targets.
+  static constexpr size_t UNIFORM_ALIGNMENT = 256u;
+
+  // Creates the backing buffers. Sizes are the initial per-frame capacities.
+  ngf_error initialize(uint32_t nframes,
+                       size_t   uniform_bytes_per_frame,
+                       size_t   attrib_bytes_per_frame,
+                       size_t   index_bytes_per_frame);
+
+  // Releases the backing buffers.
+  void destroy();
+
+  // Moves on to the next frame's buffers, growing them if needed, and maps
+  // them. All allocations made during the previous use of those buffers
+  // become invalid.
+  void begin_frame();
+
+  // Flushes and unmaps the current frame's buffers. Must be called before
+  // the frame's command buffers are submitted.
+  void end_frame();
+
+  // Allocate memory from the current frame's buffers. Uniform allocations
+  // are aligned to UNIFORM_ALIGNMENT.
+  transient_allocation<ngf_uniform_buffer> alloc_uniform(size_t size);
+  transient_allocation<ngf_attrib_buffer>  alloc_attrib(size_t size,
+                                                        size_t alignment);
+  transient_allocation<ngf_index_buffer>   alloc_index(size_t size,
+                                                       size_t alignment);
+
+  // Copies the given value into transient uniform memory and returns an op
+  // that binds it to the given set and binding.
+  template <class T>
+  ngf_resource_bind_op upload_uniform(const T &data,
+                                      uint32_t set,
+                                      uint32_t binding) {
+    const transient_allocation<ngf_uniform_buffer> a =
+        alloc_uniform(sizeof(T));
+    assert(a.ptr != nullptr);
+    memcpy(a.ptr, &data, sizeof(T));
+    return bind_op(a, set, binding);
+  }
+
+  // Returns an op that binds the given uniform allocation.
+  static ngf_resource_bind_op bind_op(
+      const transient_allocation<ngf_uniform_buffer> &a,
+      uint32_t set,
+      uint32_t binding);
+
+  // Current per-frame capacities, in bytes.
+  size_t uniform_capacity() const { return uniform_region_.capacity; }
+  size_t attrib_capacity() const { return attrib_region_.capacity; }
+  size_t index_capacity() const { return index_region_.capacity; }
+
+private:
+  // Allocation state for one kind of data.
+  struct region_state {
+    size_t              capacity = 0u; // Size new buffers are created with.
+    std::atomic<size_t> used { 0u };   // Bytes handed out this frame.
+    std::atomic<size_t> requested { 0u }; // Bytes asked for this frame,
+                                          // including failed requests.
+    uint8_t            *mapped = nullptr;
+  };
+
+  // Buffers owned by a single frame in flight, and their sizes.
+  struct frame_buffers {
+    ngf::uniform_buffer uniform_buffer;
+    ngf::attrib_buffer  attrib_buffer;
+    ngf::index_buffer   index_buffer;
+    size_t              uniform_size = 0u;
+    size_t              attrib_size = 0u;
+    size_t              index_size = 0u;
+  };
+
+  // Recreates the given frame's buffers that are smaller than the current
+  // capacities.
+  ngf_error create_frame_buffers(frame_buffers &f);
+  void* bump(region_state &r, size_t size, size_t alignment, size_t *offset);
+  static void grow(region_state &r, size_t alignment);
+
+  std::vector<frame_buffers> frames_;
+  region_state               uniform_region_;
+  region_state               attrib_region_;
+  region_state               index_region_;
+  uint32_t                   current_frame_ = 0u;
+};
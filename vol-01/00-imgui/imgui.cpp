@@ -18,6 +18,7 @@ SOFTWARE.
 */
 
 #include "common.h"
+#include "imgui_ngf_backend.h"
 #include <nicegraf.h>
 #include <nicegraf_wrappers.h>
 #include <imgui.h>
@@ -27,8 +28,18 @@ SOFTWARE.
 struct app_state {
   ngf::render_target default_rt;
   ngf::cmd_buffer cmd_buf;
+  int stress_widgets = 0; // Number of widgets in the synthetic UI.
+  bool show_extra_glyphs = false; // Show text outside of Latin-1.
+  // Stats shown in the UI, and when they were last updated.
+  ngf_imgui::frame_stats shown_stats;
+  float shown_frame_ms = 0.0f;
+  double shown_stats_time = -1.0;
 };
 
+// The stats are only updated this often. If they changed on every frame, so
+// would the UI, and it would never get replayed.
+constexpr double stats_refresh_seconds = 0.5;
+
 // Called upon application initialization.
 init_result on_initialized(uintptr_t native_handle,
                            uint32_t initial_width,
@@ -44,8 +55,8 @@ init_result on_initialized(uintptr_t native_handle,
   ngf_swapchain_info swapchain_info = {
     NGF_IMAGE_FORMAT_BGRA8, // color format
     NGF_IMAGE_FORMAT_UNDEFINED, // depth format (none)
-    NGF_SAMPLE_COUNT_8, // number of MSAA samples
-    2u, // swapchain capacity hint
+    get_active_context_profile().sample_count, // number of MSAA samples
+    get_active_context_profile().capacity_hint, // swapchain capacity hint
     initial_width, // swapchain image width
     initial_height, // swapchain image height
     native_handle,
@@ -95,12 +106,59 @@ void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token fra
   ngf_cmd_end_pass(enc);
   ngf_render_encoder_end(enc);
   ngf_cmd_buffer b = cmd_buf.get();
-  ngf_submit_cmd_buffers(1u, &b);
+  enqueue_cmd_buffer(b);
 }
 
 // Called every time the application has to draw an ImGUI overlay.
-void on_ui(void*) {
+void on_ui(void *userdata) {
+  app_state *state = (app_state*)userdata;
   ImGui::ShowDemoWindow();
+
+  // A large synthetic UI, for measuring the cost of getting UI geometry to
+  // the GPU.
+  const double now = ImGui::GetTime();
+  if (state->shown_stats_time < 0.0 ||
+      now - state->shown_stats_time >= stats_refresh_seconds) {
+    const ngf_imgui *ui = get_ui_backend();
+    state->shown_stats =
+        ui != nullptr ? ui->last_frame_stats() : ngf_imgui::frame_stats {};
+    state->shown_frame_ms = 1000.0f / ImGui::GetIO().Framerate;
+    state->shown_stats_time = now;
+  }
+  const ngf_imgui::frame_stats &stats = state->shown_stats;
+  ImGui::Begin("UI Stress Test");
+  ImGui::SliderInt("widgets", &state->stress_widgets, 0, 20000);
+  ImGui::Text("vertices: %zu KB, indices: %zu KB",
+              stats.vertex_bytes / 1024u, stats.index_bytes / 1024u);
+  ImGui::Text("geometry write time: %.3f ms%s", stats.write_ms,
+              stats.used_fallback ? " (fallback buffers)" : "");
+  ImGui::Text("draw commands: %u, draws issued: %u, scissor changes: %u, "
+              "texture binds: %u", stats.imgui_cmds, stats.draws,
+              stats.scissor_changes, stats.texture_binds);
+  ImGui::Text("last frame: %s", stats.replayed ? "replayed"
+                                 : stats.reused_geometry ? "geometry reused"
+                                                         : "uploaded");
+  ImGui::Text("font atlas: %zu KB, uploaded last frame: %zu KB",
+              stats.font_texture_bytes / 1024u,
+              stats.font_upload_bytes / 1024u);
+  ImGui::Text("%.3f ms/frame", state->shown_frame_ms);
+  ImGui::Checkbox("non-Latin text", &state->show_extra_glyphs);
+  if (state->show_extra_glyphs) {
+    // The glyphs are added to the font atlas on demand.
+    const char *text = u8"\u041f\u0440\u0438\u0432\u0435\u0442, "
+                       u8"\u03b3\u03b5\u03b9\u03ac \u03c3\u03bf\u03c5";
+    request_ui_glyphs(text);
+    ImGui::Text("%s", text);
+  }
+  ImGui::Separator();
+  for (int i = 0; i < state->stress_widgets; ++i) {
+    ImGui::PushID(i);
+    ImGui::Button("button");
+    ImGui::SameLine();
+    ImGui::Text("synthetic widget #%d", i);
+    ImGui::PopID();
+  }
+  ImGui::End();
 }
 
 // Called when the app is about to close.
@@ -28,11 +28,27 @@ SOFTWARE.
 
 struct app_state {
   ngf::render_target default_rt;
-  ngf::shader_stage blit_vert_stage;
-  ngf::shader_stage frag_stage;
-  ngf::graphics_pipeline pipeline;
+  // The default render target is recreated whenever the window is resized.
+  // Pipelines are created against this one instead, which stays alive.
+  ngf::render_target pipeline_rt;
+  pipeline_objects pipe;
 };
 
+static ngf_error create_pipeline(ngf_render_target rt, pipeline_objects *p) {
+  // Initial pipeline configuration with OpenGL-style defaults.
+  ngf_util_graphics_pipeline_data pipeline_data;
+  ngf_util_create_default_graphics_pipeline_data(nullptr,
+                                                 &pipeline_data);
+  ngf_graphics_pipeline_info &pipe_info = pipeline_data.pipeline_info;
+  pipe_info.nshader_stages = 2u;
+  pipe_info.shader_stages[0] = p->vert_stage.get();
+  pipe_info.shader_stages[1] = p->frag_stage.get();
+  pipe_info.compatible_render_target = rt;
+  pipeline_data.multisample_info.sample_count =
+      get_active_context_profile().sample_count;
+  return p->pipeline.initialize(pipe_info);
+}
+
 // Called upon application initialization.
 init_result on_initialized(uintptr_t native_handle,
                            uint32_t initial_width,
@@ -43,8 +59,8 @@ init_result on_initialized(uintptr_t native_handle,
   ngf_swapchain_info swapchain_info = {
     NGF_IMAGE_FORMAT_BGRA8, // color format
     NGF_IMAGE_FORMAT_UNDEFINED, // depth format (none)
-    NGF_SAMPLE_COUNT_1, // number of MSAA samples.
-    3u, // swapchain capacity hint
+    get_active_context_profile().sample_count, // number of MSAA samples.
+    get_active_context_profile().capacity_hint, // swapchain capacity hint
     initial_width, // swapchain image width
     initial_height, // swapchain image height
     native_handle,
@@ -77,23 +93,18 @@ init_result on_initialized(uintptr_t native_handle,
   assert(err == NGF_ERROR_OK);
   state->default_rt = ngf::render_target(rt);
 
-  // Load shader stages.
-  state->blit_vert_stage =
-      load_shader_stage("fullscreen-triangle", "VSMain", NGF_STAGE_VERTEX);
-  state->frag_stage =
-      load_shader_stage("fullscreen-triangle", "PSMain", NGF_STAGE_FRAGMENT);
-
-  // Initial pipeline configuration with OpenGL-style defaults.
-  ngf_util_graphics_pipeline_data pipeline_data;
-  ngf_util_create_default_graphics_pipeline_data(nullptr,
-                                                 &pipeline_data);
-  ngf_graphics_pipeline_info &pipe_info = pipeline_data.pipeline_info;
-  pipe_info.nshader_stages = 2u;
-  pipe_info.shader_stages[0] = state->blit_vert_stage.get();
-  pipe_info.shader_stages[1] = state->frag_stage.get();
-  pipe_info.compatible_render_target = state->default_rt.get();
-  err = state->pipeline.initialize(pipe_info);
+  err = ngf_default_render_target(NGF_LOAD_OP_CLEAR, NGF_LOAD_OP_DONTCARE,
+                                  NGF_STORE_OP_STORE, NGF_STORE_OP_DONTCARE,
+                                  &clear, NULL, &rt);
   assert(err == NGF_ERROR_OK);
+  state->pipeline_rt = ngf::render_target(rt);
+
+  // Create the pipeline, and rebuild it when the shaders change on disk.
+  watch_pipeline(&state->pipe,
+                 { "fullscreen-triangle", "fullscreen-triangle" },
+                 [rt = state->pipeline_rt.get()](pipeline_objects *p) {
+                   return create_pipeline(rt, p);
+                 });
 
   return { std::move(nicegraf_context), state};
 }
@@ -118,21 +129,17 @@ void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token fra
     state->default_rt = ngf::render_target(rt);
   }
   ngf_irect2d viewport { 0, 0, w, h };
-  ngf_cmd_buffer cmd_buf = nullptr;
-  ngf_cmd_buffer_info cmd_info;
-  ngf_create_cmd_buffer(&cmd_info, &cmd_buf);
-  ngf_start_cmd_buffer(cmd_buf, frame_token);
+  ngf_cmd_buffer cmd_buf = acquire_cmd_buffer(frame_token);
   {
     ngf::render_encoder enc{ cmd_buf };
     ngf_cmd_begin_pass(enc, state->default_rt);
-    ngf_cmd_bind_gfx_pipeline(enc, state->pipeline);
+    ngf_cmd_bind_gfx_pipeline(enc, state->pipe.pipeline);
     ngf_cmd_viewport(enc, &viewport);
     ngf_cmd_scissor(enc, &viewport);
     ngf_cmd_draw(enc, false, 0u, 3u, 1u);
     ngf_cmd_end_pass(enc);
   }
-  ngf_submit_cmd_buffers(1u, &cmd_buf);
-  ngf_destroy_cmd_buffer(cmd_buf);
+  enqueue_cmd_buffer(cmd_buf);
 }
 
 // Called every time the application has to dra an ImGUI overlay.
@@ -18,21 +18,42 @@ SOFTWARE.
 */
 
 #include "common.h"
+#include "pipeline_variant_cache.h"
 #include <nicegraf.h>
 #include <nicegraf_util.h>
 #include <nicegraf_wrappers.h>
 #include <imgui.h>
 #include <assert.h>
+#include <math.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 
+// Values of the specialization constants.
+struct spec_values {
+  float red;
+  float green;
+};
+
 struct app_state {
   ngf::render_target default_rt;
   ngf::shader_stage blit_vert_stage;
   ngf::shader_stage frag_stage;
-  ngf::graphics_pipeline pipelines[2];
+  // Pipeline state shared by all variants. The cache refers to it, so it
+  // must outlive the cache.
+  ngf_util_graphics_pipeline_data pipeline_data;
+  pipeline_variant_cache variants { 16u };
+  uint32_t base_pipeline = 0u;
+  spec_values values { 1.0f, 1.0f };
+  bool animate = true;
 };
 
+// Constants are quantized, so that animating them produces a bounded number
+// of variants.
+static float quantize(float v) {
+  return roundf(v * 20.0f) / 20.0f;
+}
+
 // Called upon application initialization.
 init_result on_initialized(uintptr_t native_handle,
                            uint32_t initial_width,
@@ -65,69 +86,80 @@ init_result on_initialized(uintptr_t native_handle,
       load_shader_stage("spec-consts", "PSMain", NGF_STAGE_FRAGMENT);
 
   // Initial pipeline configuration with OpenGL-style defaults.
-  ngf_util_graphics_pipeline_data pipeline_data;
+  ngf_util_graphics_pipeline_data &pipeline_data = state->pipeline_data;
   ngf_util_create_default_graphics_pipeline_data(nullptr,
                                                  &pipeline_data);
   ngf_graphics_pipeline_info &pipe_info = pipeline_data.pipeline_info;
-  
-  // Construct the specialization entries.
-  ngf_specialization_info spec_info;
-  spec_info.nspecializations = 2u;
-  ngf_constant_specialization specs[] = {
-    {0u /*constant_id*/, 0u /*offset*/, NGF_TYPE_FLOAT /*type*/},
-    {1u /*constant_id*/, sizeof(float) /*offset*/, NGF_TYPE_FLOAT /*type*/},
-  };
-  float spec_data[2] = {1.0f, 1.0f};
-  spec_info.specializations = specs;
-  spec_info.value_buffer = spec_data;
-  pipe_info.spec_info = &spec_info;
   pipe_info.compatible_render_target = state->default_rt.get();
-  
-  // Configure the first pipeline.
   pipe_info.nshader_stages = 2u;
   pipe_info.shader_stages[0] = state->blit_vert_stage.get();
   pipe_info.shader_stages[1] = state->frag_stage.get();
-  pipeline_data.multisample_info.sample_count = NGF_SAMPLE_COUNT_8;
-  err = state->pipelines[0].initialize(pipe_info);
-  assert(err == NGF_ERROR_OK);
+  pipeline_data.multisample_info.sample_count =
+      get_active_context_profile().sample_count;
 
-  // Configure the second pipeline.
-  spec_data[0] = 0.5f;
-  spec_data[1] = 0.7f;
-  err = state->pipelines[1].initialize(pipe_info);
-  assert(err == NGF_ERROR_OK);
+  // Construct the specialization entries, and register the pipeline with
+  // the variant cache. The generic variant is the one with both constants
+  // set to 1.
+  ngf_constant_specialization specs[] = {
+    {0u /*constant_id*/, offsetof(spec_values, red) /*offset*/,
+     NGF_TYPE_FLOAT /*type*/},
+    {1u /*constant_id*/, offsetof(spec_values, green) /*offset*/,
+     NGF_TYPE_FLOAT /*type*/},
+  };
+  const spec_values generic_values { 1.0f, 1.0f };
+  state->base_pipeline =
+      state->variants.add_base(pipe_info, specs, 2u, sizeof(spec_values),
+                               &generic_values);
 
   return { std::move(ctx), state};
 }
 
 // Called every frame.
-void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token frame_token) {
-  static uint32_t frame = 1u;
-  static uint32_t pipe = 0u;
+void on_frame(uint32_t w, uint32_t h, float time, void *userdata,
+              ngf_frame_token frame_token) {
   app_state *state = (app_state*)userdata;
+  state->variants.update();
+  if (state->animate) {
+    state->values.red = 0.5f + 0.5f * sinf(time);
+    state->values.green = 0.5f + 0.5f * cosf(0.7f * time);
+  }
+  const spec_values values {
+    quantize(state->values.red), quantize(state->values.green)
+  };
+  // A variant that isn't ready yet is replaced by the generic one.
+  ngf_graphics_pipeline pipeline =
+      state->variants.get(state->base_pipeline, &values);
+
   ngf_irect2d viewport { 0, 0, w, h };
-  ngf_cmd_buffer cmd_buf = nullptr;
-  ngf_cmd_buffer_info cmd_info;
-  ngf_create_cmd_buffer(&cmd_info, &cmd_buf);
-  ngf_start_cmd_buffer(cmd_buf, frame_token);
+  ngf_cmd_buffer cmd_buf = acquire_cmd_buffer(frame_token);
   {
     ngf::render_encoder enc{ cmd_buf };
     ngf_cmd_begin_pass(enc, state->default_rt);
-    ngf_cmd_bind_gfx_pipeline(enc, state->pipelines[pipe]);
-    // Switch between pipelines every 120 frames.
-    frame = (frame + 1u) % 120u;
-    if (frame == 0u) pipe = (pipe + 1u) % 2u;
+    ngf_cmd_bind_gfx_pipeline(enc, pipeline);
     ngf_cmd_viewport(enc, &viewport);
     ngf_cmd_scissor(enc, &viewport);
     ngf_cmd_draw(enc, false, 0u, 3u, 1u);
     ngf_cmd_end_pass(enc);
   }
-  ngf_submit_cmd_buffers(1u, &cmd_buf);
-  ngf_destroy_cmd_buffer(cmd_buf);
+  enqueue_cmd_buffer(cmd_buf);
 }
 
 // Called every time the application has to dra an ImGUI overlay.
-void on_ui(void*) {
+void on_ui(void *userdata) {
+  app_state *state = (app_state*)userdata;
+  const pipeline_variant_cache::stats &stats = state->variants.get_stats();
+  ImGui::Begin("Specialization Constants", nullptr,
+               ImGuiWindowFlags_AlwaysAutoResize);
+  ImGui::Checkbox("animate", &state->animate);
+  ImGui::SliderFloat("red", &state->values.red, 0.0f, 1.0f);
+  ImGui::SliderFloat("green", &state->values.green, 0.0f, 1.0f);
+  ImGui::Text("variants: %u ready, %u pending, %u failed", stats.variants,
+              stats.pending, stats.failed);
+  ImGui::Text("hits: %llu, misses: %llu, evictions: %llu",
+              (unsigned long long)stats.hits,
+              (unsigned long long)stats.misses,
+              (unsigned long long)stats.evictions);
+  ImGui::End();
 }
 
 // Called when the app is about to close.
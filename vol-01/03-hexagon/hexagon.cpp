@@ -38,9 +38,7 @@ constexpr double TAU = 6.28318530718;
 
 struct app_state {
   ngf::render_target default_rt;
-  ngf::shader_stage blit_vert_stage;
-  ngf::shader_stage frag_stage;
-  ngf::graphics_pipeline pipeline;
+  pipeline_objects pipe;
   ngf::attrib_buffer vert_buffer_staging;
   ngf::attrib_buffer vert_buffer;
   bool vert_buffer_uploaded = false;
@@ -51,36 +49,7 @@ struct vertex_data {
   float color[3];
 };
 
-// Called upon application initialization.
-init_result on_initialized(uintptr_t native_handle,
-                           uint32_t initial_width,
-                           uint32_t initial_height) {
-  app_state *state = new app_state;
-
-  ngf::context ctx = create_default_context(native_handle,
-                                            initial_width, initial_height);
-
-  // Obtain the default render target.
-  ngf_clear clear;
-  clear.clear_color[0] = 0.0f;
-  clear.clear_color[1] = 0.0f;
-  clear.clear_color[2] = 0.0f;
-  clear.clear_color[3] = 0.0f;
-  ngf_render_target rt;
-  ngf_error err = ngf_default_render_target(NGF_LOAD_OP_CLEAR,
-                                            NGF_LOAD_OP_DONTCARE,
-                                            NGF_STORE_OP_STORE,
-                                            NGF_STORE_OP_DONTCARE,
-                                            &clear, NULL, &rt);
-  assert(err == NGF_ERROR_OK);
-  state->default_rt = ngf::render_target(rt);
-
-  // Load shader stages.
-  state->blit_vert_stage =
-      load_shader_stage("hexagon", "VSMain", NGF_STAGE_VERTEX);
-  state->frag_stage =
-      load_shader_stage("hexagon", "PSMain", NGF_STAGE_FRAGMENT);
-
+static ngf_error create_pipeline(ngf_render_target rt, pipeline_objects *p) {
   // Initial pipeline configuration with OpenGL-style defaults.
   ngf_util_graphics_pipeline_data pipeline_data;
   ngf_util_create_default_graphics_pipeline_data(nullptr,
@@ -90,9 +59,9 @@ init_result on_initialized(uintptr_t native_handle,
   // Pipeline configuration.
   // Shader stages.
   pipe_info.nshader_stages = 2u; 
-  pipe_info.shader_stages[0] = state->blit_vert_stage.get();
-  pipe_info.shader_stages[1] = state->frag_stage.get();
-  pipe_info.compatible_render_target = state->default_rt.get();
+  pipe_info.shader_stages[0] = p->vert_stage.get();
+  pipe_info.shader_stages[1] = p->frag_stage.get();
+  pipe_info.compatible_render_target = rt;
   
   // Vertex input.
   // First, attribute descriptions.
@@ -113,10 +82,41 @@ init_result on_initialized(uintptr_t native_handle,
   vert_info.vert_buf_bindings = &binding;
   
   // Enable multisampling for anti-aliasing.
-  pipeline_data.multisample_info.sample_count = NGF_SAMPLE_COUNT_8;
+  pipeline_data.multisample_info.sample_count =
+      get_active_context_profile().sample_count;
   // Done configuring, initialize the pipeline.
-  err = state->pipeline.initialize(pipe_info);
+  return p->pipeline.initialize(pipe_info);
+}
+
+// Called upon application initialization.
+init_result on_initialized(uintptr_t native_handle,
+                           uint32_t initial_width,
+                           uint32_t initial_height) {
+  app_state *state = new app_state;
+
+  ngf::context ctx = create_default_context(native_handle,
+                                            initial_width, initial_height);
+
+  // Obtain the default render target.
+  ngf_clear clear;
+  clear.clear_color[0] = 0.0f;
+  clear.clear_color[1] = 0.0f;
+  clear.clear_color[2] = 0.0f;
+  clear.clear_color[3] = 0.0f;
+  ngf_render_target rt;
+  ngf_error err = ngf_default_render_target(NGF_LOAD_OP_CLEAR,
+                                            NGF_LOAD_OP_DONTCARE,
+                                            NGF_STORE_OP_STORE,
+                                            NGF_STORE_OP_DONTCARE,
+                                            &clear, NULL, &rt);
   assert(err == NGF_ERROR_OK);
+  state->default_rt = ngf::render_target(rt);
+
+  // Create the pipeline, and rebuild it when the shaders change on disk.
+  watch_pipeline(&state->pipe, { "hexagon", "hexagon" },
+                 [rt = state->default_rt.get()](pipeline_objects *p) {
+                   return create_pipeline(rt, p);
+                 });
 
   return { std::move(ctx), state};
 }
@@ -125,10 +125,7 @@ init_result on_initialized(uintptr_t native_handle,
 void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token frame_token) {
   app_state *state = (app_state*)userdata;
   ngf_irect2d viewport { 0, 0, w, h };
-  ngf_cmd_buffer cmd_buf = nullptr;
-  ngf_cmd_buffer_info cmd_info;
-  ngf_create_cmd_buffer(&cmd_info, &cmd_buf);
-  ngf_start_cmd_buffer(cmd_buf, frame_token);
+  ngf_cmd_buffer cmd_buf = acquire_cmd_buffer(frame_token);
   if (state->vert_buffer_uploaded && state->vert_buffer_staging.get()) {
     state->vert_buffer_staging.reset(nullptr);
   } else if (!state->vert_buffer_uploaded &&
@@ -187,15 +184,14 @@ void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token fra
   {
     ngf::render_encoder renc{ cmd_buf };
     ngf_cmd_begin_pass(renc, state->default_rt);
-    ngf_cmd_bind_gfx_pipeline(renc, state->pipeline);
+    ngf_cmd_bind_gfx_pipeline(renc, state->pipe.pipeline);
     ngf_cmd_bind_attrib_buffer(renc, state->vert_buffer, 0u, 0u);
     ngf_cmd_viewport(renc, &viewport);
     ngf_cmd_scissor(renc, &viewport);
     ngf_cmd_draw(renc, false, 0u, 3u * 6u, 1u);
     ngf_cmd_end_pass(renc);
   }
-  ngf_submit_cmd_buffers(1u, &cmd_buf);
-  ngf_destroy_cmd_buffer(cmd_buf);
+  enqueue_cmd_buffer(cmd_buf);
 }
 
 // Called every time the application has to dra an ImGUI overlay.
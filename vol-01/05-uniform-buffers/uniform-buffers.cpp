@@ -41,12 +41,9 @@ struct uniform_data {
 
 struct app_state {
   ngf::render_target default_rt;
-  ngf::shader_stage blit_vert_stage;
-  ngf::shader_stage frag_stage;
-  ngf::graphics_pipeline pipeline;
+  pipeline_objects pipe;
   ngf::attrib_buffer vert_buffer;
   ngf::index_buffer index_buffer;
-  ngf::streamed_uniform<uniform_data> uniform_buffer;
   uniform_data udata;
 };
 
@@ -55,36 +52,7 @@ struct vertex_data {
   float color[3];
 };
 
-// Called upon application initialization.
-init_result on_initialized(uintptr_t native_handle,
-                           uint32_t initial_width,
-                           uint32_t initial_height) {
-  app_state *state = new app_state;
-
-  ngf::context ctx = create_default_context(native_handle,
-                                            initial_width, initial_height);
-
-  // Obtain the default render target.
-  ngf_clear clear;
-  clear.clear_color[0] = 0.0f;
-  clear.clear_color[1] = 0.0f;
-  clear.clear_color[2] = 0.0f;
-  clear.clear_color[3] = 0.0f;
-  ngf_render_target rt;
-  ngf_error err = ngf_default_render_target(NGF_LOAD_OP_CLEAR,
-                                            NGF_LOAD_OP_DONTCARE,
-                                            NGF_STORE_OP_STORE,
-                                            NGF_STORE_OP_DONTCARE,
-                                            &clear, NULL, &rt);
-  assert(err == NGF_ERROR_OK);
-  state->default_rt = ngf::render_target(rt);
-
-  // Load shader stages.
-  state->blit_vert_stage =
-      load_shader_stage("hexagon-animated", "VSMain", NGF_STAGE_VERTEX);
-  state->frag_stage =
-      load_shader_stage("hexagon", "PSMain", NGF_STAGE_FRAGMENT);
-
+static ngf_error create_pipeline(ngf_render_target rt, pipeline_objects *p) {
   // Initial pipeline configuration with OpenGL-style defaults.
   ngf_util_graphics_pipeline_data pipeline_data;
   ngf_util_create_default_graphics_pipeline_data(nullptr,
@@ -94,9 +62,9 @@ init_result on_initialized(uintptr_t native_handle,
   // Pipeline configuration.
   // Shader stages.
   pipe_info.nshader_stages = 2u; 
-  pipe_info.shader_stages[0] = state->blit_vert_stage.get();
-  pipe_info.shader_stages[1] = state->frag_stage.get();
-  pipe_info.compatible_render_target = state->default_rt.get();
+  pipe_info.shader_stages[0] = p->vert_stage.get();
+  pipe_info.shader_stages[1] = p->frag_stage.get();
+  pipe_info.compatible_render_target = rt;
   
   // Vertex input.
   // First, attribute descriptions.
@@ -116,16 +84,48 @@ init_result on_initialized(uintptr_t native_handle,
   binding.stride = sizeof(vertex_data);
   vert_info.vert_buf_bindings = &binding;
   // Enable multisampling for anti-aliasing.
-  pipeline_data.multisample_info.sample_count = NGF_SAMPLE_COUNT_8;
+  pipeline_data.multisample_info.sample_count =
+      get_active_context_profile().sample_count;
   // Configure a simple pipeline layout (1 set 2 descriptors).
   ngf_descriptor_info descs[1] {
     {NGF_DESCRIPTOR_UNIFORM_BUFFER, 0u, NGF_DESCRIPTOR_VERTEX_STAGE_BIT},
   };
-  err = ngf_util_create_simple_layout(descs, 1u, &pipeline_data.layout_info);
-  assert(err == NGF_ERROR_OK);
+  ngf_error err =
+      ngf_util_create_simple_layout(descs, 1u, &pipeline_data.layout_info);
+  if (err != NGF_ERROR_OK) return err;
   // Done configuring, initialize the pipeline.
-  err = state->pipeline.initialize(pipe_info);
+  return p->pipeline.initialize(pipe_info);
+}
+
+// Called upon application initialization.
+init_result on_initialized(uintptr_t native_handle,
+                           uint32_t initial_width,
+                           uint32_t initial_height) {
+  app_state *state = new app_state;
+
+  ngf::context ctx = create_default_context(native_handle,
+                                            initial_width, initial_height);
+
+  // Obtain the default render target.
+  ngf_clear clear;
+  clear.clear_color[0] = 0.0f;
+  clear.clear_color[1] = 0.0f;
+  clear.clear_color[2] = 0.0f;
+  clear.clear_color[3] = 0.0f;
+  ngf_render_target rt;
+  ngf_error err = ngf_default_render_target(NGF_LOAD_OP_CLEAR,
+                                            NGF_LOAD_OP_DONTCARE,
+                                            NGF_STORE_OP_STORE,
+                                            NGF_STORE_OP_DONTCARE,
+                                            &clear, NULL, &rt);
   assert(err == NGF_ERROR_OK);
+  state->default_rt = ngf::render_target(rt);
+
+  // Create the pipeline, and rebuild it when the shaders change on disk.
+  watch_pipeline(&state->pipe, { "hexagon-animated", "hexagon" },
+                 [rt = state->default_rt.get()](pipeline_objects *p) {
+                   return create_pipeline(rt, p);
+                 });
 
   // Populate vertex buffer with data.
   vertex_data vertices[7u] = {
@@ -181,12 +181,6 @@ init_result on_initialized(uintptr_t native_handle,
   ngf_index_buffer_flush_range(state->index_buffer, 0, sizeof(indices));
   ngf_index_buffer_unmap(state->index_buffer);
 
-  std::optional<ngf::streamed_uniform<uniform_data>> maybe_streamed_uniform;
-  std::tie(maybe_streamed_uniform, err) =
-      ngf::streamed_uniform<uniform_data>::create(3);
-  assert(err == NGF_ERROR_OK);
-  state->uniform_buffer = std::move(maybe_streamed_uniform.value());
-
   return { std::move(ctx), state};
 }
 
@@ -195,19 +189,16 @@ void on_frame(uint32_t w, uint32_t h, float time, void *userdata, ngf_frame_toke
   app_state *state = (app_state*)userdata;
   state->udata.time = time;
   state->udata.aspect_ratio = (float)w / (float)h;
-  state->uniform_buffer.write(state->udata);
+  // Uniform data changes every frame, so it goes into transient memory.
+  const ngf_resource_bind_op uniform_bind_op =
+      get_transient_allocator().upload_uniform(state->udata, 0, 0);
   ngf_irect2d viewport { 0, 0, w, h };
-  ngf_cmd_buffer cmd_buf = nullptr;
-  ngf_cmd_buffer_info cmd_info;
-  ngf_create_cmd_buffer(&cmd_info, &cmd_buf);
-  ngf_start_cmd_buffer(cmd_buf, frame_token);
+  ngf_cmd_buffer cmd_buf = acquire_cmd_buffer(frame_token);
   {
     ngf::render_encoder renc{ cmd_buf };
     ngf_cmd_begin_pass(renc, state->default_rt);
-    ngf_cmd_bind_gfx_pipeline(renc, state->pipeline);
-    ngf::cmd_bind_resources(
-      renc,
-      state->uniform_buffer.bind_op_at_current_offset(0, 0));
+    ngf_cmd_bind_gfx_pipeline(renc, state->pipe.pipeline);
+    ngf::cmd_bind_resources(renc, uniform_bind_op);
     ngf_cmd_bind_attrib_buffer(renc, state->vert_buffer, 0u, 0u);
     ngf_cmd_bind_index_buffer(renc, state->index_buffer, NGF_TYPE_UINT16);
     ngf_cmd_viewport(renc, &viewport);
@@ -215,8 +206,7 @@ void on_frame(uint32_t w, uint32_t h, float time, void *userdata, ngf_frame_toke
     ngf_cmd_draw(renc, true, 0u, 3u * 6u, 1u);
     ngf_cmd_end_pass(renc);
   }
-  ngf_submit_cmd_buffers(1u, &cmd_buf);
-  ngf_destroy_cmd_buffer(cmd_buf);
+  enqueue_cmd_buffer(cmd_buf);
 }
 
 // Called every time the application has to dra an ImGUI overlay.
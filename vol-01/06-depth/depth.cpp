@@ -14,14 +14,46 @@ struct triangle_data {
 
 struct app_state {
   ngf::render_target default_rt;
-  ngf::shader_stage blit_vert_stage;
-  ngf::shader_stage frag_stage;
-  ngf::graphics_pipeline pipeline;
+  pipeline_objects pipe;
   ngf::resource_dispose_queue discard_queue;
   ngf::uniform_buffer uniform_data[2];
   bool uniform_data_uploaded = false;
 };
 
+static ngf_error create_pipeline(ngf_render_target rt, pipeline_objects *p) {
+  // Initial pipeline configuration with OpenGL-style defaults.
+  ngf_util_graphics_pipeline_data pipeline_data;
+  ngf_util_create_default_graphics_pipeline_data(nullptr,
+                                                 &pipeline_data);
+  ngf_graphics_pipeline_info &pipe_info = pipeline_data.pipeline_info;
+  pipe_info.nshader_stages = 2u;
+  pipe_info.shader_stages[0] = p->vert_stage.get();
+  pipe_info.shader_stages[1] = p->frag_stage.get();
+  pipe_info.compatible_render_target = rt;
+  
+  // Set up depth test.
+  pipeline_data.depth_stencil_info.depth_test = true;
+  pipeline_data.depth_stencil_info.depth_compare = NGF_COMPARE_OP_LESS;
+  pipeline_data.depth_stencil_info.depth_write = true;
+
+  pipeline_data.multisample_info.sample_count =
+      get_active_context_profile().sample_count;
+
+  // Initialize the pipeline layout - we will have just one descriptor set
+  // with one binding for a uniform buffer.
+  ngf_descriptor_info desc_info {
+    NGF_DESCRIPTOR_UNIFORM_BUFFER,
+    0u,
+    NGF_DESCRIPTOR_VERTEX_STAGE_BIT | NGF_DESCRIPTOR_FRAGMENT_STAGE_BIT
+  };
+  ngf_error err = ngf_util_create_simple_layout(&desc_info, 1u,
+                                                &pipeline_data.layout_info);
+  if (err != NGF_ERROR_OK) return err;
+
+  // Create the pipeline!
+  return p->pipeline.initialize(pipe_info);
+}
+
 init_result on_initialized(uintptr_t native_handle,
                            uint32_t initial_width,
                            uint32_t initial_height) {
@@ -30,8 +62,8 @@ init_result on_initialized(uintptr_t native_handle,
   ngf_swapchain_info swapchain_info {
     NGF_IMAGE_FORMAT_BGRA8, // 8 bit per channel BGRA for color
     NGF_IMAGE_FORMAT_UNDEFINED,// NGF_IMAGE_FORMAT_DEPTH24_STENCIL8, // 24 bit depth, 8 bit stencil
-    8u, // 4x MSAA
-    2u, // swapchain capacity
+    get_active_context_profile().sample_count, // MSAA
+    get_active_context_profile().capacity_hint, // swapchain capacity
     initial_width,
     initial_height,
     native_handle,
@@ -68,41 +100,11 @@ init_result on_initialized(uintptr_t native_handle,
   assert(err == NGF_ERROR_OK);
   state->default_rt.reset(default_rt);
 
-  // Load shaders.
-  state->blit_vert_stage = load_shader_stage("depth", "VSMain", NGF_STAGE_VERTEX);
-  state->frag_stage = load_shader_stage("depth", "PSMain", NGF_STAGE_FRAGMENT);
-   
-  // Initial pipeline configuration with OpenGL-style defaults.
-  ngf_util_graphics_pipeline_data pipeline_data;
-  ngf_util_create_default_graphics_pipeline_data(nullptr,
-                                                 &pipeline_data);
-  ngf_graphics_pipeline_info &pipe_info = pipeline_data.pipeline_info;
-  pipe_info.nshader_stages = 2u;
-  pipe_info.shader_stages[0] = state->blit_vert_stage.get();
-  pipe_info.shader_stages[1] = state->frag_stage.get();
-  pipe_info.compatible_render_target = state->default_rt.get();
-  
-  // Set up depth test.
-  pipeline_data.depth_stencil_info.depth_test = true;
-  pipeline_data.depth_stencil_info.depth_compare = NGF_COMPARE_OP_LESS;
-  pipeline_data.depth_stencil_info.depth_write = true;
-
-  pipeline_data.multisample_info.sample_count = NGF_SAMPLE_COUNT_8;
-
-  // Initialize the pipeline layout - we will have just one descriptor set
-  // with one binding for a uniform buffer.
-  ngf_descriptor_info desc_info {
-    NGF_DESCRIPTOR_UNIFORM_BUFFER,
-    0u,
-    NGF_DESCRIPTOR_VERTEX_STAGE_BIT | NGF_DESCRIPTOR_FRAGMENT_STAGE_BIT
-  };
-  err = ngf_util_create_simple_layout(&desc_info, 1u,
-                                      &pipeline_data.layout_info);
-  assert(err == NGF_ERROR_OK);
-
-  // Create the pipeline!
-  err = state->pipeline.initialize(pipe_info);
-  assert(err == NGF_ERROR_OK); 
+  // Create the pipeline, and rebuild it when the shaders change on disk.
+  watch_pipeline(&state->pipe, { "depth", "depth" },
+                 [rt = state->default_rt.get()](pipeline_objects *p) {
+                   return create_pipeline(rt, p);
+                 });
 
   return {std::move(ctx), state};
  }
@@ -110,10 +112,7 @@ init_result on_initialized(uintptr_t native_handle,
 void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token frame_token) {
   auto state = (app_state*)userdata;
   ngf_irect2d viewport { 0, 0, w, h };
-  ngf_cmd_buffer cmd_buf = nullptr;
-  ngf_cmd_buffer_info cmd_info;
-  ngf_create_cmd_buffer(&cmd_info, &cmd_buf);
-  ngf_start_cmd_buffer(cmd_buf, frame_token);
+  ngf_cmd_buffer cmd_buf = acquire_cmd_buffer(frame_token);
   if (!state->uniform_data_uploaded) {
     // Initialize uniform buffers.
     ngf_uniform_buffer_info ubo_info {
@@ -150,7 +149,7 @@ void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token fra
   {
     ngf::render_encoder renc{ cmd_buf };
     ngf_cmd_begin_pass(renc, state->default_rt);
-    ngf_cmd_bind_gfx_pipeline(renc, state->pipeline);
+    ngf_cmd_bind_gfx_pipeline(renc, state->pipe.pipeline);
     ngf_cmd_viewport(renc, &viewport);
     ngf_cmd_scissor(renc, &viewport);
 
@@ -167,8 +166,7 @@ void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token fra
     }
     ngf_cmd_end_pass(renc);
   }
-  ngf_submit_cmd_buffers(1u, &cmd_buf);
-  ngf_destroy_cmd_buffer(cmd_buf);
+  enqueue_cmd_buffer(cmd_buf);
 }
 
 void on_ui(void*) {}
@@ -26,21 +26,51 @@
 #include <nicegraf_wrappers.h>
 #include <imgui.h>
 #include <assert.h>
+#include <memory>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 struct app_state {
   ngf::render_target default_rt;
-  ngf::shader_stage blit_vert_stage;
-  ngf::shader_stage frag_stage;
-  ngf::graphics_pipeline pipeline;
+  pipeline_objects pipe;
   ngf::image image;
   ngf::pixel_buffer pbuffer;
   ngf::sampler sampler;
+  ngf::resource_dispose_queue dispose_queue;
   bool pixel_data_uploaded = false;
 };
 
+static ngf_error create_pipeline(ngf_render_target rt, pipeline_objects *p) {
+  ngf_plmd* pipeline_metadata = try_load_pipeline_metadata("simple-texture");
+  if (pipeline_metadata == NULL) return NGF_ERROR_OBJECT_CREATION_FAILED;
+
+  // Initial pipeline configuration with OpenGL-style defaults.
+  ngf_util_graphics_pipeline_data pipeline_data;
+  ngf_util_create_default_graphics_pipeline_data(nullptr,
+                                                 &pipeline_data);
+  ngf_graphics_pipeline_info &pipe_info = pipeline_data.pipeline_info;
+  pipe_info.nshader_stages = 2u;
+  pipe_info.shader_stages[0] = p->vert_stage.get();
+  pipe_info.shader_stages[1] = p->frag_stage.get();
+  pipe_info.compatible_render_target = rt;
+  pipe_info.image_to_combined_map =
+      ngf_plmd_get_image_to_cis_map(pipeline_metadata);
+  pipe_info.sampler_to_combined_map =
+      ngf_plmd_get_sampler_to_cis_map(pipeline_metadata);
+  pipeline_data.multisample_info.sample_count =
+      get_active_context_profile().sample_count;
+
+  // Create a pipeline layout from the loaded metadata.
+  ngf_error err = ngf_util_create_pipeline_layout_from_metadata(
+     ngf_plmd_get_layout(pipeline_metadata), &pipeline_data.layout_info);
+  if (err == NGF_ERROR_OK) err = p->pipeline.initialize(pipe_info);
+
+  // Done with the metadata.
+  ngf_plmd_destroy(pipeline_metadata, NULL);
+  return err;
+}
+
 // Called upon application initialization.
 init_result on_initialized(uintptr_t native_handle,
                            uint32_t initial_width,
@@ -66,38 +96,13 @@ init_result on_initialized(uintptr_t native_handle,
   assert(err == NGF_ERROR_OK);
   state->default_rt = ngf::render_target(rt);
 
-  // Load shader stages.
-  state->blit_vert_stage =
-      load_shader_stage("simple-texture", "VSMain", NGF_STAGE_VERTEX);
-  state->frag_stage =
-      load_shader_stage("simple-texture", "PSMain", NGF_STAGE_FRAGMENT);
-  ngf_plmd* pipeline_metadata = load_pipeline_metadata("simple-texture");
-  assert(pipeline_metadata);
-
-  // Initial pipeline configuration with OpenGL-style defaults.
-  ngf_util_graphics_pipeline_data pipeline_data;
-  ngf_util_create_default_graphics_pipeline_data(nullptr,
-                                                 &pipeline_data);
-  ngf_graphics_pipeline_info &pipe_info = pipeline_data.pipeline_info;
-  pipe_info.nshader_stages = 2u;
-  pipe_info.shader_stages[0] = state->blit_vert_stage.get();
-  pipe_info.shader_stages[1] = state->frag_stage.get();
-  pipe_info.compatible_render_target = state->default_rt.get();
-  pipe_info.image_to_combined_map =
-      ngf_plmd_get_image_to_cis_map(pipeline_metadata);
-  pipe_info.sampler_to_combined_map =
-      ngf_plmd_get_sampler_to_cis_map(pipeline_metadata);
-  pipeline_data.multisample_info.sample_count = NGF_SAMPLE_COUNT_8;
-
-  // Create a pipeline layout from the loaded metadata.
-  err = ngf_util_create_pipeline_layout_from_metadata(
-     ngf_plmd_get_layout(pipeline_metadata), &pipeline_data.layout_info);
-  assert(err == NGF_ERROR_OK);
-  err = state->pipeline.initialize(pipe_info);
-  assert(err == NGF_ERROR_OK);
-
-  // Done with the metadata.
-  ngf_plmd_destroy(pipeline_metadata, NULL);
+  // Create the pipeline, and rebuild it when the shaders or its metadata
+  // change on disk.
+  watch_pipeline(&state->pipe, { "simple-texture", "simple-texture" },
+                 [rt = state->default_rt.get()](pipeline_objects *p) {
+                   return create_pipeline(rt, p);
+                 },
+                 { "shaders/generated/simple-texture.pipeline" });
 
   // Create the image.
   const ngf_extent3d img_size { 512u, 512u, 1u };
@@ -138,17 +143,38 @@ init_result on_initialized(uintptr_t native_handle,
   err = state->sampler.initialize(samp_info);
   assert(err == NGF_ERROR_OK);
 
+  // Re-upload the image when the texture changes on disk.
+  watch_resource({ "textures/LENA0.DATA" }, [state] {
+    auto data = std::make_shared<std::vector<char>>(
+        load_raw_data("textures/LENA0.DATA"));
+    if (data->size() != 512u * 512u * 4u) {
+      fprintf(stderr, "textures/LENA0.DATA is %zu bytes, expected %u\n",
+              data->size(), 512u * 512u * 4u);
+      return hot_reloader::apply_fn {};
+    }
+    return hot_reloader::apply_fn([state, data](ngf_cmd_buffer cmd_buf) {
+      ngf::xfer_encoder xfenc { cmd_buf };
+      const ngf_error err =
+          state->dispose_queue.write_image(xfenc,
+                                           data->data(),
+                                           data->size(),
+                                           0u,
+                                           ngf::image_ref(state->image.get()),
+                                           {0, 0, 0},
+                                           {512u, 512u, 1u});
+      assert(err == NGF_ERROR_OK);
+    });
+  });
+
   return { std::move(ctx), state};
 }
 
 // Called every frame.
 void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token frame_token) {
   app_state *state = (app_state*)userdata;
+  state->dispose_queue.update();
   ngf_irect2d viewport { 0, 0, w, h };
-  ngf_cmd_buffer cmd_buf = nullptr;
-  ngf_cmd_buffer_info cmd_info;
-  ngf_create_cmd_buffer(&cmd_info, &cmd_buf);
-  ngf_start_cmd_buffer(cmd_buf, frame_token);
+  ngf_cmd_buffer cmd_buf = acquire_cmd_buffer(frame_token);
   if (state->pixel_data_uploaded && state->pbuffer.get() != nullptr) {
     state->pbuffer.reset(nullptr);
   } else if (!state->pixel_data_uploaded) {
@@ -182,7 +208,7 @@ void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token fra
   {
     ngf::render_encoder renc{ cmd_buf };
     ngf_cmd_begin_pass(renc, state->default_rt);
-    ngf_cmd_bind_gfx_pipeline(renc, state->pipeline);
+    ngf_cmd_bind_gfx_pipeline(renc, state->pipe.pipeline);
     ngf_cmd_viewport(renc, &viewport);
     ngf_cmd_scissor(renc, &viewport);
     ngf::cmd_bind_resources(
@@ -192,8 +218,7 @@ void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token fra
     ngf_cmd_draw(renc, false, 0u, 3u, 1u);
     ngf_cmd_end_pass(renc);
   }
-  ngf_submit_cmd_buffers(1u, &cmd_buf);
-  ngf_destroy_cmd_buffer(cmd_buf);
+  enqueue_cmd_buffer(cmd_buf);
 }
 
 // Called every time the application has to dra an ImGUI overlay.
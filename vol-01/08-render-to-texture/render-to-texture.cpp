@@ -21,6 +21,7 @@ SOFTWARE.
 #include <nicegraf.h>
 #include <nicegraf_util.h>
 #include <nicegraf_wrappers.h>
+#include "render_graph.h"
 #include <imgui.h>
 #include <assert.h>
 #include <stdint.h>
@@ -28,71 +29,139 @@ SOFTWARE.
 #include <stdlib.h>
 
 struct app_state {
-  ngf::render_target default_rt;
-  ngf::render_target offscreen_rt;
+  render_graph graph;
   ngf::shader_stage blit_vert_stage;
   ngf::shader_stage blit_frag_stage;
   ngf::shader_stage offscreen_vert_stage;
   ngf::shader_stage offscreen_frag_stage;
   ngf::graphics_pipeline blit_pipeline;
+  ngf::graphics_pipeline copy_pipeline;
   ngf::graphics_pipeline offscreen_pipeline;
-  ngf::image rt_texture;
   ngf::sampler sampler;
+  ngf::sampler nearest_sampler;
+  render_graph::resource displayed_image = 0u;
+  render_graph::pass blit_pass = 0u;
+  render_graph::pass triangle_pass = 0u;
+  bool pixelate = false;
+  bool graph_pixelate = false; // Setting the graph was built with.
 };
 
-// Called upon application initialization.
-init_result on_initialized(uintptr_t native_handle,
-                           uint32_t initial_width,
-                           uint32_t initial_height) {
-  app_state *state = new app_state;
-   
-  ngf::context ctx = create_default_context(native_handle,
-                                            initial_width, initial_height);
+// Creates a pipeline that draws a full-screen triangle textured with the
+// image bound to it.
+static ngf_error create_blit_pipeline(app_state              *state,
+                                      ngf::graphics_pipeline &pipeline,
+                                      ngf_render_target       rt,
+                                      ngf_sample_count        sample_count) {
+  ngf_plmd *pipeline_metadata = load_pipeline_metadata("simple-texture");
+  ngf_util_graphics_pipeline_data pipeline_data;
+  ngf_util_create_default_graphics_pipeline_data(nullptr, &pipeline_data);
+  pipeline_data.multisample_info.sample_count = sample_count;
+  ngf_graphics_pipeline_info &pipe_info = pipeline_data.pipeline_info;
+  pipe_info.nshader_stages = 2u;
+  pipe_info.shader_stages[0] = state->blit_vert_stage.get();
+  pipe_info.shader_stages[1] = state->blit_frag_stage.get();
+  pipe_info.compatible_render_target = rt;
+  pipe_info.image_to_combined_map =
+      ngf_plmd_get_image_to_cis_map(pipeline_metadata);
+  pipe_info.sampler_to_combined_map =
+      ngf_plmd_get_sampler_to_cis_map(pipeline_metadata);
+  ngf_error err = ngf_util_create_pipeline_layout_from_metadata(
+    ngf_plmd_get_layout(pipeline_metadata), &pipeline_data.layout_info);
+  if (err == NGF_ERROR_OK) err = pipeline.initialize(pipe_info);
+  ngf_plmd_destroy(pipeline_metadata, nullptr);
+  return err;
+}
+
+// Declares the passes and compiles the graph. The triangle is rendered
+// offscreen and drawn onto the screen, optionally going through a
+// low-resolution copy first. Passes are declared in the reverse order: the
+// graph works out the order from what they read and write, and leaves out
+// the pixelation passes when nothing reads their output.
+static void build_graph(app_state *state) {
+  render_graph &g = state->graph;
+  g.reset();
+  const render_graph::image_desc full_res {
+    512u, 512u, NGF_IMAGE_FORMAT_BGRA8, NGF_SAMPLE_COUNT_1
+  };
+  const render_graph::image_desc low_res {
+    64u, 64u, NGF_IMAGE_FORMAT_BGRA8, NGF_SAMPLE_COUNT_1
+  };
+  const render_graph::resource scene = g.create_image("scene", full_res);
+  const render_graph::resource small = g.create_image("small", low_res);
+  const render_graph::resource pixelated =
+      g.create_image("pixelated", full_res);
+  const render_graph::resource displayed =
+      state->pixelate ? pixelated : scene;
+  // The displayed image is also shown in the UI, after the graph runs.
+  g.mark_output(displayed);
+  state->displayed_image = displayed;
+  state->graph_pixelate = state->pixelate;
 
-  // Set up a render pass.
   ngf_clear clear;
   clear.clear_color[0] = 0.6f;
   clear.clear_color[1] = 0.7f;
   clear.clear_color[2] = 0.8f;
   clear.clear_color[3] = 1.0f;
-  
-  // Create the image.
-  const ngf_extent3d img_size { 512u, 512u, 1u };
-  const ngf_image_info img_info {
-    NGF_IMAGE_TYPE_IMAGE_2D,
-    img_size,
-    1u,
-    NGF_IMAGE_FORMAT_BGRA8,
-    NGF_SAMPLE_COUNT_1,
-    NGF_IMAGE_USAGE_SAMPLE_FROM | NGF_IMAGE_USAGE_ATTACHMENT
-  };
-  ngf_error err = state->rt_texture.initialize(img_info);
-  assert(err == NGF_ERROR_OK);
-  
-  // Obtain the default render target.
-  ngf_render_target rt;
-  err = ngf_default_render_target(NGF_LOAD_OP_CLEAR, NGF_LOAD_OP_DONTCARE,
-                                  NGF_STORE_OP_STORE, NGF_STORE_OP_DONTCARE,
-                                  &clear, NULL, &rt);
-  assert(err == NGF_ERROR_OK);
-  state->default_rt = ngf::render_target(rt);
-  
-  // Create the offscreen render target.
-  ngf_attachment  offscreen_color_attachment{
-    {state->rt_texture.get(), 0u, 0u, NGF_CUBEMAP_FACE_POSITIVE_X},
-    NGF_ATTACHMENT_COLOR,
-    NGF_LOAD_OP_CLEAR,
-    NGF_STORE_OP_STORE,
-    {{0.0f}}
-  };
-  ngf_render_target_info rt_info {
-    &offscreen_color_attachment,
-    1u
+  state->blit_pass = g.add_pass("blit",
+    [=](render_graph::pass_builder &b) {
+      b.read(displayed);
+      b.write_color(render_graph::BACKBUFFER, NGF_LOAD_OP_CLEAR, clear);
+    },
+    [state, displayed](ngf_render_encoder enc, const ngf_irect2d&) {
+      ngf_cmd_bind_gfx_pipeline(enc, state->blit_pipeline);
+      ngf::cmd_bind_resources(enc,
+        ngf::descriptor_set<0>::binding<1>::texture(
+            state->graph.image(displayed)),
+        ngf::descriptor_set<0>::binding<2>::sampler(state->sampler.get()));
+      ngf_cmd_draw(enc, false, 0u, 3u, 1u);
+    });
+
+  // Copies `src` onto the pass's target with the given sampler.
+  auto copy = [state](render_graph::resource src, ngf_sampler sampler) {
+    return [state, src, sampler](ngf_render_encoder enc, const ngf_irect2d&) {
+      ngf_cmd_bind_gfx_pipeline(enc, state->copy_pipeline);
+      ngf::cmd_bind_resources(enc,
+        ngf::descriptor_set<0>::binding<1>::texture(state->graph.image(src)),
+        ngf::descriptor_set<0>::binding<2>::sampler(sampler));
+      ngf_cmd_draw(enc, false, 0u, 3u, 1u);
+    };
   };
-  err = state->offscreen_rt.initialize(rt_info);
+  g.add_pass("upsample",
+    [=](render_graph::pass_builder &b) {
+      b.read(small);
+      b.write_color(pixelated, NGF_LOAD_OP_DONTCARE);
+    },
+    copy(small, state->nearest_sampler.get()));
+  g.add_pass("downsample",
+    [=](render_graph::pass_builder &b) {
+      b.read(scene);
+      b.write_color(small, NGF_LOAD_OP_DONTCARE);
+    },
+    copy(scene, state->sampler.get()));
+
+  state->triangle_pass = g.add_pass("triangle",
+    [=](render_graph::pass_builder &b) {
+      b.write_color(scene, NGF_LOAD_OP_CLEAR, ngf_clear {{0.0f}});
+    },
+    [state](ngf_render_encoder enc, const ngf_irect2d&) {
+      ngf_cmd_bind_gfx_pipeline(enc, state->offscreen_pipeline);
+      ngf_cmd_draw(enc, false, 0u, 3u, 1u);
+    });
+  const ngf_error err = g.compile();
   assert(err == NGF_ERROR_OK);
+  (void)err;
+}
 
-  // Load shader stages and pipeline metadata.
+// Called upon application initialization.
+init_result on_initialized(uintptr_t native_handle,
+                           uint32_t initial_width,
+                           uint32_t initial_height) {
+  app_state *state = new app_state;
+   
+  ngf::context ctx = create_default_context(native_handle,
+                                            initial_width, initial_height);
+
+  // Load shader stages.
   state->blit_vert_stage =
       load_shader_stage("fullscreen-triangle", "VSMain", NGF_STAGE_VERTEX);
   state->blit_frag_stage =
@@ -101,45 +170,8 @@ init_result on_initialized(uintptr_t native_handle,
       load_shader_stage("small-triangle", "VSMain", NGF_STAGE_VERTEX);
   state->offscreen_frag_stage =
       load_shader_stage("small-triangle", "PSMain", NGF_STAGE_FRAGMENT);
-  ngf_plmd *pipeline_metadata = load_pipeline_metadata("simple-texture");
 
-  // Create pipeline for blit pass.
-  ngf_util_graphics_pipeline_data blit_pipeline_data;
-  ngf_util_create_default_graphics_pipeline_data(nullptr,
-                                                 &blit_pipeline_data);
-  blit_pipeline_data.multisample_info.sample_count = NGF_SAMPLE_COUNT_8;
-  ngf_graphics_pipeline_info &blit_pipe_info =
-      blit_pipeline_data.pipeline_info;
-  blit_pipe_info.nshader_stages = 2u;
-  blit_pipe_info.shader_stages[0] = state->blit_vert_stage.get();
-  blit_pipe_info.shader_stages[1] = state->blit_frag_stage.get();
-  blit_pipe_info.compatible_render_target = state->default_rt.get();
-  blit_pipe_info.image_to_combined_map =
-      ngf_plmd_get_image_to_cis_map(pipeline_metadata);
-  blit_pipe_info.sampler_to_combined_map =
-      ngf_plmd_get_sampler_to_cis_map(pipeline_metadata);
-
-  // Create a simple pipeline layout.
-  err = ngf_util_create_pipeline_layout_from_metadata(
-    ngf_plmd_get_layout(pipeline_metadata), &blit_pipeline_data.layout_info);
-  assert(err == NGF_ERROR_OK);
-  err = state->blit_pipeline.initialize(blit_pipe_info);
-  assert(err == NGF_ERROR_OK);
-
-  // Create pipeline for offscreen pass.
-  ngf_util_graphics_pipeline_data offscreen_pipeline_data;
-  ngf_util_create_default_graphics_pipeline_data(nullptr,
-                                                 &offscreen_pipeline_data);
-  ngf_graphics_pipeline_info &offscreen_pipe_info =
-      offscreen_pipeline_data.pipeline_info;
-  offscreen_pipe_info.nshader_stages = 2u;
-  offscreen_pipe_info.shader_stages[0] = state->offscreen_vert_stage.get();
-  offscreen_pipe_info.shader_stages[1] = state->offscreen_frag_stage.get();
-  offscreen_pipe_info.compatible_render_target = state->offscreen_rt.get();
-  err = state->offscreen_pipeline.initialize(offscreen_pipe_info);
-  assert(err == NGF_ERROR_OK);
-
-  // Create sampler.
+  // Create samplers.
   ngf_sampler_info samp_info {
     NGF_FILTER_LINEAR,
     NGF_FILTER_LINEAR,
@@ -154,7 +186,40 @@ init_result on_initialized(uintptr_t native_handle,
     1.0f,
     false
   };
-  err = state->sampler.initialize(samp_info);
+  ngf_error err = state->sampler.initialize(samp_info);
+  assert(err == NGF_ERROR_OK);
+  samp_info.min_filter = NGF_FILTER_NEAREST;
+  samp_info.mag_filter = NGF_FILTER_NEAREST;
+  err = state->nearest_sampler.initialize(samp_info);
+  assert(err == NGF_ERROR_OK);
+
+  // Build the render graph, and create pipelines compatible with the render
+  // targets of its passes. All offscreen passes render to a single BGRA8
+  // image, so the triangle pass's target works for both offscreen
+  // pipelines.
+  build_graph(state);
+  render_graph &g = state->graph;
+  const ngf_render_target offscreen_rt =
+      g.render_target(state->triangle_pass);
+  const ngf_render_target onscreen_rt = g.render_target(state->blit_pass);
+  err = create_blit_pipeline(state, state->blit_pipeline, onscreen_rt,
+                             get_active_context_profile().sample_count);
+  assert(err == NGF_ERROR_OK);
+  err = create_blit_pipeline(state, state->copy_pipeline, offscreen_rt,
+                             NGF_SAMPLE_COUNT_1);
+  assert(err == NGF_ERROR_OK);
+
+  // Create pipeline for offscreen pass.
+  ngf_util_graphics_pipeline_data offscreen_pipeline_data;
+  ngf_util_create_default_graphics_pipeline_data(nullptr,
+                                                 &offscreen_pipeline_data);
+  ngf_graphics_pipeline_info &offscreen_pipe_info =
+      offscreen_pipeline_data.pipeline_info;
+  offscreen_pipe_info.nshader_stages = 2u;
+  offscreen_pipe_info.shader_stages[0] = state->offscreen_vert_stage.get();
+  offscreen_pipe_info.shader_stages[1] = state->offscreen_frag_stage.get();
+  offscreen_pipe_info.compatible_render_target = offscreen_rt;
+  err = state->offscreen_pipeline.initialize(offscreen_pipe_info);
   assert(err == NGF_ERROR_OK);
 
   return { std::move(ctx), state};
@@ -163,36 +228,31 @@ init_result on_initialized(uintptr_t native_handle,
 // Called every frame.
 void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token frame_token) {
   app_state *state = (app_state*)userdata;
-  ngf_irect2d offsc_viewport { 0, 0, 512, 512 };
-  ngf_irect2d onsc_viewport {0, 0, w, h };
-  ngf_cmd_buffer cmd_buf = nullptr;
-  ngf_cmd_buffer_info cmd_info;
-  ngf_create_cmd_buffer(&cmd_info, &cmd_buf);
-  ngf_start_cmd_buffer(cmd_buf, frame_token);
+  if (state->pixelate != state->graph_pixelate) build_graph(state);
+  ngf_cmd_buffer cmd_buf = acquire_cmd_buffer(frame_token);
   {
   ngf::render_encoder renc { cmd_buf };
-  ngf_cmd_begin_pass(renc, state->offscreen_rt);
-  ngf_cmd_bind_gfx_pipeline(renc, state->offscreen_pipeline);
-  ngf_cmd_viewport(renc, &offsc_viewport);
-  ngf_cmd_scissor(renc, &offsc_viewport);
-  ngf_cmd_draw(renc, false, 0u, 3u, 1u);
-  ngf_cmd_end_pass(renc);
-  ngf_cmd_begin_pass(renc, state->default_rt);
-  ngf_cmd_bind_gfx_pipeline(renc, state->blit_pipeline);
-  ngf_cmd_viewport(renc, &onsc_viewport);
-  ngf_cmd_scissor(renc, &onsc_viewport);
-  ngf::cmd_bind_resources(renc,
-    ngf::descriptor_set<0>::binding<1>::texture(state->rt_texture.get()),
-    ngf::descriptor_set<0>::binding<2>::sampler(state->sampler.get()));
-  ngf_cmd_draw(renc, false, 0u, 3u, 1u);
-  ngf_cmd_end_pass(renc);
+  state->graph.execute(renc, w, h);
   }
-  ngf_submit_cmd_buffers(1u, &cmd_buf);
-  ngf_destroy_cmd_buffer(cmd_buf);
+  enqueue_cmd_buffer(cmd_buf);
 }
 
 // Called every time the application has to dra an ImGUI overlay.
-void on_ui(void*) { }
+void on_ui(void *userdata) {
+  app_state *state = (app_state*)userdata;
+  const render_graph::stats &stats = state->graph.get_stats();
+  ImGui::Begin("Offscreen Target", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+  ImGui::Image(
+      (ImTextureID)(uintptr_t)state->graph.image(state->displayed_image),
+      ImVec2(256.0f, 256.0f));
+  ImGui::Checkbox("pixelate", &state->pixelate);
+  ImGui::Text("passes: %u (%u culled)", stats.passes, stats.culled_passes);
+  ImGui::Text("images: %u, backed by %u", stats.images,
+              stats.backing_images);
+  ImGui::Text("image memory: %zu KB (%zu KB without aliasing)",
+              stats.backing_bytes / 1024u, stats.image_bytes / 1024u);
+  ImGui::End();
+}
 
 // Called when the app is about to close.
 void on_shutdown(void *userdata) {
@@ -27,9 +27,11 @@
 #include <nicegraf_util.h>
 #include <nicegraf_wrappers.h>
 #include <assert.h>
+#include <memory>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string>
 
 using nm::float4x4;
 using nm::float4;
@@ -46,17 +48,15 @@ struct uniform_data {
 
 struct app_state {
   ngf::render_target default_rt;
-  ngf::shader_stage blit_vert_stage;
-  ngf::shader_stage frag_stage;
-  ngf::graphics_pipeline pipeline;
+  pipeline_objects pipe;
   ngf::image image;
   ngf::sampler bilinear_sampler;
   ngf::sampler trilinear_sampler;
   ngf::sampler aniso_sampler;
   ngf::sampler nearest_sampler;
-  ngf::streamed_uniform<uniform_data> ubo;
   ngf::resource_dispose_queue dispose_queue;
   float4x4 perspective_matrix;
+  uint32_t old_w = 0u, old_h = 0u; // Size the projection was computed for.
   float4x4 view_matrix;
   float tilt = 0.0f;
   float zoom = 0.0f;
@@ -64,6 +64,72 @@ struct app_state {
   bool textures_uploaded = false;
 };
 
+static ngf_error create_pipeline(ngf_render_target rt, pipeline_objects *p) {
+  // Initial pipeline configuration with OpenGL-style defaults.
+  ngf_util_graphics_pipeline_data pipeline_data;
+  ngf_util_create_default_graphics_pipeline_data(nullptr,
+                                                 &pipeline_data);
+  pipeline_data.multisample_info.sample_count =
+      get_active_context_profile().sample_count;
+  ngf_graphics_pipeline_info &pipe_info = pipeline_data.pipeline_info;
+  pipe_info.nshader_stages = 2u;
+  pipe_info.shader_stages[0] = p->vert_stage.get();
+  pipe_info.shader_stages[1] = p->frag_stage.get();
+  pipe_info.compatible_render_target = rt;
+
+  // Create pipeline layout from metadata.
+  ngf_plmd *pipeline_metadata = try_load_pipeline_metadata("textured-quad");
+  if (pipeline_metadata == NULL) return NGF_ERROR_OBJECT_CREATION_FAILED;
+  ngf_error err = ngf_util_create_pipeline_layout_from_metadata(
+      ngf_plmd_get_layout(pipeline_metadata),
+      &pipeline_data.layout_info);
+  // The sample binds resources to both descriptor sets.
+  if (err == NGF_ERROR_OK &&
+      pipeline_data.layout_info.ndescriptor_set_layouts != 2) {
+    fprintf(stderr, "textured-quad must use two descriptor sets\n");
+    err = NGF_ERROR_INVALID_OPERATION;
+  }
+  pipe_info.image_to_combined_map =
+      ngf_plmd_get_image_to_cis_map(pipeline_metadata);
+  pipe_info.sampler_to_combined_map =
+      ngf_plmd_get_sampler_to_cis_map(pipeline_metadata);
+  if (err == NGF_ERROR_OK) err = p->pipeline.initialize(pipe_info);
+
+  // Done with the metadata.
+  ngf_plmd_destroy(pipeline_metadata, NULL);
+  return err;
+}
+
+// Number of mip levels in the texture, each of which is stored in its own
+// file.
+static constexpr uint32_t texture_mip_levels = 11u;
+
+static std::string texture_mip_path(uint32_t mip_level) {
+  return "textures/TILES" + std::to_string(mip_level) + ".DATA";
+}
+
+// Records commands that upload every mip level of the texture.
+static void upload_texture(app_state               *state,
+                           ngf_cmd_buffer           cmd_buf,
+                           const std::vector<char> *mips) {
+  uint32_t tw = 1024u, th = 1024u;
+  ngf::xfer_encoder xfenc { cmd_buf };
+  for (uint32_t mip_level = 0u; mip_level < texture_mip_levels; ++mip_level) {
+    const std::vector<char> &data = mips[mip_level];
+    const ngf_error err =
+      state->dispose_queue.write_image(xfenc,
+                                       data.data(),
+                                       data.size(),
+                                       0u,
+                                       ngf::image_ref(state->image.get(),
+                                                      mip_level),
+                                       {0u, 0u, 0u},
+                                       {tw, th, 1u});
+    assert(err == NGF_ERROR_OK);
+    tw = tw >> 1; th = th >> 1;
+  }
+}
+
 // Called upon application initialization.
 init_result on_initialized(uintptr_t native_handle,
                            uint32_t initial_width,
@@ -89,37 +155,13 @@ init_result on_initialized(uintptr_t native_handle,
   assert(err == NGF_ERROR_OK);
   state->default_rt = ngf::render_target(rt);
 
-  // Load shader stages.
-  state->blit_vert_stage =
-      load_shader_stage("textured-quad", "VSMain", NGF_STAGE_VERTEX);
-  state->frag_stage =
-      load_shader_stage("textured-quad", "PSMain", NGF_STAGE_FRAGMENT);
-
-  // Initial pipeline configuration with OpenGL-style defaults.
-  ngf_util_graphics_pipeline_data pipeline_data;
-  ngf_util_create_default_graphics_pipeline_data(nullptr,
-                                                 &pipeline_data);
-  pipeline_data.multisample_info.sample_count = NGF_SAMPLE_COUNT_8;
-  ngf_graphics_pipeline_info &pipe_info = pipeline_data.pipeline_info;
-  pipe_info.nshader_stages = 2u;
-  pipe_info.shader_stages[0] = state->blit_vert_stage.get();
-  pipe_info.shader_stages[1] = state->frag_stage.get();
-  pipe_info.compatible_render_target = state->default_rt.get();
-
-  // Create pipeline layout from metadata.
-  ngf_plmd *pipeline_metadata = load_pipeline_metadata("textured-quad");
-  assert(pipeline_metadata);
-  err = ngf_util_create_pipeline_layout_from_metadata(
-      ngf_plmd_get_layout(pipeline_metadata),
-      &pipeline_data.layout_info);
-  assert(err == NGF_ERROR_OK);
-  assert(pipeline_data.layout_info.ndescriptor_set_layouts == 2);
-  pipe_info.image_to_combined_map =
-      ngf_plmd_get_image_to_cis_map(pipeline_metadata);
-  pipe_info.sampler_to_combined_map =
-      ngf_plmd_get_sampler_to_cis_map(pipeline_metadata);
-  err = state->pipeline.initialize(pipe_info);
-  assert(err == NGF_ERROR_OK);
+  // Create the pipeline, and rebuild it when the shaders or its metadata
+  // change on disk.
+  watch_pipeline(&state->pipe, { "textured-quad", "textured-quad" },
+                 [rt = state->default_rt.get()](pipeline_objects *p) {
+                   return create_pipeline(rt, p);
+                 },
+                 { "shaders/generated/textured-quad.pipeline" });
 
   // Create the image.
   const ngf_extent3d img_size { 1024u, 1024u, 1u };
@@ -164,40 +206,58 @@ init_result on_initialized(uintptr_t native_handle,
   err = state->aniso_sampler.initialize(samp_info);
   assert(err == NGF_ERROR_OK);
 
-  // Create a streamed uniform buffer.
-  std::optional<ngf::streamed_uniform<uniform_data>> maybe_streamed_uniform;
-  std::tie(maybe_streamed_uniform, err) =
-      ngf::streamed_uniform<uniform_data>::create(3);
-  assert(err == NGF_ERROR_OK);
-  state->ubo = std::move(maybe_streamed_uniform.value());
-
   state->perspective_matrix = float4x4::identity();
   state->view_matrix = float4x4::identity();
+
+  // Re-upload the texture when any of its mip levels changes on disk.
+  std::vector<std::string> mip_files;
+  for (uint32_t mip_level = 0u; mip_level < texture_mip_levels; ++mip_level) {
+    mip_files.push_back(texture_mip_path(mip_level));
+  }
+  watch_resource(mip_files, [state] {
+    auto mips = std::make_shared<std::vector<std::vector<char>>>();
+    size_t expected_size = 1024u * 1024u * 4u;
+    for (uint32_t mip_level = 0u; mip_level < texture_mip_levels; ++mip_level) {
+      const std::string path = texture_mip_path(mip_level);
+      mips->push_back(load_raw_data(path.c_str()));
+      if (mips->back().size() != expected_size) {
+        fprintf(stderr, "%s is %zu bytes, expected %zu\n", path.c_str(),
+                mips->back().size(), expected_size);
+        return hot_reloader::apply_fn {};
+      }
+      expected_size /= 4u;
+    }
+    return hot_reloader::apply_fn([state, mips](ngf_cmd_buffer cmd_buf) {
+      upload_texture(state, cmd_buf, mips->data());
+    });
+  });
   return { std::move(ctx), state};
 }
 
-void draw_textured_quad(const ngf::streamed_uniform<uniform_data> &ubo,
+void draw_textured_quad(const transient_allocation<ngf_uniform_buffer> &ubo,
                         size_t pane,
                         const ngf_sampler sampler,
                         ngf_render_encoder renc) {
+  transient_allocation<ngf_uniform_buffer> pane_ubo = ubo;
+  pane_ubo.offset += sizeof(pane_uniform_data) * pane;
+  pane_ubo.size = sizeof(pane_uniform_data);
   ngf::cmd_bind_resources(renc,
                          ngf::descriptor_set<1>::binding<1>::sampler(sampler),
-                         ubo.bind_op_at_current_offset(
-                            1, 0, sizeof(pane_uniform_data) * pane, sizeof(pane_uniform_data)));
-                         
+                         transient_allocator::bind_op(pane_ubo, 1, 0));
+
   ngf_cmd_draw(renc, false, 0u, 6u, 1u);
 }
 
 // Called every frame.
 void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token frame_token) {
-  static uint32_t old_w = 0u, old_h = 0u;
   app_state *state = (app_state*)userdata;
-  if (old_w != w || old_h != h) {
+  state->dispose_queue.update();
+  if (state->old_w != w || state->old_h != h) {
     state->perspective_matrix = nm::perspective(nm::deg2rad(45.0f),
                                                 (float)w/(float)h,
                                                 0.1f,
                                                 100.0f);
-    old_w = w; old_h = h;
+    state->old_w = w; state->old_h = h;
   }
   const float4x4 translation =
       nm::translation(float3(-state->pan, 0.0f, -10.0f + 0.09f * state->zoom));
@@ -209,51 +269,37 @@ void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token fra
     const float4x4 model = nm::translation(origin) * nm::scale(float4 {float3{0.99f}, 1.0f});
     ubo_data.panes[i].transform_matrix = (camera * model);
   }
-  state->ubo.write(ubo_data);
+  const transient_allocation<ngf_uniform_buffer> ubo =
+      get_transient_allocator().alloc_uniform(sizeof(ubo_data));
+  assert(ubo.ptr != nullptr);
+  memcpy(ubo.ptr, &ubo_data, sizeof(ubo_data));
 
   ngf_irect2d viewport { 0, 0, w, h };
-  ngf_cmd_buffer cmd_buf = nullptr;
-  ngf_cmd_buffer_info cmd_info;
-  ngf_create_cmd_buffer(&cmd_info, &cmd_buf);
-  ngf_start_cmd_buffer(cmd_buf, frame_token);
+  ngf_cmd_buffer cmd_buf = acquire_cmd_buffer(frame_token);
   if (!state->textures_uploaded) {
-    char file_name[] = "textures/TILES00.DATA";
-    uint32_t tw = 1024u, th = 1024u;
-    for (uint32_t mip_level = 0u;  mip_level < 11u; ++mip_level) {
-      snprintf(file_name, sizeof(file_name), "textures/TILES%d.DATA", mip_level);
-      std::vector<char> data = load_raw_data(file_name);
-      ngf::xfer_encoder xfenc { cmd_buf };
-      const ngf_error err =
-        state->dispose_queue.write_image(xfenc,
-                                         data.data(),
-                                         data.size(),
-                                         0u,
-                                         ngf::image_ref(state->image.get(),
-                                                        mip_level),
-                                         {0u, 0u, 0u},
-                                         {tw, th, 1u});
-      assert(err == NGF_ERROR_OK);
-      tw = tw >> 1; th = th >> 1;
+    std::vector<char> mips[texture_mip_levels];
+    for (uint32_t mip_level = 0u; mip_level < texture_mip_levels; ++mip_level) {
+      mips[mip_level] = load_raw_data(texture_mip_path(mip_level).c_str());
     }
+    upload_texture(state, cmd_buf, mips);
     state->textures_uploaded = true;
   }
   {
     ngf::render_encoder renc{ cmd_buf };
     ngf_cmd_begin_pass(renc, state->default_rt);
-    ngf_cmd_bind_gfx_pipeline(renc, state->pipeline);
+    ngf_cmd_bind_gfx_pipeline(renc, state->pipe.pipeline);
     ngf_cmd_viewport(renc, &viewport);
     ngf_cmd_scissor(renc, &viewport);
     ngf::cmd_bind_resources(
       renc,
       ngf::descriptor_set<0>::binding<0>::texture(state->image));
-    draw_textured_quad(state->ubo, 0, state->nearest_sampler, renc);
-    draw_textured_quad(state->ubo, 1, state->bilinear_sampler, renc);
-    draw_textured_quad(state->ubo, 2, state->trilinear_sampler, renc);
-    draw_textured_quad(state->ubo, 3, state->aniso_sampler, renc);
+    draw_textured_quad(ubo, 0, state->nearest_sampler, renc);
+    draw_textured_quad(ubo, 1, state->bilinear_sampler, renc);
+    draw_textured_quad(ubo, 2, state->trilinear_sampler, renc);
+    draw_textured_quad(ubo, 3, state->aniso_sampler, renc);
     ngf_cmd_end_pass(renc);
   }
-  ngf_submit_cmd_buffers(1u, &cmd_buf);
-  ngf_destroy_cmd_buffer(cmd_buf);
+  enqueue_cmd_buffer(cmd_buf);
 }
 
 // Called every time the application has to dra an ImGUI overlay.
@@ -21,67 +21,292 @@
  */
 #define _CRT_SECURE_NO_WARNINGS
 #include "common.h"
+#include "dynamic_resolution.h"
+#include "frustum.h"
+#include "occlusion_buffer.h"
 #include <nicegraf_util.h>
 #include <nicemath.h>
 #include <imgui.h>
 #include <assert.h>
+#include <chrono>
+#include <math.h>
+#include <memory>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
 
 using nm::float4x4;
 using nm::float3;
 
-constexpr uint32_t NUM_CUBES_H = 220u;
-constexpr uint32_t NUM_CUBES_V = 220u;
+// The cubes are laid out on a square grid of up to MAX_GRID_SIZE^2
+// instances.
+constexpr uint32_t DEFAULT_GRID_SIZE = 220u;
+constexpr uint32_t MAX_GRID_SIZE = 1000u;
+constexpr float    CUBE_SPACING = 5.0f;
 
-union mtw {
-  float4x4 matrix;
-  uint8_t padding[256];
+// Radius of a sphere bounding a cube, wherever its animation takes it.
+constexpr float    CUBE_BOUNDING_RADIUS = 1.7320508f + 1.0f;
+
+// Half-extents of a box bounding a cube, wherever its animation takes it.
+// Cubes rotate around Y and bob along Z.
+constexpr float    CUBE_BOUNDING_BOX[3] = {
+  1.4142136f, 1.0f, 1.4142136f + 1.0f
+};
+
+// Walls made of large cubes run across the grid, and serve as occluders.
+constexpr uint32_t NUM_WALLS = 3u;
+constexpr float    WALL_CUBE_SCALE = 10.0f;
+
+// Number of instances culled and written by a single job. Must be a
+// multiple of 32, so that batches don't share words of the visibility mask.
+constexpr uint32_t INSTANCE_BATCH_SIZE = 8192u;
+static_assert(INSTANCE_BATCH_SIZE % 32u == 0u,
+              "batch size not a multiple of 32");
+
+// Vertical field of view, as given to nm::perspective.
+constexpr float    CAMERA_FOVY = 70.0f;
+
+// Camera positions to compare culling results between.
+enum camera_preset {
+  CAMERA_TOP_DOWN,   // Looking down at the grid's center.
+  CAMERA_OVERVIEW,   // Far enough to see the whole grid.
+  CAMERA_LOW_ANGLE,  // Looking across the grid from its edge.
+  CAMERA_PRESET_COUNT
+};
+static const char *camera_preset_names[CAMERA_PRESET_COUNT] = {
+  "top-down", "overview", "low angle"
+};
+
+// Culling results for a frame.
+struct cull_stats {
+  uint32_t total = 0u;      // Instances in the grid.
+  uint32_t visible = 0u;    // Instances that survived culling.
+  float    cull_ms = 0.0f;  // Time spent testing instances.
+  float    compact_ms = 0.0f; // Time spent writing the survivors.
+  uint32_t occluded = 0u;   // Instances hidden by the occluders.
+  uint32_t occluder_triangles = 0u;
+  float    raster_ms = 0.0f; // Time spent rasterizing the occluders.
+};
+
+// Per-instance data, as consumed by the vertex shader.
+struct instance_data {
+  float    offset_scale[4]; // World-space position and uniform scale.
+  float    rotation[2];     // Sine and cosine of the angle around Y.
+  uint32_t color;           // RGBA8.
+  uint32_t padding;
 };
+static_assert(sizeof(instance_data) == 32u, "unexpected instance data size");
 
 struct app_state {
-  ngf::render_target     default_render_target;
-  ngf::shader_stage      blit_vert_stage;
-  ngf::shader_stage      frag_stage;
-  ngf::graphics_pipeline pipeline;
+  dynamic_resolution     dynres;
+  pipeline_objects       pipe;
   ngf::attrib_buffer     attr_buf;
   ngf::index_buffer      idx_buf;
-  ngf::uniform_buffer    world_to_clip_ub;
   ngf::image             texture;
   ngf::sampler           sampler;
   ngf::cmd_buffer        cmdbuf;
   ngf::resource_dispose_queue dispose_queue;
   bool                   resources_uploaded = false;
+  int                    grid_size = (int)DEFAULT_GRID_SIZE;
+  camera_preset          camera = CAMERA_TOP_DOWN;
+  float                  camera_distance = 150.0f;
+  bool                   animate = true;
+  bool                   cull = true;
+  bool                   occlusion_cull = true;
+  float                  anim_time = 0.0f;
+  uint32_t               instances_drawn = 0u;
+  std::vector<uint32_t>  visible_mask; // One bit per instance.
+  std::vector<uint32_t>  batch_counts;
+  std::vector<uint32_t>  batch_offsets; // Within the compacted stream.
+  std::vector<uint32_t>  batch_occluded;
+  std::vector<instance_data> walls;
+  occlusion_buffer       occlusion { 256u, 128u };
+  cull_stats             last_stats;
+  // Most recent results with each camera preset.
+  cull_stats             preset_stats[CAMERA_PRESET_COUNT];
 };
 
-init_result on_initialized(uintptr_t native_window_handle,
-                           uint32_t  initial_window_width,
-                           uint32_t  initial_window_height) {
-  app_state *state = new app_state;
+// Cheap integer hash, used to derive per-instance variation.
+static uint32_t hash_instance(uint32_t i) {
+  i ^= i >> 16u;
+  i *= 0x7feb352du;
+  i ^= i >> 15u;
+  i *= 0x846ca68bu;
+  i ^= i >> 16u;
+  return i;
+}
 
-  // Create and activate a nicegraf context with default settings.
-  ngf::context ctx = create_default_context(native_window_handle,
-                                            initial_window_width,
-                                            initial_window_height);
-  
-  // Obtain the default render target from the context that we just created.
-  ngf_render_target default_render_target = nullptr;
-  ngf_clear clear_color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-  ngf_clear clear_depth;
-  clear_depth.clear_depth = 1.0f;
-  ngf_error err =
-      ngf_default_render_target(NGF_LOAD_OP_CLEAR,
-                                NGF_LOAD_OP_CLEAR,
-                                NGF_STORE_OP_STORE,
-                                NGF_STORE_OP_DONTCARE,
-                                &clear_color,
-                                &clear_depth,
-                                &default_render_target);
-  assert(err == NGF_ERROR_OK);
-  state->default_render_target.reset(default_render_target);
-  
-  // Load shader stages.
-  state->blit_vert_stage = load_shader_stage("cubes-instanced", "VSMainInstanced", NGF_STAGE_VERTEX);
-  state->frag_stage = load_shader_stage("cubes-instanced", "PSMain", NGF_STAGE_FRAGMENT);
-  
+// Computes the data for instance `i` of a grid with the given size.
+static instance_data make_instance(uint32_t i, uint32_t grid_size,
+                                   float time) {
+  const uint32_t h = hash_instance(i);
+  const float phase = (float)(h & 0xffffu) * (6.2831853f / 65536.0f);
+  const float angle = time * (0.5f + (float)((h >> 16u) & 0xffu) / 128.0f) +
+                      phase;
+  instance_data inst;
+  inst.offset_scale[0] = (float)(i % grid_size) * CUBE_SPACING;
+  inst.offset_scale[1] = (float)(i / grid_size) * CUBE_SPACING;
+  inst.offset_scale[2] = sinf(time * 2.0f + phase);
+  inst.offset_scale[3] = 0.75f + 0.25f * sinf(time + phase);
+  inst.rotation[0] = sinf(angle);
+  inst.rotation[1] = cosf(angle);
+  inst.color = h | 0xff000000u;
+  inst.padding = 0u;
+  return inst;
+}
+
+// Tests instances [begin, end) against the frustum, four at a time, then
+// against the occlusion buffer, and sets the bits of the ones that survive
+// in `mask_words`, which has one bit per instance of the grid. `begin` must
+// be a multiple of 32. Null `f` or `occ` skip the corresponding test. Returns
+// the number of survivors, and the number hidden by occluders in
+// `noccluded`.
+static uint32_t cull_instances(uint32_t               *mask_words,
+                               uint32_t                begin,
+                               uint32_t                end,
+                               uint32_t                grid_size,
+                               const frustum          *f,
+                               const occlusion_buffer *occ,
+                               uint32_t               *noccluded) {
+  uint32_t count = 0u;
+  *noccluded = 0u;
+  memset(mask_words + begin / 32u, 0,
+         sizeof(uint32_t) * ((end - begin + 31u) / 32u));
+  for (uint32_t i = begin; i < end; i += 4u) {
+    const uint32_t n = end - i < 4u ? end - i : 4u;
+    uint32_t mask = (1u << n) - 1u;
+    if (f != nullptr) {
+      // Bounding spheres are centered on the grid cell, which is where the
+      // cubes bob around.
+      float x[4], y[4];
+      const float z[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+      for (uint32_t lane = 0u; lane < 4u; ++lane) {
+        const uint32_t idx = i + (lane < n ? lane : 0u);
+        x[lane] = (float)(idx % grid_size) * CUBE_SPACING;
+        y[lane] = (float)(idx / grid_size) * CUBE_SPACING;
+      }
+      mask &= f->test_spheres4(x, y, z, CUBE_BOUNDING_RADIUS);
+    }
+    for (uint32_t lane = 0u; lane < n; ++lane) {
+      if ((mask & (1u << lane)) == 0u) continue;
+      const uint32_t idx = i + lane;
+      if (occ != nullptr) {
+        const float x = (float)(idx % grid_size) * CUBE_SPACING;
+        const float y = (float)(idx / grid_size) * CUBE_SPACING;
+        const float box_min[3] = {
+          x - CUBE_BOUNDING_BOX[0], y - CUBE_BOUNDING_BOX[1],
+          -CUBE_BOUNDING_BOX[2]
+        };
+        const float box_max[3] = {
+          x + CUBE_BOUNDING_BOX[0], y + CUBE_BOUNDING_BOX[1],
+          CUBE_BOUNDING_BOX[2]
+        };
+        if (occ->is_occluded(box_min, box_max)) {
+          ++*noccluded;
+          continue;
+        }
+      }
+      mask_words[idx / 32u] |= 1u << (idx % 32u);
+      ++count;
+    }
+  }
+  return count;
+}
+
+// Writes the instances in [begin, end) whose bits are set in `mask_words`
+// to consecutive locations starting at `dst`. `begin` must be a multiple of
+// 32. The instances that didn't survive culling aren't computed at all.
+static void write_instances(instance_data  *dst,
+                            const uint32_t *mask_words,
+                            uint32_t        begin,
+                            uint32_t        end,
+                            uint32_t        grid_size,
+                            float           time) {
+  for (uint32_t word = begin / 32u; word * 32u < end; ++word) {
+    uint32_t bits = mask_words[word];
+    for (uint32_t idx = word * 32u; bits != 0u; ++idx, bits >>= 1u) {
+      if ((bits & 1u) != 0u) *dst++ = make_instance(idx, grid_size, time);
+    }
+  }
+}
+
+// Lays out the walls for a grid of the given size: rows of large cubes
+// standing on the grid, at even intervals. Returns the instances in
+// `walls`, and queues one box per wall as an occluder.
+static void make_walls(uint32_t                    grid_size,
+                       std::vector<instance_data> &walls,
+                       occlusion_buffer           &occlusion) {
+  // Corners and faces of the cube, for rasterizing occluders.
+  static const float box_positions[] = {
+    -1.f, -1.f, -1.f,   1.f, -1.f, -1.f,   1.f,  1.f, -1.f,  -1.f,  1.f, -1.f,
+    -1.f, -1.f,  1.f,   1.f, -1.f,  1.f,   1.f,  1.f,  1.f,  -1.f,  1.f,  1.f
+  };
+  static const uint16_t box_indices[] = {
+    0, 2, 1, 0, 3, 2,  4, 5, 6, 4, 6, 7,  0, 1, 5, 0, 5, 4,
+    3, 6, 2, 3, 7, 6,  0, 4, 7, 0, 7, 3,  1, 2, 6, 1, 6, 5
+  };
+  walls.clear();
+  const float extent = (float)(grid_size - 1u) * CUBE_SPACING;
+  const float cube_size = 2.0f * WALL_CUBE_SCALE;
+  const uint32_t cubes_per_wall = (uint32_t)(extent / cube_size) + 1u;
+  if (extent < cube_size) return;
+  for (uint32_t wall = 1u; wall <= NUM_WALLS; ++wall) {
+    const float y = extent * (float)wall / (float)(NUM_WALLS + 1u);
+    const float z = WALL_CUBE_SCALE - 1.0f; // Standing on the grid.
+    for (uint32_t i = 0u; i < cubes_per_wall; ++i) {
+      instance_data inst;
+      inst.offset_scale[0] = (float)i * cube_size;
+      inst.offset_scale[1] = y;
+      inst.offset_scale[2] = z;
+      inst.offset_scale[3] = WALL_CUBE_SCALE;
+      inst.rotation[0] = 0.0f;
+      inst.rotation[1] = 1.0f;
+      inst.color = 0xff808080u;
+      inst.padding = 0u;
+      walls.push_back(inst);
+    }
+    // The cubes of a wall touch, so a single box covers all of them.
+    const float half_length =
+        (float)cubes_per_wall * WALL_CUBE_SCALE;
+    const float4x4 model_to_world =
+        nm::translation(float3 { half_length - WALL_CUBE_SCALE, y, z }) *
+        nm::scale(nm::float4 {
+          half_length, WALL_CUBE_SCALE, WALL_CUBE_SCALE, 1.0f
+        });
+    occlusion.add_occluder(box_positions, box_indices, 36u, model_to_world);
+  }
+}
+
+// Returns the world-to-clip transform for the given camera preset.
+static float4x4 camera_transform(const app_state *state,
+                                 uint32_t         grid_size,
+                                 float            aspect_ratio) {
+  const float extent = (float)(grid_size - 1u) * CUBE_SPACING;
+  const float center = extent * 0.5f;
+  float3 eye { center, center, state->camera_distance };
+  float3 target { center, center, 0.0f };
+  float3 up { 0.0f, 1.0f, 0.0f };
+  switch (state->camera) {
+  case CAMERA_OVERVIEW:
+    eye = float3 { center, center,
+                   (center + 10.0f) / tanf(CAMERA_FOVY * 0.5f) };
+    break;
+  case CAMERA_LOW_ANGLE:
+    eye = float3 { center, -20.0f, 30.0f };
+    target = float3 { center, center, 0.0f };
+    up = float3 { 0.0f, 0.0f, 1.0f };
+    break;
+  default:
+    break;
+  }
+  const float far_dist = nm::length(target - eye) + extent + 100.0f;
+  const float4x4 clip_from_view =
+      nm::perspective(CAMERA_FOVY, aspect_ratio, 0.1f, far_dist);
+  return clip_from_view * nm::look_at(eye, target, up);
+}
+
+static ngf_error create_pipeline(ngf_render_target rt, pipeline_objects *p) {
   // Create the initial pipeline configuration with OpenGL-style defaults.
   ngf_util_graphics_pipeline_data pipeline_data;
   ngf_util_create_default_graphics_pipeline_data(nullptr,
@@ -90,47 +315,87 @@ init_result on_initialized(uintptr_t native_window_handle,
 
   // Set up shader stages.
   pipe_info.nshader_stages = 2u;
-  pipe_info.shader_stages[0] = state->blit_vert_stage.get();
-  pipe_info.shader_stages[1] = state->frag_stage.get();
+  pipe_info.shader_stages[0] = p->vert_stage.get();
+  pipe_info.shader_stages[1] = p->frag_stage.get();
   
   // Set compatible render target.
-  pipe_info.compatible_render_target = state->default_render_target.get();
+  pipe_info.compatible_render_target = rt;
 
   // Enable depth testing and writing.
   pipeline_data.depth_stencil_info.depth_test = true;
   pipeline_data.depth_stencil_info.depth_write = true;
 
-  // Set up multisampling.
-  pipeline_data.multisample_info.sample_count = NGF_SAMPLE_COUNT_8;
+  // Set up multisampling. The offscreen target is not multisampled.
+  pipeline_data.multisample_info.sample_count = NGF_SAMPLE_COUNT_1;
   pipeline_data.multisample_info.alpha_to_coverage = false;
 
-  // Set up pipeline's vertex input.
+  // Set up pipeline's vertex input. Binding 0 holds the cube's vertices,
+  // binding 1 holds per-instance data.
   const ngf_vertex_attrib_desc attrib_descs[] = {
     {0, 0, 0, NGF_TYPE_FLOAT, 3, false},
-    {1, 0, sizeof(float) * 3, NGF_TYPE_FLOAT, 2, false}
+    {1, 0, sizeof(float) * 3, NGF_TYPE_FLOAT, 2, false},
+    {2, 1, offsetof(instance_data, offset_scale), NGF_TYPE_FLOAT, 4, false},
+    {3, 1, offsetof(instance_data, rotation), NGF_TYPE_FLOAT, 2, false},
+    {4, 1, offsetof(instance_data, color), NGF_TYPE_UINT8, 4, true}
   };
-  const ngf_vertex_buf_binding_desc binding_desc = {
-    0, sizeof(float) * 5u, NGF_INPUT_RATE_VERTEX 
+  const ngf_vertex_buf_binding_desc binding_descs[] = {
+    {0, sizeof(float) * 5u, NGF_INPUT_RATE_VERTEX},
+    {1, sizeof(instance_data), NGF_INPUT_RATE_INSTANCE}
   };
-  pipeline_data.vertex_input_info.nattribs = 2u;
+  pipeline_data.vertex_input_info.nattribs = 5u;
   pipeline_data.vertex_input_info.attribs = attrib_descs;
-  pipeline_data.vertex_input_info.nvert_buf_bindings = 1u;
-  pipeline_data.vertex_input_info.vert_buf_bindings = &binding_desc;
+  pipeline_data.vertex_input_info.nvert_buf_bindings = 2u;
+  pipeline_data.vertex_input_info.vert_buf_bindings = binding_descs;
   
   // Create pipeline layout from metadata.
-  ngf_plmd *pipeline_metadata = load_pipeline_metadata("cubes-instanced");
-  assert(pipeline_metadata);
-  ngf_util_create_pipeline_layout_from_metadata(
+  ngf_plmd *pipeline_metadata =
+      try_load_pipeline_metadata("cubes-instanced");
+  if (pipeline_metadata == NULL) return NGF_ERROR_OBJECT_CREATION_FAILED;
+  ngf_error err = ngf_util_create_pipeline_layout_from_metadata(
       ngf_plmd_get_layout(pipeline_metadata),
       &pipeline_data.layout_info);
-  assert(pipeline_data.layout_info.ndescriptor_set_layouts == 1);
+  // All of the sample's resources are in one descriptor set.
+  if (err == NGF_ERROR_OK &&
+      pipeline_data.layout_info.ndescriptor_set_layouts != 1) {
+    fprintf(stderr, "cubes-instanced must use one descriptor set\n");
+    err = NGF_ERROR_INVALID_OPERATION;
+  }
   pipe_info.image_to_combined_map =
       ngf_plmd_get_image_to_cis_map(pipeline_metadata);
   pipe_info.sampler_to_combined_map =
       ngf_plmd_get_sampler_to_cis_map(pipeline_metadata);
-  state->pipeline.reset(nullptr);
-  state->pipeline.initialize(pipe_info);
+  if (err == NGF_ERROR_OK) err = p->pipeline.initialize(pipe_info);
   ngf_plmd_destroy(pipeline_metadata, nullptr);
+  return err;
+}
+
+init_result on_initialized(uintptr_t native_window_handle,
+                           uint32_t  initial_window_width,
+                           uint32_t  initial_window_height) {
+  app_state *state = new app_state;
+
+  // Create and activate a nicegraf context with default settings.
+  ngf::context ctx = create_default_context(native_window_handle,
+                                            initial_window_width,
+                                            initial_window_height);
+  
+  // The cubes are rendered into a scaled offscreen target, which is then
+  // upscaled to the default render target.
+  ngf_clear clear_color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+  ngf_error err =
+      state->dynres.initialize(initial_window_width,
+                               initial_window_height,
+                               get_active_context_profile().depth_format,
+                               clear_color);
+  assert(err == NGF_ERROR_OK);
+  
+  // Create the pipeline, and rebuild it when the shaders or its metadata
+  // change on disk.
+  watch_pipeline(&state->pipe,
+                 { "cubes-instanced", "cubes-instanced", "VSMainInstanced" },
+                 [rt = state->dynres.compatible_render_target()](
+                     pipeline_objects *p) { return create_pipeline(rt, p); },
+                 { "shaders/generated/cubes-instanced.pipeline" });
 
   // Create the texture image.
   const ngf_extent3d img_size { 512u, 512u, 1u };
@@ -169,7 +434,7 @@ init_result on_initialized(uintptr_t native_window_handle,
   return { std::move(ctx), state };
 }
 
-void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token frame_token) {
+void on_frame(uint32_t w, uint32_t h, float time, void *userdata, ngf_frame_token frame_token) {
   app_state      *state = (app_state*)userdata;
   ngf_cmd_buffer  b     = state->cmdbuf.get();
 
@@ -274,28 +539,6 @@ void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token fra
         sizeof(cube_indices),
         0,
         0);
-    // Create a uniform buffer.
-    const ngf_uniform_buffer_info world_to_clip_ub_info =
-        { sizeof(float4x4), NGF_BUFFER_STORAGE_PRIVATE, NGF_BUFFER_USAGE_XFER_DST };
-    err = state->world_to_clip_ub.initialize(world_to_clip_ub_info);
-    assert(err == NGF_ERROR_OK);
-
-    // Set up transforms.
-    const float  aspect_ratio   = (float)w / (float)h;
-    const float4x4 clip_from_view =
-        nm::perspective(70.0f, aspect_ratio, 0.01f, 1000.0f);
-    const float4x4 view_from_world =
-        nm::look_at(nm::float3 { 110.0f, 110.0f, 150.0f },
-                    nm::float3 { 110.0f, 110.0f, 0.0f },
-                    nm::float3 {0.0f, 1.0f, 0.0f});
-    const float4x4 world_to_clip = clip_from_view * view_from_world;
-    err = state->dispose_queue.write_buffer(xfenc,
-                                            state->world_to_clip_ub,
-                                            (void*)&world_to_clip,
-                                            sizeof(float4x4),
-                                            0,
-                                            0);
-    assert(err == NGF_ERROR_OK);
     // Create texture and load data into it.
     FILE *image = fopen("textures/LENA0.DATA", "rb");
     assert(image != NULL);
@@ -316,18 +559,104 @@ void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token fra
     assert(err == NGF_ERROR_OK);
     state->resources_uploaded = true;
   }
+
+  // Set up transforms.
+  const uint32_t grid_size = (uint32_t)state->grid_size;
+  const float4x4 world_to_clip =
+      camera_transform(state, grid_size, (float)w / (float)h);
+
+  // Rasterize the walls into the occlusion buffer.
+  const auto raster_start = std::chrono::steady_clock::now();
+  state->occlusion.begin_frame(world_to_clip);
+  make_walls(grid_size, state->walls, state->occlusion);
+  if (state->occlusion_cull) state->occlusion.rasterize(get_thread_pool());
+  const auto raster_end = std::chrono::steady_clock::now();
+
+  // Cull the instances, splitting the batches across the thread pool. This
+  // only marks the survivors in a bitmask and counts them per batch.
+  if (state->animate) state->anim_time = time;
+  const uint32_t ninstances = grid_size * grid_size;
+  const uint32_t nbatches =
+      (ninstances + INSTANCE_BATCH_SIZE - 1u) / INSTANCE_BATCH_SIZE;
+  state->visible_mask.resize((ninstances + 31u) / 32u);
+  state->batch_counts.resize(nbatches);
+  state->batch_offsets.resize(nbatches);
+  state->batch_occluded.resize(nbatches);
+  const frustum view_frustum(world_to_clip);
+  const frustum *cull_frustum = state->cull ? &view_frustum : nullptr;
+  uint32_t *mask = state->visible_mask.data();
+  uint32_t *counts = state->batch_counts.data();
+  uint32_t *occluded = state->batch_occluded.data();
+  const occlusion_buffer *occ =
+      state->occlusion_cull ? &state->occlusion : nullptr;
+  const float anim_time = state->anim_time;
+  const auto cull_start = std::chrono::steady_clock::now();
+  get_thread_pool().parallel_for(
+      ninstances, INSTANCE_BATCH_SIZE,
+      [=](uint32_t begin, uint32_t end) {
+        const uint32_t batch = begin / INSTANCE_BATCH_SIZE;
+        counts[batch] = cull_instances(mask, begin, end, grid_size,
+                                       cull_frustum, occ, &occluded[batch]);
+      });
+  const auto cull_end = std::chrono::steady_clock::now();
+
+  // An exclusive prefix sum over the per-batch counts gives the location of
+  // each batch's survivors in the compacted instance stream.
+  uint32_t nvisible = 0u, noccluded = 0u;
+  for (uint32_t b = 0u; b < nbatches; ++b) {
+    state->batch_offsets[b] = nvisible;
+    nvisible += counts[b];
+    noccluded += occluded[b];
+  }
+
+  // Write the survivors straight into transient memory, one batch per job,
+  // followed by the walls. If the allocation fails, the allocator will have
+  // grown to fit it in a few frames, and the cubes are skipped until then.
+  const uint32_t nwalls = (uint32_t)state->walls.size();
+  transient_allocation<ngf_attrib_buffer> instances {};
+  if (nvisible + nwalls > 0u) {
+    instances = get_transient_allocator().alloc_attrib(
+        sizeof(instance_data) * (nvisible + nwalls), sizeof(float));
+  }
+  state->instances_drawn = 0u;
+  if (instances.ptr != nullptr) {
+    instance_data *dst = (instance_data*)instances.ptr;
+    memcpy(dst + nvisible, state->walls.data(),
+           sizeof(instance_data) * nwalls);
+    const uint32_t *offsets = state->batch_offsets.data();
+    get_thread_pool().parallel_for(
+        ninstances, INSTANCE_BATCH_SIZE,
+        [=](uint32_t begin, uint32_t end) {
+          const uint32_t batch = begin / INSTANCE_BATCH_SIZE;
+          write_instances(dst + offsets[batch], mask, begin, end, grid_size,
+                          anim_time);
+        });
+    state->instances_drawn = nvisible + nwalls;
+  }
+  const auto compact_end = std::chrono::steady_clock::now();
+
+  cull_stats &stats = state->last_stats;
+  stats.total = ninstances;
+  stats.visible = nvisible;
+  stats.cull_ms = std::chrono::duration<float, std::milli>(
+      cull_end - cull_start).count();
+  stats.compact_ms = std::chrono::duration<float, std::milli>(
+      compact_end - cull_end).count();
+  stats.occluded = noccluded;
+  stats.occluder_triangles =
+      state->occlusion_cull ? state->occlusion.triangle_count() : 0u;
+  stats.raster_ms = std::chrono::duration<float, std::milli>(
+      raster_end - raster_start).count();
+  if (state->cull) state->preset_stats[state->camera] = stats;
+
   {
   ngf::render_encoder renc{ b };
-  ngf_cmd_begin_pass(renc, state->default_render_target.get());
-  ngf_cmd_bind_gfx_pipeline(renc, state->pipeline.get());
+  const ngf_irect2d viewport_rect = state->dynres.begin_frame(w, h, time);
+  ngf_cmd_begin_pass(renc, state->dynres.render_target());
+  ngf_cmd_bind_gfx_pipeline(renc, state->pipe.pipeline.get());
 
   ngf_resource_bind_op rbops[3];
-  rbops[0].target_set = 0u;
-  rbops[0].target_binding = 0u;
-  rbops[0].type = NGF_DESCRIPTOR_UNIFORM_BUFFER;
-  rbops[0].info.uniform_buffer.buffer = state->world_to_clip_ub.get();
-  rbops[0].info.uniform_buffer.offset = 0u;
-  rbops[0].info.uniform_buffer.range = sizeof(float4x4);
+  rbops[0] = get_transient_allocator().upload_uniform(world_to_clip, 0, 0);
   rbops[1].target_set = 0u;
   rbops[1].target_binding = 2u;
   rbops[1].type = NGF_DESCRIPTOR_TEXTURE;
@@ -337,21 +666,94 @@ void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token fra
   rbops[2].type = NGF_DESCRIPTOR_SAMPLER;
   rbops[2].info.image_sampler.sampler = state->sampler.get();
   ngf_cmd_bind_gfx_resources(renc, rbops, 3u);
-  const ngf_irect2d viewport_rect{
-    0, 0, w, h
-  };
   ngf_cmd_viewport(renc, &viewport_rect);
   ngf_cmd_scissor(renc, &viewport_rect);
-  ngf_cmd_bind_attrib_buffer(renc, state->attr_buf.get(), 0, 0);
-  ngf_cmd_bind_index_buffer(renc, state->idx_buf.get(), NGF_TYPE_UINT16);
-  ngf_cmd_draw(renc, true, 0, 36, NUM_CUBES_H* NUM_CUBES_V);
+  if (state->instances_drawn > 0u) {
+    ngf_cmd_bind_attrib_buffer(renc, state->attr_buf.get(), 0, 0);
+    ngf_cmd_bind_attrib_buffer(renc, instances.buffer, 1,
+                               (uint32_t)instances.offset);
+    ngf_cmd_bind_index_buffer(renc, state->idx_buf.get(), NGF_TYPE_UINT16);
+    ngf_cmd_draw(renc, true, 0, 36, state->instances_drawn);
+  }
 
   ngf_cmd_end_pass(renc);
+  state->dynres.record_upscale(renc);
   }
-  ngf_submit_cmd_buffers(1u, &b);
+  enqueue_cmd_buffer(b);
 }
 
-void on_ui(void*) { }
+void on_ui(void *userdata) {
+  app_state *state = (app_state*)userdata;
+  resolution_controller &ctl = state->dynres.controller();
+  ImGui::Begin("Dynamic Resolution", nullptr,
+               ImGuiWindowFlags_AlwaysAutoResize);
+  bool adaptive = ctl.adaptive();
+  if (ImGui::Checkbox("adaptive", &adaptive)) ctl.set_adaptive(adaptive);
+  float target_ms = ctl.target_frame_ms();
+  if (ImGui::SliderFloat("target (ms)", &target_ms, 4.0f, 50.0f)) {
+    ctl.set_target_frame_ms(target_ms);
+  }
+  ImGui::Text("frame time: %.2f ms", ctl.smoothed_frame_ms());
+  ImGui::Text("scale: %.2f (%u x %u)", ctl.scale(),
+              state->dynres.scaled_width(), state->dynres.scaled_height());
+  ImGui::End();
+
+  ImGui::Begin("Instances", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+  ImGui::SliderInt("grid size", &state->grid_size, 1,
+                   (int)MAX_GRID_SIZE);
+  for (int i = 0; i < CAMERA_PRESET_COUNT; ++i) {
+    if (i > 0) ImGui::SameLine();
+    if (ImGui::RadioButton(camera_preset_names[i], state->camera == i)) {
+      state->camera = (camera_preset)i;
+    }
+  }
+  if (state->camera == CAMERA_TOP_DOWN) {
+    ImGui::SliderFloat("camera distance", &state->camera_distance, 10.0f,
+                       4000.0f);
+  }
+  ImGui::Checkbox("animate", &state->animate);
+  ImGui::Checkbox("frustum culling", &state->cull);
+  ImGui::Checkbox("occlusion culling", &state->occlusion_cull);
+  const cull_stats &stats = state->last_stats;
+  ImGui::Text("instances: %u of %u drawn (%u occluded)", stats.visible,
+              stats.total, stats.occluded);
+  ImGui::Text("instance data: %.2f MB/frame",
+              (float)(sizeof(instance_data) * state->instances_drawn) /
+                  (1024.0f * 1024.0f));
+  ImGui::Text("cull: %.2f ms, compact: %.2f ms on %u threads",
+              stats.cull_ms, stats.compact_ms,
+              get_thread_pool().size() + 1u);
+  ImGui::Text("occluders: %u triangles in %.3f ms (%.1f K triangles/ms)",
+              stats.occluder_triangles, stats.raster_ms,
+              stats.raster_ms > 0.0f
+                  ? (float)stats.occluder_triangles / stats.raster_ms / 1000.0f
+                  : 0.0f);
+
+  // Compare the results of culling from each camera position. Throughput
+  // counts all tested instances; vertex work is the number of vertex
+  // shader invocations the draw would otherwise have needed.
+  ImGui::Separator();
+  ImGui::Text("culling results per camera (most recent):");
+  for (int i = 0; i < CAMERA_PRESET_COUNT; ++i) {
+    const cull_stats &s = state->preset_stats[i];
+    if (s.total == 0u) {
+      ImGui::Text("  %-10s not measured yet", camera_preset_names[i]);
+      continue;
+    }
+    const float culled_fraction =
+        1.0f - (float)s.visible / (float)s.total;
+    ImGui::Text("  %-10s %5.1f%% culled (%5.1f%% occluded), "
+                "%6.1f M instances/s, %.1f M fewer indexed vertices",
+                camera_preset_names[i], 100.0f * culled_fraction,
+                100.0f * (float)s.occluded / (float)s.total,
+                s.cull_ms > 0.0f ? (float)s.total / (s.cull_ms * 1000.0f)
+                                 : 0.0f,
+                (float)(s.total - s.visible) * 36.0f / 1000000.0f);
+  }
+  ImGui::End();
+}
 
-void on_shutdown(void*) {}
+void on_shutdown(void *userdata) {
+  delete (app_state*)userdata;
+}
 
@@ -22,6 +22,14 @@ SOFTWARE.
 #include <imgui.h>
 #include <TextEditor.h>
 #include <assert.h>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
 
 #if defined(_MSC_VER_)
 #define SED_PATH_SEPARATOR "\\"
@@ -29,6 +37,18 @@ SOFTWARE.
 #define SED_PATH_SEPARATOR "/"
 #endif
 
+// Only the shaders for the backend in use are needed.
+#if defined(NGF_BACKEND_OPENGL)
+#define SED_SHADERC_TARGET "gl430"
+#elif defined(NGF_BACKEND_VULKAN)
+#define SED_SHADERC_TARGET "spv"
+#else
+#define SED_SHADERC_TARGET "msl12"
+#endif
+
+// How long the text has to stay unchanged before it gets recompiled.
+static constexpr std::chrono::milliseconds recompile_delay { 500 };
+
 struct uniform_data {
   float time;
   float time_delta;
@@ -36,18 +56,128 @@ struct uniform_data {
   float height;
 };
 
+// Outcome of compiling the editor's contents.
+struct compile_result {
+  bool                     ok = false;
+  std::string              log; // Compiler output.
+  TextEditor::ErrorMarkers error_markers;
+  ngf::shader_stage        vert_stage;
+  ngf::shader_stage        frag_stage;
+  ngf::graphics_pipeline   pipeline;
+};
+
 struct app_state {
-  ngf::render_target     default_render_target;
-  ngf::shader_stage      blit_vert_stage;
-  ngf::shader_stage      frag_stage;
-  ngf::graphics_pipeline pipeline;
-  ngf::cmd_buffer        cmdbuf;
-  ngf::streamed_uniform<uniform_data> uniform_data;
-  TextEditor             editor;
-  bool                   err_flag = false;
-  bool                   force_update = true;
+  ngf::render_target          default_render_target;
+  ngf::shader_stage           blit_vert_stage;
+  ngf::shader_stage           frag_stage;
+  ngf::graphics_pipeline      pipeline;
+  ngf::cmd_buffer             cmdbuf;
+  TextEditor                  editor;
+  bool                        err_flag = false;
+  std::string                 compiler_log;
+  // The compilation in progress, if any, and where its result goes.
+  std::future<void>               compile_job;
+  std::shared_ptr<compile_result> compiled;
+  // Whether there are edits that haven't been compiled yet.
+  bool                        edit_pending = true;
+  std::chrono::steady_clock::time_point last_edit_time;
+  // Runs the compilations, one at a time. Started along with the first one.
+  // Declared last, so that its thread is joined before anything else goes.
+  std::unique_ptr<thread_pool> compiler;
 };
 
+// Extracts error markers for the editor from the compiler output. Messages
+// that refer to a line of the source look like "live.hlsl:LINE:COL: ..." or
+// "live.hlsl(LINE,COL): ...".
+static TextEditor::ErrorMarkers parse_error_markers(const std::string &log) {
+  TextEditor::ErrorMarkers markers;
+  size_t line_start = 0u;
+  while (line_start < log.size()) {
+    size_t line_end = log.find('\n', line_start);
+    if (line_end == std::string::npos) line_end = log.size();
+    const std::string line = log.substr(line_start, line_end - line_start);
+    const size_t name_pos = line.find("live.hlsl");
+    if (name_pos != std::string::npos) {
+      const char *p = line.c_str() + name_pos + strlen("live.hlsl");
+      const int line_number = (*p == ':' || *p == '(') ? atoi(p + 1) : 0;
+      if (line_number > 0) {
+        std::string &marker = markers[line_number];
+        if (!marker.empty()) marker += "\n";
+        marker += line;
+      }
+    }
+    line_start = line_end + 1u;
+  }
+  return markers;
+}
+
+// Compiles the given source and creates a pipeline from it. Runs on a
+// background thread, so that the UI stays responsive meanwhile. The compiler
+// output may be broken or half-written, so failures to load it are reported
+// in the log rather than asserted on.
+static compile_result compile_shader(const std::string &source,
+                                     ngf_render_target  rt) {
+  compile_result result;
+  FILE *hlsl_file = fopen("live.hlsl", "wb");
+  fprintf(hlsl_file, "%s\n//T: live vs:VSMain ps:PSMain\n", source.c_str());
+  fclose(hlsl_file);
+  const int status =
+      system(".." SED_PATH_SEPARATOR "nicegraf-shaderc" SED_PATH_SEPARATOR
+             "nicegraf_shaderc live.hlsl -t " SED_SHADERC_TARGET
+             " > live.log 2>&1");
+  std::ifstream log_file("live.log", std::ios::binary);
+  result.log.assign(std::istreambuf_iterator<char>(log_file),
+                    std::istreambuf_iterator<char>());
+  if (status != 0) {
+    result.error_markers = parse_error_markers(result.log);
+    return result;
+  }
+  if (try_load_shader_stage(&result.vert_stage, "live", "VSMain",
+                            NGF_STAGE_VERTEX, "./") != NGF_ERROR_OK ||
+      try_load_shader_stage(&result.frag_stage, "live", "PSMain",
+                            NGF_STAGE_FRAGMENT, "./") != NGF_ERROR_OK) {
+    result.log += "\nFailed to load the compiled shader stages.\n";
+    return result;
+  }
+
+  // Initial pipeline configuration with OpenGL-style defaults.
+  ngf_util_graphics_pipeline_data pipeline_data;
+  ngf_util_create_default_graphics_pipeline_data(nullptr,
+    &pipeline_data);
+  ngf_graphics_pipeline_info &pipe_info = pipeline_data.pipeline_info;
+  pipe_info.nshader_stages = 2u;
+  pipe_info.shader_stages[0] = result.vert_stage.get();
+  pipe_info.shader_stages[1] = result.frag_stage.get();
+  pipe_info.compatible_render_target = rt;
+  pipeline_data.multisample_info.sample_count =
+      get_active_context_profile().sample_count;
+  // Create pipeline layout from metadata.
+  ngf_plmd *pipeline_metadata = try_load_pipeline_metadata("textured-quad");
+  if (pipeline_metadata == nullptr) {
+    result.log += "\nFailed to load the pipeline metadata.\n";
+    return result;
+  }
+  ngf_error err = ngf_util_create_pipeline_layout_from_metadata(
+      ngf_plmd_get_layout(pipeline_metadata),
+      &pipeline_data.layout_info);
+  if (err == NGF_ERROR_OK &&
+      pipeline_data.layout_info.ndescriptor_set_layouts != 2) {
+    err = NGF_ERROR_OBJECT_CREATION_FAILED;
+  }
+  pipe_info.image_to_combined_map =
+      ngf_plmd_get_image_to_cis_map(pipeline_metadata);
+  pipe_info.sampler_to_combined_map =
+      ngf_plmd_get_sampler_to_cis_map(pipeline_metadata);
+  if (err == NGF_ERROR_OK) err = result.pipeline.initialize(pipe_info);
+  ngf_plmd_destroy(pipeline_metadata, nullptr);
+  if (err != NGF_ERROR_OK) {
+    result.log += "\nFailed to create a pipeline from the shaders.\n";
+    return result;
+  }
+  result.ok = true;
+  return result;
+}
+
 init_result on_initialized(uintptr_t native_window_handle,
                            uint32_t  initial_window_width,
                            uint32_t  initial_window_height) {
@@ -75,13 +205,6 @@ init_result on_initialized(uintptr_t native_window_handle,
   // Create a command buffer.
   state->cmdbuf.initialize(ngf_cmd_buffer_info{});
 
-  // Create a streamed uniform buffer.
-  std::optional<ngf::streamed_uniform<uniform_data>> maybe_streamed_uniform;
-  std::tie(maybe_streamed_uniform, err) =
-      ngf::streamed_uniform<uniform_data>::create(3);
-  assert(err == NGF_ERROR_OK);
-  state->uniform_data = std::move(maybe_streamed_uniform.value());
-
   state->editor.SetLanguageDefinition( TextEditor::LanguageDefinition::HLSL());
   state->editor.SetText(R"SHADER(#include "shaders/hlsl/editor-preamble.hlsl"
 
@@ -91,95 +214,104 @@ float4 PSMain(Triangle_PSInput ps_in) : SV_TARGET {
   return { std::move(ctx), state };
 }
 
-void on_frame(uint32_t w, uint32_t h, float time, void *userdata) {
+void on_frame(uint32_t w, uint32_t h, float time, void *userdata,
+              ngf_frame_token frame_token) {
   static float prev_time = time;
 
   app_state      *state = (app_state*)userdata;
   ngf_cmd_buffer  b     = state->cmdbuf.get();
-  state->uniform_data.write(uniform_data {
-    time,
-    time - prev_time,
-    (float)w,
-    (float)h
-  });
-  ngf_start_cmd_buffer(b);
-  ngf::render_encoder renc { b };
-  ngf_cmd_begin_pass(renc, state->default_render_target.get());
-  if (state->pipeline.get() != nullptr) {
-    ngf_cmd_bind_gfx_pipeline(renc, state->pipeline.get());
-    ngf_resource_bind_op rbop =
-        state->uniform_data.bind_op_at_current_offset(0, 0);
-    ngf_cmd_bind_gfx_resources(renc, &rbop, 1u);
-    const ngf_irect2d viewport_rect{
-      0, 0, w, h
-    };
-    ngf_cmd_viewport(renc, &viewport_rect);
-    ngf_cmd_scissor(renc, &viewport_rect);
-    ngf_cmd_draw(renc, false, 0, 3, 1);
+
+  // Pick up the result of a finished compilation. The new pipeline replaces
+  // the old one between frames; until then, the old one keeps rendering.
+  if (state->compile_job.valid() &&
+      state->compile_job.wait_for(std::chrono::seconds(0)) ==
+          std::future_status::ready) {
+    state->compile_job.get();
+    compile_result result = std::move(*state->compiled);
+    state->compiled.reset();
+    state->err_flag = !result.ok;
+    state->compiler_log = std::move(result.log);
+    state->editor.SetErrorMarkers(result.error_markers);
+    if (result.ok) {
+      state->pipeline = std::move(result.pipeline);
+      state->blit_vert_stage = std::move(result.vert_stage);
+      state->frag_stage = std::move(result.frag_stage);
+    }
   }
-  ngf_cmd_end_pass(renc);
-  ngf_render_encoder_end(renc);
-  ngf_submit_cmd_buffers(1u, &b);
+
+  const ngf_resource_bind_op rbop =
+      get_transient_allocator().upload_uniform(uniform_data {
+        time,
+        time - prev_time,
+        (float)w,
+        (float)h
+      }, 0, 0);
+  ngf_start_cmd_buffer(b, frame_token);
+  {
+    ngf::render_encoder renc { b };
+    ngf_cmd_begin_pass(renc, state->default_render_target.get());
+    if (state->pipeline.get() != nullptr) {
+      ngf_cmd_bind_gfx_pipeline(renc, state->pipeline.get());
+      ngf_cmd_bind_gfx_resources(renc, &rbop, 1u);
+      const ngf_irect2d viewport_rect{
+        0, 0, w, h
+      };
+      ngf_cmd_viewport(renc, &viewport_rect);
+      ngf_cmd_scissor(renc, &viewport_rect);
+      ngf_cmd_draw(renc, false, 0, 3, 1);
+    }
+    ngf_cmd_end_pass(renc);
+  }
+  enqueue_cmd_buffer(b);
 }
 
 void on_ui(void *userdata) {
   app_state *state = (app_state*)userdata;
   ImGui::Begin("Shader Editor", nullptr, 0u);
-  if (state->force_update) {
-    ImGui::Button("Hold on...");
-    state->err_flag = false;
-    FILE *hlsl_file = fopen("live.hlsl", "wb");
-    fprintf(hlsl_file, "%s\n//T: live vs:VSMain ps:PSMain\n",
-            state->editor.GetText().c_str());
-    fclose(hlsl_file);
-    int status =
-        system(".." SED_PATH_SEPARATOR "nicegraf-shaderc" SED_PATH_SEPARATOR
-               "nicegraf_shaderc live.hlsl -t gl430 -t msl12");
-    if (status == 0) {
-      state->blit_vert_stage = load_shader_stage("live", "VSMain", NGF_STAGE_VERTEX,
-                                            "./");
-      state->frag_stage = load_shader_stage("live", "PSMain",
-                                             NGF_STAGE_FRAGMENT, "./");
-
-      // Initial pipeline configuration with OpenGL-style defaults.
-      ngf_util_graphics_pipeline_data pipeline_data;
-      ngf_util_create_default_graphics_pipeline_data(nullptr,
-        &pipeline_data);
-      ngf_graphics_pipeline_info &pipe_info = pipeline_data.pipeline_info;
-      pipe_info.nshader_stages = 2u;
-      pipe_info.shader_stages[0] = state->blit_vert_stage.get();
-      pipe_info.shader_stages[1] = state->frag_stage.get();
-      pipe_info.compatible_render_target = state->default_render_target.get();
-      // Create pipeline layout from metadata.
-      ngf_plmd *pipeline_metadata = load_pipeline_metadata("textured-quad");
-      assert(pipeline_metadata);
-      ngf_util_create_pipeline_layout_from_metadata(
-          ngf_plmd_get_layout(pipeline_metadata),
-          &pipeline_data.layout_info);
-      assert(pipeline_data.layout_info.ndescriptor_set_layouts == 2);
-      pipe_info.image_to_combined_map =
-          ngf_plmd_get_image_to_cis_map(pipeline_metadata);
-      pipe_info.sampler_to_combined_map =
-          ngf_plmd_get_sampler_to_cis_map(pipeline_metadata);
-      state->pipeline.reset(nullptr);
-      state->pipeline.initialize(pipe_info);
-      ngf_plmd_destroy(pipeline_metadata, nullptr);
-    } else {
-      state->err_flag = true;
-    }
-    state->force_update = false;
-  } else if (ImGui::Button("Update")) {
-    state->force_update = true;
+
+  // Recompile once the text has stopped changing for a bit, or right away
+  // when asked to. Only one compilation runs at a time; edits made meanwhile
+  // get compiled after it finishes.
+  const auto now = std::chrono::steady_clock::now();
+  if (state->editor.IsTextChanged()) {
+    state->edit_pending = true;
+    state->last_edit_time = now;
+  }
+  if (ImGui::Button("Update")) {
+    state->edit_pending = true;
+    state->last_edit_time = std::chrono::steady_clock::time_point {};
   }
-  if (state->err_flag) {
+  if (state->edit_pending && !state->compile_job.valid() &&
+      now - state->last_edit_time >= recompile_delay) {
+    state->edit_pending = false;
+    if (!state->compiler) state->compiler = create_background_thread_pool(1u);
+    std::shared_ptr<compile_result> result =
+        std::make_shared<compile_result>();
+    const std::string source = state->editor.GetText();
+    const ngf_render_target rt = state->default_render_target.get();
+    state->compiled = result;
+    state->compile_job = state->compiler->enqueue([result, source, rt] {
+      *result = compile_shader(source, rt);
+    });
+  }
+  if (state->compile_job.valid()) {
+    ImGui::SameLine();
+    ImGui::Text("Compiling...");
+  } else if (state->err_flag) {
     ImGui::SameLine();
     ImGui::TextColored(
       ImVec4(1.0f, 0.0f, 0.0f, 1.0f),
-     "Error occurred, check console!\n");
+     "Compilation failed, see the marked lines.\n");
+  }
+  if (state->err_flag && ImGui::CollapsingHeader("Compiler output")) {
+    ImGui::TextWrapped("%s", state->compiler_log.c_str());
   }
   state->editor.Render("Shader Editor");
   ImGui::End();
 }
 
-void on_shutdown(void*) {}
-
+void on_shutdown(void *userdata) {
+  app_state *state = (app_state*)userdata;
+  if (state->compile_job.valid()) state->compile_job.wait();
+  delete state;
+}
@@ -27,9 +27,12 @@
 #include <nicemath.h>
 #include <imgui.h>
 #include <assert.h>
+#include <memory>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string>
+#include <vector>
 
 using nm::float4x4;
 
@@ -46,17 +49,52 @@ struct uniform_data {
 
 struct app_state {
   ngf::render_target default_rt;
-  ngf::shader_stage blit_vert_stage;
-  ngf::shader_stage frag_stage;
-  ngf::graphics_pipeline pipeline;
+  pipeline_objects pipe;
   ngf::image image;
   ngf::pixel_buffer pbuffer;
   ngf::sampler sampler;
+  ngf::resource_dispose_queue dispose_queue;
   bool pixel_data_uploaded = false;
   uniform_data udata;
-  ngf::streamed_uniform<uniform_data> uniform_buffer;
 };
 
+static ngf_error create_pipeline(ngf_render_target rt, pipeline_objects *p) {
+  ngf_plmd* pipeline_metadata = try_load_pipeline_metadata("cubemap");
+  if (pipeline_metadata == NULL) return NGF_ERROR_OBJECT_CREATION_FAILED;
+
+  // Initial pipeline configuration with OpenGL-style defaults.
+  ngf_util_graphics_pipeline_data pipeline_data;
+  ngf_util_create_default_graphics_pipeline_data(nullptr,
+                                                 &pipeline_data);
+  pipeline_data.multisample_info.sample_count =
+      get_active_context_profile().sample_count;
+  ngf_graphics_pipeline_info &pipe_info = pipeline_data.pipeline_info;
+  pipe_info.nshader_stages = 2u;
+  pipe_info.shader_stages[0] = p->vert_stage.get();
+  pipe_info.shader_stages[1] = p->frag_stage.get();
+  pipe_info.compatible_render_target = rt;
+  pipe_info.image_to_combined_map =
+      ngf_plmd_get_image_to_cis_map(pipeline_metadata);
+  pipe_info.sampler_to_combined_map =
+      ngf_plmd_get_sampler_to_cis_map(pipeline_metadata);
+
+  // Create a pipeline layout from the loaded metadata.
+  ngf_error err = ngf_util_create_pipeline_layout_from_metadata(
+     ngf_plmd_get_layout(pipeline_metadata), &pipeline_data.layout_info);
+  if (err == NGF_ERROR_OK) err = p->pipeline.initialize(pipe_info);
+
+  // Done with the metadata.
+  ngf_plmd_destroy(pipeline_metadata, NULL);
+  return err;
+}
+
+// Size of one face of the cubemap, in bytes.
+static constexpr size_t cube_face_bytes = 2048u * 2048u * 4u;
+
+static std::string cube_face_path(uint32_t face) {
+  return "textures/CUBE0F" + std::to_string(face) + ".DATA";
+}
+
 // Called upon application initialization.
 init_result on_initialized(uintptr_t native_handle,
                            uint32_t initial_width,
@@ -82,38 +120,13 @@ init_result on_initialized(uintptr_t native_handle,
   assert(err == NGF_ERROR_OK);
   state->default_rt = ngf::render_target(rt);
 
-  // Load shader stages.
-  state->blit_vert_stage =
-      load_shader_stage("cubemap", "VSMain", NGF_STAGE_VERTEX);
-  state->frag_stage =
-      load_shader_stage("cubemap", "PSMain", NGF_STAGE_FRAGMENT);
-  ngf_plmd* pipeline_metadata = load_pipeline_metadata("cubemap");
-  assert(pipeline_metadata);
-
-  // Initial pipeline configuration with OpenGL-style defaults.
-  ngf_util_graphics_pipeline_data pipeline_data;
-  ngf_util_create_default_graphics_pipeline_data(nullptr,
-                                                 &pipeline_data);
-  pipeline_data.multisample_info.sample_count = NGF_SAMPLE_COUNT_8;
-  ngf_graphics_pipeline_info &pipe_info = pipeline_data.pipeline_info;
-  pipe_info.nshader_stages = 2u;
-  pipe_info.shader_stages[0] = state->blit_vert_stage.get();
-  pipe_info.shader_stages[1] = state->frag_stage.get();
-  pipe_info.compatible_render_target = state->default_rt.get();
-  pipe_info.image_to_combined_map =
-      ngf_plmd_get_image_to_cis_map(pipeline_metadata);
-  pipe_info.sampler_to_combined_map =
-      ngf_plmd_get_sampler_to_cis_map(pipeline_metadata);
-
-  // Create a pipeline layout from the loaded metadata.
-  err = ngf_util_create_pipeline_layout_from_metadata(
-     ngf_plmd_get_layout(pipeline_metadata), &pipeline_data.layout_info);
-  assert(err == NGF_ERROR_OK);
-  err = state->pipeline.initialize(pipe_info);
-  assert(err == NGF_ERROR_OK);
-
-  // Done with the metadata.
-  ngf_plmd_destroy(pipeline_metadata, NULL);
+  // Create the pipeline, and rebuild it when the shaders or its metadata
+  // change on disk.
+  watch_pipeline(&state->pipe, { "cubemap", "cubemap" },
+                 [rt = state->default_rt.get()](pipeline_objects *p) {
+                   return create_pipeline(rt, p);
+                 },
+                 { "shaders/generated/cubemap.pipeline" });
 
   // Create the image.
   const ngf_extent3d img_size { 2048u, 2048u, 1u };
@@ -154,21 +167,59 @@ init_result on_initialized(uintptr_t native_handle,
   err = state->sampler.initialize(samp_info);
   assert(err == NGF_ERROR_OK);
 
-  std::optional<ngf::streamed_uniform<uniform_data>> maybe_uniform_buffer;
-  std::tie(maybe_uniform_buffer, err) = ngf::streamed_uniform<uniform_data>::create(3);
-  assert(err == NGF_ERROR_OK);
-  state->uniform_buffer = std::move(maybe_uniform_buffer.value());
+  // Re-upload the cubemap when any of its faces changes on disk.
+  std::vector<std::string> face_files;
+  for (uint32_t face = NGF_CUBEMAP_FACE_POSITIVE_X;
+       face < NGF_CUBEMAP_FACE_COUNT;
+       face++) {
+    face_files.push_back(cube_face_path(face));
+  }
+  watch_resource(face_files, [state] {
+    auto faces = std::make_shared<std::vector<std::vector<char>>>();
+    for (uint32_t face = NGF_CUBEMAP_FACE_POSITIVE_X;
+         face < NGF_CUBEMAP_FACE_COUNT;
+         face++) {
+      const std::string path = cube_face_path(face);
+      faces->push_back(load_raw_data(path.c_str()));
+      if (faces->back().size() != cube_face_bytes) {
+        fprintf(stderr, "%s is %zu bytes, expected %zu\n", path.c_str(),
+                faces->back().size(), cube_face_bytes);
+        return hot_reloader::apply_fn {};
+      }
+    }
+    return hot_reloader::apply_fn([state, faces](ngf_cmd_buffer cmd_buf) {
+      ngf::xfer_encoder xfenc { cmd_buf };
+      for (uint32_t face = NGF_CUBEMAP_FACE_POSITIVE_X;
+           face < NGF_CUBEMAP_FACE_COUNT;
+           face++) {
+        const std::vector<char> &data = (*faces)[face];
+        const ngf_image_ref img_ref = {
+          state->image,
+          0,
+          0,
+          (ngf_cubemap_face)face
+        };
+        const ngf_error err =
+            state->dispose_queue.write_image(xfenc,
+                                             data.data(),
+                                             data.size(),
+                                             0u,
+                                             img_ref,
+                                             {0, 0, 0},
+                                             {2048u, 2048u, 1u});
+        assert(err == NGF_ERROR_OK);
+      }
+    });
+  });
   return { std::move(ctx), state};
 }
 
 // Called every frame.
 void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token frame_token) {
   app_state *state = (app_state*)userdata;
+  state->dispose_queue.update();
   ngf_irect2d viewport { 0, 0, w, h };
-  ngf_cmd_buffer cmd_buf = nullptr;
-  ngf_cmd_buffer_info cmd_info;
-  ngf_create_cmd_buffer(&cmd_info, &cmd_buf);
-  ngf_start_cmd_buffer(cmd_buf, frame_token);
+  ngf_cmd_buffer cmd_buf = acquire_cmd_buffer(frame_token);
   if (state->pixel_data_uploaded && state->pbuffer.get() != nullptr) {
     state->pbuffer.reset(nullptr);
   } else if (!state->pixel_data_uploaded) {
@@ -210,23 +261,23 @@ void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token fra
     state->pixel_data_uploaded = true;
   }
   state->udata.aspect_ratio = (float)w/(float)h;
-  state->uniform_buffer.write(state->udata);
+  const ngf_resource_bind_op uniform_bind_op =
+      get_transient_allocator().upload_uniform(state->udata, 0, 0);
   {
     ngf::render_encoder renc{ cmd_buf };
     ngf_cmd_begin_pass(renc, state->default_rt);
-    ngf_cmd_bind_gfx_pipeline(renc, state->pipeline);
+    ngf_cmd_bind_gfx_pipeline(renc, state->pipe.pipeline);
     ngf_cmd_viewport(renc, &viewport);
     ngf_cmd_scissor(renc, &viewport);
     // Create and write to the descriptor set.
     ngf::cmd_bind_resources(renc,
-      state->uniform_buffer.bind_op_at_current_offset(0, 0),
+      uniform_bind_op,
       ngf::descriptor_set<0>::binding<1>::texture(state->image.get()),
       ngf::descriptor_set<0>::binding<2>::sampler(state->sampler.get()));
     ngf_cmd_draw(renc, false, 0u, 3u, 1u);
     ngf_cmd_end_pass(renc);
   }
-  ngf_submit_cmd_buffers(1u, &cmd_buf);
-  ngf_destroy_cmd_buffer(cmd_buf);
+  enqueue_cmd_buffer(cmd_buf);
 }
 
 // Called every time the application has to dra an ImGUI overlay.
@@ -21,10 +21,13 @@
  */
 #define _CRT_SECURE_NO_WARNINGS
 #include "common.h"
+#include "simulation.h"
 #include <nicegraf_util.h>
 #include <nicemath.h>
 #include <imgui.h>
 #include <assert.h>
+#include <atomic>
+#include <memory>
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
@@ -37,6 +40,11 @@ union uniform_data {
   uint8_t padding[256];
 };
 
+// State advanced by the simulation thread.
+struct spin_state {
+  float angle = 0.0f; // Extra rotation about the model's Y axis, in radians.
+};
+
 struct app_state {
   ngf::render_target     default_render_target;
   ngf::shader_stage      blit_vert_stage;
@@ -57,7 +65,10 @@ struct app_state {
   uint16_t               num_elements = 0u;
   bool                   buffers_uploaded = false;
   ngf::resource_dispose_queue dispose_queue;
-  ngf::streamed_uniform<uniform_data> uniform_buffer;
+  bool                   auto_rotate = false;
+  float                  spin_speed_ui = 1.0f;
+  std::atomic<float>     spin_speed { 0.0f }; // Radians per second.
+  std::unique_ptr<simulation_thread<spin_state>> spin_simulation;
 };
 
 init_result on_initialized(uintptr_t native_window_handle,
@@ -108,7 +119,8 @@ init_result on_initialized(uintptr_t native_window_handle,
   pipeline_data.depth_stencil_info.depth_write = true;
 
   // Set up multisampling.
-  pipeline_data.multisample_info.sample_count = NGF_SAMPLE_COUNT_8;
+  pipeline_data.multisample_info.sample_count =
+      get_active_context_profile().sample_count;
   pipeline_data.multisample_info.alpha_to_coverage = false;
 
   // Set up pipeline's vertex input.
@@ -142,12 +154,13 @@ init_result on_initialized(uintptr_t native_window_handle,
   // Create a command buffer.
   state->cmdbuf.initialize(ngf_cmd_buffer_info{});
 
-  // Create a streamed uniform buffer.
-  std::optional<ngf::streamed_uniform<uniform_data>> maybe_streamed_uniform;
-  std::tie(maybe_streamed_uniform, err) =
-    ngf::streamed_uniform<uniform_data>::create(3);
-  assert(err == NGF_ERROR_OK);
-  state->uniform_buffer = std::move(maybe_streamed_uniform.value());
+  // Spin the model on a separate thread at a fixed rate. The render thread
+  // only reads the latest snapshot, so frame times don't affect the motion.
+  state->spin_simulation.reset(new simulation_thread<spin_state>(
+      60.0f, spin_state{}, [state](spin_state &s, float dt) {
+        s.angle += state->spin_speed.load(std::memory_order_relaxed) * dt;
+        if (s.angle > 2.0f * nm::PI) s.angle -= 2.0f * nm::PI;
+      }));
 
   return { std::move(ctx), state };
 }
@@ -192,9 +205,16 @@ void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token fra
     state->num_elements = (uint16_t)vert_data.size();
     state->buffers_uploaded = true;
   }
+  const spin_state spin = state->spin_simulation->sample(
+      [](const spin_state &prev, const spin_state &cur, float t) {
+        float delta = cur.angle - prev.angle;
+        if (delta < 0.0f) delta += 2.0f * nm::PI; // Wrapped around.
+        return spin_state { prev.angle + delta * t };
+      });
   state->world_from_model = nm::scale(float4 { 0.059f, 0.059f, 0.059f, 1.0f })
                           * nm::rotation_z(state->model_rot_world[2])
-                          * nm::rotation_y(state->model_rot_world[1])
+                          * nm::rotation_y(state->model_rot_world[1] +
+                                           spin.angle)
                           * nm::rotation_x(state->model_rot_world[0])
                           * nm::translation(state->model_pos_world);
   state->view_from_world  = nm::look_at(state->camera_pos_world,
@@ -207,14 +227,13 @@ void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token fra
   uniform_data final_transform {
       state->clip_from_view * state->view_from_world * state->world_from_model
   };
-  state->uniform_buffer.write(final_transform);
+  const ngf_resource_bind_op uniform_bind_op =
+      get_transient_allocator().upload_uniform(final_transform, 0, 0);
   {
     ngf::render_encoder render_enc{ b };
     ngf_cmd_begin_pass(render_enc, state->default_render_target.get());
     ngf_cmd_bind_gfx_pipeline(render_enc, state->pipeline.get());
-    ngf::cmd_bind_resources(
-      render_enc,
-      state->uniform_buffer.bind_op_at_current_offset(0, 0));
+    ngf::cmd_bind_resources(render_enc, uniform_bind_op);
     const ngf_irect2d viewport_rect{
       0, 0, w, h
     };
@@ -224,7 +243,7 @@ void on_frame(uint32_t w, uint32_t h, float, void *userdata, ngf_frame_token fra
     ngf_cmd_draw(render_enc, false, 0, state->num_elements, 1u);
     ngf_cmd_end_pass(render_enc);
   }
-  ngf_submit_cmd_buffers(1u, &b);
+  enqueue_cmd_buffer(b);
 }
 
 void on_ui(void *userdata) { 
@@ -250,10 +269,15 @@ void on_ui(void *userdata) {
   ImGui::SliderFloat("Camera Z",
                      &state->camera_pos_world.data[2], -100.0, 100.0);
   ImGui::SliderFloat("Verical FOV", &state->persp_fovy, 1.0, 180.0);
+  ImGui::Checkbox("Auto-rotate", &state->auto_rotate);
+  ImGui::SliderFloat("Spin speed", &state->spin_speed_ui, 0.0f, 2.0f * nm::PI);
+  state->spin_speed = state->auto_rotate ? state->spin_speed_ui : 0.0f;
   ImGui::End();
 }
 
 void on_shutdown(void *userdata) {
-  delete (app_state*)userdata;
+  app_state *state = (app_state*)userdata;
+  state->spin_simulation.reset(); // Stop ticking before the state goes away.
+  delete state;
 }
 